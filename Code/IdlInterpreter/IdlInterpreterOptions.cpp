@@ -24,6 +24,7 @@
 #include <QtGui/QGridLayout>
 #include <QtGui/QLabel>
 #include <QtGui/QMessageBox>
+#include <QtGui/QSpinBox>
 #include <QtGui/QWidget>
 
 REGISTER_PLUGIN(Idl, IdlInterpreterOptions, OptionQWidgetWrapper<IdlInterpreterOptions>());
@@ -50,6 +51,34 @@ IdlInterpreterOptions::IdlInterpreterOptions()
    mpVersion->setDuplicatesEnabled(false);
    mpVersion->setInsertPolicy(QComboBox::InsertAlphabetically);
 
+   QLabel* pTileCacheLabel = new QLabel("Tile Cache Size:", pIdlConfigWidget);
+   mpTileCacheSize = new QSpinBox(pIdlConfigWidget);
+   mpTileCacheSize->setRange(0, 65536);
+   mpTileCacheSize->setSuffix(" MB");
+   mpTileCacheSize->setToolTip("Memory used to keep on-disk data between ARRAY_TO_IDL calls. "
+      "Set to 0 to disable the cache.");
+
+   QLabel* pResultCacheLabel = new QLabel("Result Cache Size:", pIdlConfigWidget);
+   mpResultCacheSize = new QSpinBox(pIdlConfigWidget);
+   mpResultCacheSize->setRange(0, 65536);
+   mpResultCacheSize->setSuffix(" MB");
+   mpResultCacheSize->setToolTip("Memory used to keep copies of ARRAY_TO_IDL results so requesting unchanged "
+      "data again is fast. Set to 0 to disable the cache.");
+
+   QLabel* pOverviewCacheLabel = new QLabel("Overview Cache Size:", pIdlConfigWidget);
+   mpOverviewCacheSize = new QSpinBox(pIdlConfigWidget);
+   mpOverviewCacheSize->setRange(0, 65536);
+   mpOverviewCacheSize->setSuffix(" MB");
+   mpOverviewCacheSize->setToolTip("Memory used to keep the reduced resolution bands built by "
+      "OPTICKS_VIEW_ARRAY. Set to 0 to disable the cache.");
+
+   QLabel* pConcurrentRowsLabel = new QLabel("Concurrent Rows:", pIdlConfigWidget);
+   mpConcurrentRows = new QSpinBox(pIdlConfigWidget);
+   mpConcurrentRows->setRange(0, 1000000);
+   mpConcurrentRows->setSpecialValueText("Automatic");
+   mpConcurrentRows->setToolTip("Number of rows paged in at once when data is transferred to or from IDL. "
+      "Automatic picks the number from the shape of each request.");
+
    QGridLayout* pIdlConfigLayout = new QGridLayout(pIdlConfigWidget);
    pIdlConfigLayout->setMargin(0);
    pIdlConfigLayout->setSpacing(5);
@@ -57,13 +86,25 @@ IdlInterpreterOptions::IdlInterpreterOptions()
    pIdlConfigLayout->addWidget(mpDll, 0, 1);
    pIdlConfigLayout->addWidget(pVersionLabel, 1, 0);
    pIdlConfigLayout->addWidget(mpVersion, 1, 1, Qt::AlignLeft);
+   pIdlConfigLayout->addWidget(pTileCacheLabel, 2, 0);
+   pIdlConfigLayout->addWidget(mpTileCacheSize, 2, 1, Qt::AlignLeft);
+   pIdlConfigLayout->addWidget(pResultCacheLabel, 3, 0);
+   pIdlConfigLayout->addWidget(mpResultCacheSize, 3, 1, Qt::AlignLeft);
+   pIdlConfigLayout->addWidget(pOverviewCacheLabel, 4, 0);
+   pIdlConfigLayout->addWidget(mpOverviewCacheSize, 4, 1, Qt::AlignLeft);
+   pIdlConfigLayout->addWidget(pConcurrentRowsLabel, 5, 0);
+   pIdlConfigLayout->addWidget(mpConcurrentRows, 5, 1, Qt::AlignLeft);
    pIdlConfigLayout->setColumnStretch(1, 10);
-   pIdlConfigLayout->setRowStretch(2, 10);
+   pIdlConfigLayout->setRowStretch(6, 10);
 
    LabeledSection* pIdlConfigSection = new LabeledSection(pIdlConfigWidget, "IDL Configuration", this);
    const Filename* pTmpFile = IdlInterpreterOptions::getSettingDLL();
    setDll(pTmpFile);
    setVersion(QString::fromStdString(IdlInterpreterOptions::getSettingVersion()));
+   mpTileCacheSize->setValue(static_cast<int>(IdlInterpreterOptions::getSettingTileCacheSize()));
+   mpResultCacheSize->setValue(static_cast<int>(IdlInterpreterOptions::getSettingResultCacheSize()));
+   mpOverviewCacheSize->setValue(static_cast<int>(IdlInterpreterOptions::getSettingOverviewCacheSize()));
+   mpConcurrentRows->setValue(static_cast<int>(IdlInterpreterOptions::getSettingConcurrentRows()));
 
    // Initialization
    addSection(pIdlConfigSection, 100);
@@ -94,6 +135,12 @@ void IdlInterpreterOptions::setVersion(const QString& version)
 
 void IdlInterpreterOptions::applyChanges()
 {
+   // these are read on each use so they take effect immediately
+   IdlInterpreterOptions::setSettingTileCacheSize(static_cast<unsigned int>(mpTileCacheSize->value()));
+   IdlInterpreterOptions::setSettingResultCacheSize(static_cast<unsigned int>(mpResultCacheSize->value()));
+   IdlInterpreterOptions::setSettingOverviewCacheSize(static_cast<unsigned int>(mpOverviewCacheSize->value()));
+   IdlInterpreterOptions::setSettingConcurrentRows(static_cast<unsigned int>(mpConcurrentRows->value()));
+
    std::string newFilename = mpDll->getFilename().toStdString();
    std::string currentFilename;
 
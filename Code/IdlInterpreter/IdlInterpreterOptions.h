@@ -19,6 +19,7 @@
 
 class FileBrowser;
 class QComboBox;
+class QSpinBox;
 
 class IdlInterpreterOptions : public LabeledSectionGroup
 {
@@ -29,6 +30,10 @@ public:
    SETTING(Version, IdlInterpreter, std::string, std::string());
    SETTING(Modules, IdlInterpreter, std::vector<Filename*>, std::vector<Filename*>());
    SETTING(InteractiveAvailable, IdlInterpreter, bool, true);
+   SETTING(TileCacheSize, IdlInterpreter, unsigned int, 256);
+   SETTING(ResultCacheSize, IdlInterpreter, unsigned int, 128);
+   SETTING(OverviewCacheSize, IdlInterpreter, unsigned int, 128);
+   SETTING(ConcurrentRows, IdlInterpreter, unsigned int, 0);
 
    IdlInterpreterOptions();
    virtual ~IdlInterpreterOptions();
@@ -93,6 +98,10 @@ public:
 private:
    FileBrowser* mpDll;
    QComboBox* mpVersion;
+   QSpinBox* mpTileCacheSize;
+   QSpinBox* mpResultCacheSize;
+   QSpinBox* mpOverviewCacheSize;
+   QSpinBox* mpConcurrentRows;
 };
 
 #endif
\ No newline at end of file
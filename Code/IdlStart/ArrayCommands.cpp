@@ -8,21 +8,808 @@
  */
 
 #include "ArrayCommands.h"
+#include "AoiElement.h"
+#include "AsyncTransfers.h"
+#include "DataVariant.h"
 #include "DesktopServices.h"
+#include "DimensionDescriptor.h"
+#include "DynamicObject.h"
+#include "ExportRegistry.h"
 #include "IdlFunctions.h"
+#include "IdlStart.h"
+#include "LayerList.h"
+#include "LocationType.h"
+#include "ModelServices.h"
+#include "OverviewCache.h"
+#include "Progress.h"
 #include "RasterDataDescriptor.h"
 #include "RasterElement.h"
 #include "RasterLayer.h"
+#include "RasterUtilities.h"
+#include "ResultCache.h"
 #include "SpatialDataView.h"
 #include "SpatialDataWindow.h"
+#include "Statistics.h"
 #include "StringUtilities.h"
 #include "switchOnEncoding.h"
+#include "TileCache.h"
 #include "Undo.h"
 
+#include <new>
+#include <numeric>
 #include <string>
+#include <vector>
+#include <math.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <string.h>
 #include <idl_export.h>
 
+namespace
+{
+   int getIdlType(EncodingType encoding)
+   {
+      switch (encoding)
+      {
+         case INT1SBYTE:
+            return IDL_TYP_BYTE;
+         case INT1UBYTE:
+            return IDL_TYP_BYTE;
+         case INT2SBYTES:
+            return IDL_TYP_INT;
+         case INT2UBYTES:
+            return IDL_TYP_UINT;
+         case INT4SCOMPLEX:
+            return IDL_TYP_COMPLEX;
+         case INT4SBYTES:
+            return IDL_TYP_LONG;
+         case INT4UBYTES:
+            return IDL_TYP_ULONG;
+         case FLT4BYTES:
+            return IDL_TYP_FLOAT;
+         case FLT8COMPLEX:
+            return IDL_TYP_COMPLEX;
+         case FLT8BYTES:
+            return IDL_TYP_DOUBLE;
+         default:
+            return IDL_TYP_UNDEF;
+      }
+   }
+
+   bool getEncoding(int type, EncodingType& encoding)
+   {
+      switch (type)
+      {
+         case IDL_TYP_BYTE :
+            encoding = INT1SBYTE;
+            break;
+         case IDL_TYP_INT :
+            encoding = INT2SBYTES;
+            break;
+         case IDL_TYP_UINT :
+            encoding = INT2UBYTES;
+            break;
+         case IDL_TYP_LONG :
+            encoding = INT4SBYTES;
+            break;
+         case IDL_TYP_ULONG :
+            encoding = INT4UBYTES;
+            break;
+         case IDL_TYP_FLOAT :
+            encoding = FLT4BYTES;
+            break;
+         case IDL_TYP_DOUBLE :
+            encoding = FLT8BYTES;
+            break;
+         case IDL_TYP_COMPLEX:
+            encoding = FLT8COMPLEX;
+            break;
+         default:
+            return false;
+      }
+      return true;
+   }
+
+   bool getIdlDimensions(InterleaveFormatType interleave, IDL_MEMINT rows, IDL_MEMINT columns, IDL_MEMINT bands,
+      IDL_MEMINT dims[3], int& dimensions)
+   {
+      if (bands == 1)
+      {
+         dimensions = 2;
+         // set the order for IDL (column major)
+         dims[1] = rows;
+         dims[0] = columns;
+         return interleave.isValid();
+      }
+      dimensions = 3;
+      switch (interleave)
+      {
+      // set the order for IDL (column major)
+      case BSQ:
+         dims[2] = bands;
+         dims[1] = rows;
+         dims[0] = columns;
+         break;
+      case BIL:
+         dims[2] = rows;
+         dims[1] = bands;
+         dims[0] = columns;
+         break;
+      case BIP:
+         dims[2] = rows;
+         dims[1] = columns;
+         dims[0] = bands;
+         break;
+      default:
+         return false;
+      }
+      return true;
+   }
+
+   /**
+    * Determine if IDL dimensions match, ignoring trailing dimensions of one which IDL
+    * drops from arrays.
+    */
+   bool matchDimensions(const IDL_MEMINT* pDims, int dimensions, const IDL_MEMINT* pOtherDims, int otherDimensions)
+   {
+      while (dimensions > 1 && pDims[dimensions - 1] == 1)
+      {
+         --dimensions;
+      }
+      while (otherDimensions > 1 && pOtherDims[otherDimensions - 1] == 1)
+      {
+         --otherDimensions;
+      }
+      if (dimensions != otherDimensions)
+      {
+         return false;
+      }
+      for (int dimension = 0; dimension < dimensions; ++dimension)
+      {
+         if (pDims[dimension] != pOtherDims[dimension])
+         {
+            return false;
+         }
+      }
+      return true;
+   }
+
+   /**
+    * Determine if an IDL array holds the rows and columns of a tile laid out in the
+    * given interleave, as getIdlDimensions() describes it. Only the number of bands
+    * may differ from the tile.
+    *
+    * @param bands
+    *        Set to the number of bands of the array.
+    */
+   bool hasTileDimensions(const IDL_ARRAY* pArray, InterleaveFormatType interleave, IDL_MEMINT rows,
+      IDL_MEMINT columns, unsigned int& bands)
+   {
+      const IDL_MEMINT tilePixels = rows * columns;
+      if (pArray->n_elts == 0 || pArray->n_elts % tilePixels != 0)
+      {
+         return false;
+      }
+      bands = static_cast<unsigned int>(pArray->n_elts / tilePixels);
+      IDL_MEMINT dims[] = {0, 0, 0};
+      int dimensions = 0;
+      if (!getIdlDimensions(interleave, rows, columns, bands, dims, dimensions))
+      {
+         return false;
+      }
+      if (matchDimensions(pArray->dim, pArray->n_dim, dims, dimensions))
+      {
+         return true;
+      }
+
+      //a single band may also keep its band dimension when it is not the last one
+      if (bands != 1 || interleave == BSQ)
+      {
+         return false;
+      }
+      const IDL_MEMINT bandDims[] = {(interleave == BIP) ? 1 : columns, (interleave == BIP) ? columns : 1, rows};
+      return matchDimensions(pArray->dim, pArray->n_dim, bandDims, 3);
+   }
+
+   /**
+    * Store a list of indices in an IDL variable as a ULONG array.
+    */
+   bool storeIndices(IDL_VPTR pVariable, const std::vector<unsigned int>& indices)
+   {
+      IDL_ULONG* pIndices = reinterpret_cast<IDL_ULONG*>(malloc(indices.size() * sizeof(IDL_ULONG)));
+      if (pIndices == NULL)
+      {
+         return false;
+      }
+      std::copy(indices.begin(), indices.end(), pIndices);
+      IDL_MEMINT dims[] = {static_cast<IDL_MEMINT>(indices.size())};
+      IDL_VarCopy(IDL_ImportArray(1, dims, IDL_TYP_ULONG, reinterpret_cast<UCHAR*>(pIndices),
+         reinterpret_cast<IDL_ARRAY_FREE_CB>(free), NULL), pVariable);
+      return true;
+   }
+
+   /**
+    * Get the data of an IDL array which can be filled in place with \p count values of \p type.
+    *
+    * @return The data of the array or \c NULL if the variable is not a writable array of
+    *         the type and number of elements, or if it refers to the data of a raster element.
+    */
+   UCHAR* getOutArrayData(IDL_VPTR pVariable, int type, IDL_MEMINT count)
+   {
+      if (pVariable == NULL || (pVariable->flags & IDL_V_ARR) == 0 || (pVariable->flags & IDL_V_CONST) != 0 ||
+         pVariable->type != type || pVariable->value.arr->n_elts != count ||
+         ExportRegistry::instance().isExported(pVariable->value.arr->data))
+      {
+         return NULL;
+      }
+      return pVariable->value.arr->data;
+   }
+
+   /**
+    * Get a value for each band of a subcube from a keyword which is either a number or
+    * array of numbers, or the metadata path of them in the raster element. A single value
+    * is used for every band. With a value for each band of the raster element, the values
+    * of the bands of the subcube are selected, otherwise there must be a value for each
+    * band of the subcube.
+    */
+   bool getBandValues(IDL_VPTR pVariable, RasterElement* pElement, const IdlFunctions::Subcube& subcube,
+      std::vector<double>& values)
+   {
+      std::vector<double> given;
+      if (pVariable->type == IDL_TYP_STRING)
+      {
+         const DynamicObject* pMetadata = pElement->getMetadata();
+         if (pMetadata == NULL)
+         {
+            return false;
+         }
+         const DataVariant& value = pMetadata->getAttributeByPath(IDL_VarGetString(pVariable));
+         const std::vector<double>* pDoubles = dv_cast<std::vector<double> >(&value);
+         const std::vector<float>* pFloats = dv_cast<std::vector<float> >(&value);
+         const double* pDouble = dv_cast<double>(&value);
+         const float* pFloat = dv_cast<float>(&value);
+         if (pDoubles != NULL)
+         {
+            given = *pDoubles;
+         }
+         else if (pFloats != NULL)
+         {
+            given.assign(pFloats->begin(), pFloats->end());
+         }
+         else if (pDouble != NULL)
+         {
+            given.push_back(*pDouble);
+         }
+         else if (pFloat != NULL)
+         {
+            given.push_back(*pFloat);
+         }
+      }
+      else
+      {
+         IDL_VPTR pDoubleList = IDL_CvtDbl(1, &pVariable);
+         IDL_MEMINT total = 0;
+         char* pValues = NULL;
+         IDL_VarGetData(pDoubleList, &total, &pValues, 0);
+         given.assign(reinterpret_cast<double*>(pValues), reinterpret_cast<double*>(pValues) + total);
+         if (pDoubleList != pVariable)
+         {
+            IDL_Deltmp(pDoubleList);
+         }
+      }
+
+      const unsigned int bands = subcube.getBandCount();
+      const RasterDataDescriptor* pDesc = static_cast<const RasterDataDescriptor*>(pElement->getDataDescriptor());
+      values.clear();
+      if (given.size() == 1)
+      {
+         values.assign(bands, given.front());
+      }
+      else if (given.size() == pDesc->getBandCount())
+      {
+         for (unsigned int band = 0; band < bands; ++band)
+         {
+            values.push_back(given[subcube.getBand(band)]);
+         }
+      }
+      else if (given.size() == bands)
+      {
+         values = given;
+      }
+      return !values.empty();
+   }
+
+   /**
+    * The count, range, mean and sum of squared deviations of the values of a band.
+    */
+   struct BandMoments
+   {
+      BandMoments() :
+         mCount(0),
+         mMin(0.0),
+         mMax(0.0),
+         mMean(0.0),
+         mM2(0.0)
+      {}
+
+      void merge(const BandMoments& other)
+      {
+         if (other.mCount == 0)
+         {
+            return;
+         }
+         if (mCount == 0)
+         {
+            *this = other;
+            return;
+         }
+         const double count = static_cast<double>(mCount + other.mCount);
+         const double delta = other.mMean - mMean;
+         mMean += delta * other.mCount / count;
+         mM2 += other.mM2 + delta * delta * mCount * other.mCount / count;
+         mCount += other.mCount;
+         mMin = std::min(mMin, other.mMin);
+         mMax = std::max(mMax, other.mMax);
+      }
+
+      uint64_t mCount;
+      double mMin;
+      double mMax;
+      double mMean;
+      double mM2;
+   };
+
+   /**
+    * Get the value used for the statistics of a data value. Complex values use their
+    * magnitude, as Opticks does by default.
+    */
+   template<typename T>
+   inline double getStatisticsValue(const T& value)
+   {
+      return static_cast<double>(value);
+   }
+
+   inline double getStatisticsValue(const IntegerComplex& value)
+   {
+      return sqrt(static_cast<double>(value.mReal) * value.mReal + static_cast<double>(value.mImaginary) *
+         value.mImaginary);
+   }
+
+   inline double getStatisticsValue(const FloatComplex& value)
+   {
+      return sqrt(static_cast<double>(value.mReal) * value.mReal + static_cast<double>(value.mImaginary) *
+         value.mImaginary);
+   }
+
+   /**
+    * Reduces the bands of a subcube to moments or histograms in a single pass.
+    *
+    * Each chunk is a block of rows, and a single band of BSQ data, read through
+    * copyNativeSubcube() into a scratch buffer and reduced in memory order. The
+    * moments of each chunk are kept separately and merged once every chunk is done.
+    * Histogram counts are added to the totals as each chunk finishes. Bad values
+    * and NaN are not counted.
+    */
+   template<typename T>
+   class BandStatisticsTask : public IdlFunctions::ChunkTask
+   {
+   public:
+      BandStatisticsTask(RasterElement* pElement, const IdlFunctions::Subcube& subcube,
+         const std::vector<double>& badValues, unsigned int threadCount) :
+         mpElement(pElement),
+         mSubcube(subcube),
+         mBadValues(badValues),
+         mRows(subcube.getRowCount()),
+         mColumns(subcube.getColumnCount()),
+         mBands(subcube.getBandCount()),
+         mBandGroups(1),
+         mBinCount(0)
+      {
+         const RasterDataDescriptor* pDesc = static_cast<const RasterDataDescriptor*>(pElement->getDataDescriptor());
+         mNative = pDesc->getInterleaveFormat();
+         if (mNative == BSQ)
+         {
+            mBandGroups = mBands;
+         }
+         mRowsPerChunk = IdlFunctions::getRowsPerChunk(mRows, mColumns * (mBands / mBandGroups) * sizeof(T),
+            mBandGroups, threadCount);
+         mRowBlocks = (mRows + mRowsPerChunk - 1) / mRowsPerChunk;
+         mMoments.resize(mRowBlocks * mBands);
+         pthread_mutex_init(&mMutex, NULL);
+      }
+
+      ~BandStatisticsTask()
+      {
+         pthread_mutex_destroy(&mMutex);
+      }
+
+      /**
+       * Count the values of each band in \p binCount equal bins between the given
+       * limits instead of computing the moments.
+       */
+      void setHistogram(const std::vector<double>& minimums, const std::vector<double>& maximums,
+         unsigned int binCount)
+      {
+         mMinimums = minimums;
+         mMaximums = maximums;
+         mBinCount = binCount;
+         mHistograms.assign(mBands * binCount, 0);
+      }
+
+      size_t getChunkCount() const
+      {
+         return mBandGroups * mRowBlocks;
+      }
+
+      bool processChunk(size_t chunk)
+      {
+         const size_t bandGroup = chunk / mRowBlocks;
+         const size_t rowBlock = chunk % mRowBlocks;
+         const size_t row = rowBlock * mRowsPerChunk;
+         const size_t count = std::min(mRowsPerChunk, mRows - row);
+         const size_t bands = mBands / mBandGroups;
+         const size_t firstBand = (mBandGroups > 1) ? bandGroup : 0;
+         IdlFunctions::Subcube block = mSubcube;
+         block.mHeightStart = mSubcube.mHeightStart + static_cast<unsigned int>(row);
+         block.mHeightEnd = block.mHeightStart + static_cast<unsigned int>(count - 1);
+         if (mBandGroups > 1)
+         {
+            block.mBandStart = mSubcube.getBand(static_cast<unsigned int>(bandGroup));
+            block.mBandEnd = block.mBandStart;
+            block.mBandList.clear();
+         }
+
+         std::vector<T> scratch(count * mColumns * bands);
+         if (!IdlFunctions::copyNativeSubcube(&scratch[0], mpElement, block))
+         {
+            return false;
+         }
+         size_t strides[3];
+         IdlFunctions::getInterleaveStrides(mNative, count, mColumns, bands, strides);
+
+         std::vector<Sums> sums(bands);
+         std::vector<uint64_t> histograms(bands * mBinCount, 0);
+         for (size_t band = 0; band < bands; ++band)
+         {
+            if (mBinCount > 0)
+            {
+               const double minimum = mMinimums[firstBand + band];
+               const double range = mMaximums[firstBand + band] - minimum;
+               sums[band].mMin = minimum;
+               sums[band].mScale = (range > 0.0) ? mBinCount / range : 0.0;
+               sums[band].mpHistogram = &histograms[band * mBinCount];
+            }
+         }
+
+         //visit the values in memory order
+         for (size_t r = 0; r < count; ++r)
+         {
+            if (strides[1] == 1)
+            {
+               for (size_t band = 0; band < bands; ++band)
+               {
+                  const T* pValue = &scratch[r * strides[0] + band * strides[2]];
+                  for (size_t c = 0; c < mColumns; ++c)
+                  {
+                     add(sums[band], pValue[c]);
+                  }
+               }
+            }
+            else
+            {
+               for (size_t c = 0; c < mColumns; ++c)
+               {
+                  const T* pValue = &scratch[r * strides[0] + c * strides[1]];
+                  for (size_t band = 0; band < bands; ++band)
+                  {
+                     add(sums[band], pValue[band]);
+                  }
+               }
+            }
+         }
+
+         if (mBinCount > 0)
+         {
+            pthread_mutex_lock(&mMutex);
+            for (size_t bin = 0; bin < histograms.size(); ++bin)
+            {
+               mHistograms[firstBand * mBinCount + bin] += histograms[bin];
+            }
+            pthread_mutex_unlock(&mMutex);
+            return true;
+         }
+         for (size_t band = 0; band < bands; ++band)
+         {
+            BandMoments& moments = mMoments[rowBlock * mBands + firstBand + band];
+            const Sums& bandSums = sums[band];
+            moments.mCount = bandSums.mCount;
+            if (bandSums.mCount > 0)
+            {
+               moments.mMin = bandSums.mMin;
+               moments.mMax = bandSums.mMax;
+               moments.mMean = bandSums.mShift + bandSums.mSum / bandSums.mCount;
+               moments.mM2 = std::max(0.0, bandSums.mSumSquares - bandSums.mSum * bandSums.mSum / bandSums.mCount);
+            }
+         }
+         return true;
+      }
+
+      /**
+       * Get the moments of the n'th band of the subcube once every chunk is done.
+       */
+      BandMoments getMoments(size_t band) const
+      {
+         BandMoments moments;
+         for (size_t rowBlock = 0; rowBlock < mRowBlocks; ++rowBlock)
+         {
+            moments.merge(mMoments[rowBlock * mBands + band]);
+         }
+         return moments;
+      }
+
+      /**
+       * Get the histogram counts of the n'th band of the subcube once every chunk is done.
+       */
+      const uint64_t* getHistogram(size_t band) const
+      {
+         return &mHistograms[band * mBinCount];
+      }
+
+   private:
+      BandStatisticsTask(const BandStatisticsTask& rhs);
+      BandStatisticsTask& operator=(const BandStatisticsTask& rhs);
+
+      /**
+       * The running sums of a band within a chunk. The sums are taken relative to the
+       * first value so they keep their precision.
+       */
+      struct Sums
+      {
+         Sums() :
+            mCount(0),
+            mShift(0.0),
+            mSum(0.0),
+            mSumSquares(0.0),
+            mMin(0.0),
+            mMax(0.0),
+            mScale(0.0),
+            mpHistogram(NULL)
+         {}
+
+         uint64_t mCount;
+         double mShift;
+         double mSum;
+         double mSumSquares;
+         double mMin;
+         double mMax;
+         double mScale;
+         uint64_t* mpHistogram;
+      };
+
+      void add(Sums& sums, const T& data)
+      {
+         const double value = getStatisticsValue(data);
+         bool bad = (value != value);
+         for (std::vector<double>::const_iterator badValue = mBadValues.begin(); badValue != mBadValues.end();
+            ++badValue)
+         {
+            bad |= (value == *badValue);
+         }
+         if (bad)
+         {
+            return;
+         }
+         if (mBinCount > 0)
+         {
+            const double bin = (value - sums.mMin) * sums.mScale;
+            ++sums.mpHistogram[(bin <= 0.0) ? 0 : std::min(static_cast<size_t>(bin), mBinCount - 1)];
+            return;
+         }
+         if (sums.mCount == 0)
+         {
+            sums.mShift = value;
+            sums.mMin = value;
+            sums.mMax = value;
+         }
+         const double delta = value - sums.mShift;
+         sums.mSum += delta;
+         sums.mSumSquares += delta * delta;
+         sums.mMin = std::min(sums.mMin, value);
+         sums.mMax = std::max(sums.mMax, value);
+         ++sums.mCount;
+      }
+
+      RasterElement* mpElement;
+      IdlFunctions::Subcube mSubcube;
+      const std::vector<double>& mBadValues;
+      InterleaveFormatType mNative;
+      size_t mRows;
+      size_t mColumns;
+      size_t mBands;
+      size_t mBandGroups;
+      size_t mRowsPerChunk;
+      size_t mRowBlocks;
+      std::vector<BandMoments> mMoments;
+      std::vector<double> mMinimums;
+      std::vector<double> mMaximums;
+      size_t mBinCount;
+      std::vector<uint64_t> mHistograms;
+      pthread_mutex_t mMutex;
+   };
+
+   /**
+    * Copies the same subcube of several raster elements into consecutive slices of one
+    * BSQ array, converting each to an IDL type. Each chunk is a raster element, and each
+    * element is read on \p sliceThreadCount threads.
+    */
+   class StackTask : public IdlFunctions::ChunkTask
+   {
+   public:
+      StackTask(const std::vector<RasterElement*>& elements, const IdlFunctions::Subcube& subcube, int type,
+         UCHAR* pData, unsigned int sliceThreadCount) :
+         mElements(elements),
+         mSubcube(subcube),
+         mType(type),
+         mpData(pData),
+         mSliceThreadCount(sliceThreadCount)
+      {
+         mSliceBytes = static_cast<size_t>(subcube.getRowCount()) * subcube.getColumnCount() *
+            subcube.getBandCount() * IdlFunctions::getIdlTypeSize(type);
+      }
+
+      bool processChunk(size_t chunk)
+      {
+         RasterElement* pElement = mElements[chunk];
+         const RasterDataDescriptor* pDesc = static_cast<const RasterDataDescriptor*>(pElement->getDataDescriptor());
+         const size_t rowBytes = static_cast<size_t>(mSubcube.getColumnCount()) * mSubcube.getBandCount() *
+            pDesc->getBytesPerElement();
+         const size_t rowsPerBlock = std::max<size_t>(1, std::min<size_t>(mSubcube.getRowCount(),
+            IdlFunctions::MaxChunkBytes * mSliceThreadCount / std::max<size_t>(1, rowBytes)));
+         std::vector<char> scratch(rowsPerBlock * rowBytes);
+         void* const* ppBands = NULL;
+         IdlFunctions::BadValueFill* pBadValues = NULL;
+         bool success = false;
+         switchOnComplexEncoding(pDesc->getDataType(), IdlFunctions::convertSubcube, &scratch[0],
+            static_cast<void*>(mpData + chunk * mSliceBytes), ppBands, mType, pElement, mSubcube,
+            InterleaveFormatType(BSQ), rowsPerBlock, mSliceThreadCount, pBadValues, success);
+         return success;
+      }
+
+   private:
+      StackTask(const StackTask& rhs);
+      StackTask& operator=(const StackTask& rhs);
+
+      const std::vector<RasterElement*>& mElements;
+      IdlFunctions::Subcube mSubcube;
+      int mType;
+      UCHAR* mpData;
+      unsigned int mSliceThreadCount;
+      size_t mSliceBytes;
+   };
+
+   template<typename T>
+   void computeBandMoments(T* pUnused, RasterElement* pElement, const IdlFunctions::Subcube& subcube,
+      const std::vector<double>& badValues, std::vector<BandMoments>& moments, bool& success)
+   {
+      const unsigned int threadCount = IdlFunctions::getThreadCount();
+      BandStatisticsTask<T> task(pElement, subcube, badValues, threadCount);
+      success = IdlFunctions::runChunks(task, task.getChunkCount(), threadCount);
+      moments.resize(subcube.getBandCount());
+      for (size_t band = 0; band < moments.size(); ++band)
+      {
+         moments[band] = task.getMoments(band);
+      }
+   }
+
+   template<typename T>
+   void computeBandHistograms(T* pUnused, RasterElement* pElement, const IdlFunctions::Subcube& subcube,
+      const std::vector<double>& badValues, const std::vector<double>& minimums, const std::vector<double>& maximums,
+      unsigned int binCount, std::vector<uint64_t>& histograms, bool& success)
+   {
+      const unsigned int threadCount = IdlFunctions::getThreadCount();
+      BandStatisticsTask<T> task(pElement, subcube, badValues, threadCount);
+      task.setHistogram(minimums, maximums, binCount);
+      success = IdlFunctions::runChunks(task, task.getChunkCount(), threadCount);
+      histograms.resize(static_cast<size_t>(subcube.getBandCount()) * binCount);
+      for (size_t band = 0; band < subcube.getBandCount(); ++band)
+      {
+         std::copy(task.getHistogram(band), task.getHistogram(band) + binCount, histograms.begin() + band * binCount);
+      }
+   }
+
+   /**
+    * Get the statistics Opticks has already calculated for a band when they match what
+    * opticks_band_stats would compute: every pixel, the element's bad values and the
+    * magnitude of complex values. Opticks keeps the population standard deviation, so
+    * it is scaled to the sample standard deviation by the pixel count of the histogram.
+    *
+    * @return \c true if the statistics could be used, \c false if they must be computed.
+    */
+   bool getCalculatedStatistics(Statistics* pStatistics, const RasterDataDescriptor* pDesc, double& minimum,
+      double& maximum, double& mean, double& deviation)
+   {
+      if (pStatistics == NULL || !pStatistics->isCalculated() || pStatistics->getStatisticsResolution() != 1 ||
+         pStatistics->getBadValues() != pDesc->getBadValues())
+      {
+         return false;
+      }
+      const EncodingType dataType = pDesc->getDataType();
+      if ((dataType == INT4SCOMPLEX || dataType == FLT8COMPLEX) &&
+         pStatistics->getComplexComponent() != COMPLEX_MAGNITUDE)
+      {
+         return false;
+      }
+
+      const double* pBinCenters = NULL;
+      const unsigned int* pCounts = NULL;
+      pStatistics->getHistogram(pBinCenters, pCounts);
+      if (pCounts == NULL)
+      {
+         return false;
+      }
+      //Opticks always calculates a histogram of 256 bins
+      const uint64_t count = std::accumulate(pCounts, pCounts + 256, static_cast<uint64_t>(0));
+      if (count == 0)
+      {
+         return false;
+      }
+      minimum = pStatistics->getMin();
+      maximum = pStatistics->getMax();
+      mean = pStatistics->getAverage();
+      deviation = (count > 1) ? pStatistics->getStandardDeviation() * sqrt(static_cast<double>(count) / (count - 1)) :
+         0.0;
+      return true;
+   }
+
+   /**
+    * Start writing an array into an existing raster element on a background thread.
+    * The array is in the element's interleave. When it had to be converted,
+    * \p pConvertedData holds it and is handed to the transfer, otherwise the IDL
+    * array is copied so it can be changed as soon as this returns.
+    */
+   IDL_VPTR startAsyncWrite(RasterElement* pElement, char* pRawData, char* pConvertedData, size_t bytes,
+      unsigned int startRow, unsigned int rows, unsigned int startCol, unsigned int cols, unsigned int startBand,
+      unsigned int bands, unsigned int concurrentRows)
+   {
+      const RasterDataDescriptor* pDesc = static_cast<const RasterDataDescriptor*>(pElement->getDataDescriptor());
+      if (static_cast<uint64_t>(startRow) + rows > pDesc->getRowCount() ||
+         static_cast<uint64_t>(startCol) + cols > pDesc->getColumnCount() ||
+         static_cast<uint64_t>(startBand) + bands > pDesc->getBandCount())
+      {
+         free(pConvertedData);
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "The array does not fit in the raster element.");
+         return IDL_StrToSTRING("failure");
+      }
+      char* pData = pConvertedData;
+      if (pData == NULL)
+      {
+         pData = reinterpret_cast<char*>(malloc(bytes));
+         if (pData == NULL)
+         {
+            IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Not enough memory to allocate array");
+            return IDL_StrToSTRING("failure");
+         }
+         memcpy(pData, pRawData, bytes);
+      }
+
+      IdlFunctions::Subcube subcube;
+      subcube.mHeightStart = startRow;
+      subcube.mHeightEnd = startRow + rows - 1;
+      subcube.mWidthStart = startCol;
+      subcube.mWidthEnd = startCol + cols - 1;
+      subcube.mBandStart = startBand;
+      subcube.mBandEnd = startBand + bands - 1;
+      subcube.mConcurrentRows = concurrentRows;
+      const IDL_LONG handle = AsyncTransfers::instance().startWrite(pData, pElement, subcube);
+      if (handle == 0)
+      {
+         free(pData);
+         return IDL_StrToSTRING("failure");
+      }
+      return IDL_GettmpLong(handle);
+   }
+}
+
 /**
  * \defgroup arraycommands Array Commands
  */
@@ -31,18 +818,34 @@
 /**
  * Make raster data available to IDL.
  *
- * @note You must zero out the return value of this function before destroying
- *       the corresponding raster element in Opticks or the application may crash.
+ * @note When the returned array refers to the data of the raster element, the array is
+ *       given its own copy of the data if the raster element is destroyed, so it stays
+ *       valid. If there is not enough memory for the copy, the array is replaced by a
+ *       single zero value and an error is posted. Use opticks_exported_bytes() to see how
+ *       much of an element's data is referred to by IDL arrays.
+ *
+ * @note Data from on-disk raster elements is read in blocks of rows which are kept
+ *       for later calls, up to the size set in the IDL interpreter options. Reading
+ *       the blocks of an element in order reads the next block in the background.
+ *       Set the size to 0 to read only the requested data on every call. Requests
+ *       with \p ROW_SKIP or \p COLUMN_SKIP, or much smaller than a block, are always
+ *       read directly.
+ *
+ * @note Copies of the returned arrays are kept, up to the result cache size set in the
+ *       IDL interpreter options, so requesting the same subcube again is copied from
+ *       memory until the data of the raster element is modified. Results with replaced
+ *       bad values or a \p MASK are not kept, and nothing is kept for a raster element
+ *       while an IDL array refers directly to its data.
  *
  * @param[in] DATASET @opt
  *            The name of the raster element to get. Defaults to
  *            the primary raster element of the active window.
  * @param[out] BANDS_OUT @opt
- *             Returns the number of active bands.
+ *             Returns the number of bands in the returned array.
  * @param[out] HEIGHT_OUT @opt
- *             Returns the number of active rows.
+ *             Returns the number of rows in the returned array.
  * @param[out] WIDTH_OUT @opt
- *             Returns the number of active columns.
+ *             Returns the number of columns in the returned array.
  * @param[in] BANDS_START @opt
  *            The starting band in active band numbers. Defaults to 0.
  * @param[in] BANDS_END @opt
@@ -55,8 +858,143 @@
  *            The starting column in active column numbers. Defaults to 0.
  * @param[in] WIDTH_END @opt
  *            The end column in active column numbers. Defaults to the last column.
- * @return An array containing the requested data.
+ * @param[in] ROW_SKIP @opt
+ *            Return every n'th row starting at \p HEIGHT_START. Rows which are skipped are
+ *            not read from the raster element. Defaults to 1.
+ * @param[in] COLUMN_SKIP @opt
+ *            Return every n'th column starting at \p WIDTH_START. Defaults to 1.
+ * @param[in] BAND_SKIP @opt
+ *            Return every n'th band starting at \p BANDS_START. Bands which are skipped are
+ *            not read from BSQ or BIL raster elements. Defaults to 1.
+ * @param[in] BAND_LIST @opt
+ *            An array of the active band numbers to return, in the order they are returned.
+ *            This can not be used with \p BANDS_START, \p BANDS_END or \p BAND_SKIP. The
+ *            bands are read in a single pass, so scattered bands can be gathered from BIP
+ *            and BIL data without reading every band separately.
+ * @param[in] CONCURRENT_ROWS @opt
+ *            The number of rows of the raster element which are paged in at once while
+ *            the data is read. Defaults to the value in the IDL interpreter options, or when
+ *            that is 0, to enough rows to make blocks of about four megabytes. Larger values
+ *            read tall narrow subcubes of on-disk data in fewer and larger blocks.
+ * @param[in] COPY @opt
+ *            If this flag is set the returned array is always a copy of the data. By default,
+ *            when the requested subcube is a single contiguous block of an in-memory raster
+ *            element, the returned array refers to the element's data instead of a copy.
+ *            Examples are the whole element, a band range of BSQ data or a row range of BIP
+ *            or BIL data. Changes to such an array change the raster element. A block which
+ *            is already referred to by another IDL array is always copied.
+ * @param[in] NO_COPY @opt
+ *            If this flag is set for a read only on-disk raster element imported as a raw
+ *            file of samples in the system byte order, the part of the
+ *            file holding the subcube is mapped into memory instead, so data is only read
+ *            from the file as IDL uses it. Changes to a mapped array are not saved to the
+ *            file and the array stays valid after the raster element is destroyed.
+ * @param[in] USE_BAD_VALUES @opt
+ *            If this flag is set, the bad values of the raster element are replaced with
+ *            \p FILL_VALUE as the data is copied.
+ * @param[in] BAD_VALUES @opt
+ *            An array of values to replace with \p FILL_VALUE as the data is copied, in
+ *            addition to those from \p USE_BAD_VALUES. Values are compared before they are
+ *            converted to \p TYPE, and complex values are compared by their real part. The
+ *            returned array is always a copy when values are replaced.
+ * @param[in] FILL_VALUE @opt
+ *            The value written in place of bad values. Defaults to NaN, so it must be given
+ *            when the returned array has an integer type.
+ * @param[out] BAD_COUNT_OUT @opt
+ *             Returns the number of values which were replaced, as an unsigned 64-bit integer.
+ * @param[in] OUT_ARRAY @opt
+ *            An existing IDL array to fill with the data instead of returning a new array. It
+ *            must have the type of the returned array and the same number of elements, and
+ *            it keeps its own dimensions. Nothing is allocated, so a loop which fetches the
+ *            same size of subcube on every iteration can reuse one array. An array which
+ *            refers to the data of a raster element can not be used.
+ * @param[in] SPLIT_BANDS @opt
+ *            If this flag is set, a pointer array with a pointer to a two dimensional array of
+ *            columns by rows for each band is returned instead of a single array. Each band is
+ *            allocated separately, so large subcubes can be returned when there is no single
+ *            block of free memory large enough to hold them, and each band can be freed with
+ *            PTR_FREE once it has been used. The subcube is still read once. This can not be
+ *            used with \p MASK, \p OUT_ARRAY or \p INTERLEAVE.
+ * @param[in] MASK @opt
+ *            The name of an AOI, or of a raster element whose first band is non-zero for
+ *            the selected pixels. Only the selected pixels of the subcube are returned, as
+ *            a two dimensional array of bands by pixels. The raster element is read once and
+ *            rows without selected pixels are not read. Defaults to returning every pixel.
+ *            This can not be used with \p ROW_SKIP, \p COLUMN_SKIP, \p INTERLEAVE or
+ *            \p TYPE.
+ * @param[out] ROWS_OUT @opt
+ *             Returns the row of each pixel returned for \p MASK.
+ * @param[out] COLUMNS_OUT @opt
+ *             Returns the column of each pixel returned for \p MASK.
+ * @param[in] INTERLEAVE @opt
+ *            The interleave of the returned array. Defaults to the interleave of the raster
+ *            element. Valid values are: BIP, BIL, and BSQ. Converting here is much faster
+ *            than calling TRANSPOSE on the returned array and does not need a second copy
+ *            of the array in IDL. The returned array is always a copy when the interleave
+ *            is converted.
+ * @param[in] TYPE @opt
+ *            The IDL type code of the returned array, as returned by SIZE(/TYPE). Defaults
+ *            to the type of the raster element. Valid values are the numeric type codes 1 to 6,
+ *            9 and 12 to 15. The values are converted as they are copied, as FIX, FLOAT,
+ *            COMPLEX and the other IDL conversion functions would, so the array does not need
+ *            to be converted again in IDL. Floating point values are truncated toward zero
+ *            when converted to an integer type. Where IDL's result depends on the platform,
+ *            NaN becomes 0 and values outside the range of the integer type become its
+ *            minimum or maximum. Complex integer raster elements are always returned
+ *            as COMPLEX unless another type is given. The returned array is always a copy when
+ *            the type is converted.
+ * @param[in] GAIN @opt
+ *            The gain of each band, or the metadata path of the gains in the raster element.
+ *            The returned array holds GAIN * value + OFFSET for each value, computed as the
+ *            data is copied, so digital numbers can be returned as radiance in one pass. A
+ *            single gain is used for every band. Otherwise there must be a gain for each band
+ *            of the raster element, or for each returned band. Defaults to 1. The returned
+ *            array is FLOAT unless \p TYPE is 5, and bad values are replaced before they are
+ *            scaled. This can not be used with complex data, \p MASK, \p SPLIT_BANDS or
+ *            \p DETECT.
+ * @param[in] OFFSET @opt
+ *            The offset of each band, or the metadata path of the offsets in the raster
+ *            element, given as for \p GAIN. Defaults to 0.
+ * @param[in] DETECT @opt
+ *            Return a float array of the magnitude, power, decibels or phase of complex
+ *            data instead of the complex values. Valid values are: MAGNITUDE, POWER, DB
+ *            and PHASE. These match ABS, ABS(z)^2, 10 * ALOG10(ABS(z)^2) and
+ *            ATAN(z, /PHASE) in IDL, but are computed as the data is copied so the complex
+ *            array is never held in IDL. This can not be used with \p TYPE, \p MASK,
+ *            \p SPLIT_BANDS or bad value replacement.
+ * @param[in] ASYNC @opt
+ *            If this flag is set, a transfer handle is returned at once and the data is copied
+ *            on a background thread while IDL keeps running. Pass the handle to opticks_wait()
+ *            to get the array, or to opticks_poll() to see if the copy has finished. The
+ *            returned array is always a copy in the element's data type. The raster element
+ *            must not be changed until the transfer has been waited for. This can not be used
+ *            with \p TYPE, \p DETECT, \p GAIN, \p OFFSET, \p MASK, \p SPLIT_BANDS,
+ *            \p OUT_ARRAY, \p NO_COPY or bad value replacement.
+ * @return An array containing the requested data, or a pointer array when \p SPLIT_BANDS
+ *         is set. If \p OUT_ARRAY is given, the IDL string
+ *         of "success" is returned instead. If \p ASYNC is set, a transfer handle is
+ *         returned instead. If the data can't be returned, the IDL string of
+ *         "failure" is returned.
  * @usage data = array_to_idl(BANDS_START=1, BANDS_END=2)
+ * pixels = array_to_idl(INTERLEAVE="BIP")
+ * radiance = array_to_idl(TYPE=4)
+ * band = array_to_idl(BANDS_START=5, BANDS_END=5)
+ * scratch = array_to_idl(/COPY)
+ * cube = array_to_idl(DATASET="big.raw", /NO_COPY)
+ * quicklook = array_to_idl(ROW_SKIP=10, COLUMN_SKIP=10)
+ * features = array_to_idl(BAND_LIST=[12, 13, 40, 41, 42, 97])
+ * targets = array_to_idl(MASK="targets", ROWS_OUT=rows, COLUMNS_OUT=columns)
+ * radiance = array_to_idl(TYPE=4, /USE_BAD_VALUES, BAD_VALUES=[-9999], BAD_COUNT_OUT=masked)
+ * frame = fltarr(640, 480)
+ * for i = 0, 99 do result = array_to_idl(BANDS_START=i, BANDS_END=i, TYPE=4, OUT_ARRAY=frame)
+ * sigma0 = array_to_idl(DATASET="slc.nitf", DETECT="DB")
+ * radiance = array_to_idl(GAIN="Calibration/Gains", OFFSET="Calibration/Offsets")
+ * radiance = array_to_idl(BANDS_START=2, BANDS_END=3, GAIN=[0.012, 0.0095], OFFSET=-1.5)
+ * bands = array_to_idl(DATASET="big.raw", /SPLIT_BANDS)
+ * for i = 0, n_elements(bands) - 1 do begin & process_band, *bands[i] & ptr_free, bands[i] & endfor
+ * transfer = array_to_idl(DATASET="big.raw", BANDS_START=1, BANDS_END=1, /ASYNC)
+ * process_band, previous
+ * previous = opticks_wait(transfer)
  * @endusage
  */
 IDL_VPTR array_to_idl(int argc, IDL_VPTR pArgv[], char* pArgk)
@@ -92,6 +1030,50 @@ IDL_VPTR array_to_idl(int argc, IDL_VPTR pArgv[], char* pArgk)
       IDL_VPTR width;
       int bandsExists;
       IDL_VPTR bands;
+      int noCopyExists;
+      IDL_LONG noCopy;
+      int copyExists;
+      IDL_LONG copy;
+      int interleaveExists;
+      IDL_STRING idlInterleave;
+      int rowSkipExists;
+      IDL_LONG rowSkip;
+      int columnSkipExists;
+      IDL_LONG columnSkip;
+      int bandSkipExists;
+      IDL_LONG bandSkip;
+      int typeExists;
+      IDL_LONG idlType;
+      int bandListExists;
+      IDL_VPTR bandList;
+      int maskExists;
+      IDL_STRING maskName;
+      int rowsOutExists;
+      IDL_VPTR rowsOut;
+      int columnsOutExists;
+      IDL_VPTR columnsOut;
+      int useBadValuesExists;
+      IDL_LONG useBadValues;
+      int badValuesExists;
+      IDL_VPTR badValues;
+      int fillValueExists;
+      double fillValue;
+      int badCountOutExists;
+      IDL_VPTR badCountOut;
+      int outArrayExists;
+      IDL_VPTR outArray;
+      int concurrentRowsExists;
+      IDL_LONG concurrentRows;
+      int splitBandsExists;
+      IDL_LONG splitBands;
+      int detectExists;
+      IDL_STRING detect;
+      int gainExists;
+      IDL_VPTR gain;
+      int offsetExists;
+      IDL_VPTR offset;
+      int asyncExists;
+      IDL_LONG async;
    } KW_RESULT;
 
    //IDL_KW_FAST_SCAN is the type of scan we are using, following it is the
@@ -99,20 +1081,64 @@ IDL_VPTR array_to_idl(int argc, IDL_VPTR pArgv[], char* pArgk)
    //flags, a boolean whether the value was populated and finally the value itself
    static IDL_KW_PAR kw_pars[] = {
       IDL_KW_FAST_SCAN,
+      {"ASYNC", IDL_TYP_LONG, 1, IDL_KW_ZERO, reinterpret_cast<int*>(IDL_KW_OFFSETOF(asyncExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(async))},
+      {"BAD_COUNT_OUT", IDL_TYP_UNDEF, 1, IDL_KW_OUT, reinterpret_cast<int*>(IDL_KW_OFFSETOF(badCountOutExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(badCountOut))},
+      {"BAD_VALUES", IDL_TYP_UNDEF, 1, IDL_KW_VIN, reinterpret_cast<int*>(IDL_KW_OFFSETOF(badValuesExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(badValues))},
       {"BANDS_END", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(bandendExists)),
          reinterpret_cast<char*>(IDL_KW_OFFSETOF(bandend))},
       {"BANDS_OUT", IDL_TYP_LONG, 1, IDL_KW_OUT, reinterpret_cast<int*>(IDL_KW_OFFSETOF(bandsExists)),
          reinterpret_cast<char*>(IDL_KW_OFFSETOF(bands))},
       {"BANDS_START", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(bandstartExists)),
          reinterpret_cast<char*>(IDL_KW_OFFSETOF(bandstart))},
+      {"BAND_LIST", IDL_TYP_UNDEF, 1, IDL_KW_VIN, reinterpret_cast<int*>(IDL_KW_OFFSETOF(bandListExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(bandList))},
+      {"BAND_SKIP", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(bandSkipExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(bandSkip))},
+      {"COLUMNS_OUT", IDL_TYP_UNDEF, 1, IDL_KW_OUT, reinterpret_cast<int*>(IDL_KW_OFFSETOF(columnsOutExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(columnsOut))},
+      {"COLUMN_SKIP", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(columnSkipExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(columnSkip))},
+      {"CONCURRENT_ROWS", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(concurrentRowsExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(concurrentRows))},
+      {"COPY", IDL_TYP_LONG, 1, IDL_KW_ZERO, reinterpret_cast<int*>(IDL_KW_OFFSETOF(copyExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(copy))},
       {"DATASET", IDL_TYP_STRING, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(datasetExists)),
          reinterpret_cast<char*>(IDL_KW_OFFSETOF(datasetName))},
+      {"DETECT", IDL_TYP_STRING, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(detectExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(detect))},
+      {"FILL_VALUE", IDL_TYP_DOUBLE, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(fillValueExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(fillValue))},
+      {"GAIN", IDL_TYP_UNDEF, 1, IDL_KW_VIN, reinterpret_cast<int*>(IDL_KW_OFFSETOF(gainExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(gain))},
       {"HEIGHT_END", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(endyheightExists)),
          reinterpret_cast<char*>(IDL_KW_OFFSETOF(endyheight))},
       {"HEIGHT_OUT", IDL_TYP_LONG, 1, IDL_KW_OUT, reinterpret_cast<int*>(IDL_KW_OFFSETOF(heightExists)),
          reinterpret_cast<char*>(IDL_KW_OFFSETOF(height))},
       {"HEIGHT_START", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(startyheightExists)),
          reinterpret_cast<char*>(IDL_KW_OFFSETOF(startyheight))},
+      {"INTERLEAVE", IDL_TYP_STRING, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(interleaveExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(idlInterleave))},
+      {"MASK", IDL_TYP_STRING, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(maskExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(maskName))},
+      {"NO_COPY", IDL_TYP_LONG, 1, IDL_KW_ZERO, reinterpret_cast<int*>(IDL_KW_OFFSETOF(noCopyExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(noCopy))},
+      {"OFFSET", IDL_TYP_UNDEF, 1, IDL_KW_VIN, reinterpret_cast<int*>(IDL_KW_OFFSETOF(offsetExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(offset))},
+      {"OUT_ARRAY", IDL_TYP_UNDEF, 1, IDL_KW_VIN, reinterpret_cast<int*>(IDL_KW_OFFSETOF(outArrayExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(outArray))},
+      {"ROWS_OUT", IDL_TYP_UNDEF, 1, IDL_KW_OUT, reinterpret_cast<int*>(IDL_KW_OFFSETOF(rowsOutExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(rowsOut))},
+      {"ROW_SKIP", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(rowSkipExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(rowSkip))},
+      {"SPLIT_BANDS", IDL_TYP_LONG, 1, IDL_KW_ZERO, reinterpret_cast<int*>(IDL_KW_OFFSETOF(splitBandsExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(splitBands))},
+      {"TYPE", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(typeExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(idlType))},
+      {"USE_BAD_VALUES", IDL_TYP_LONG, 1, IDL_KW_ZERO, reinterpret_cast<int*>(IDL_KW_OFFSETOF(useBadValuesExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(useBadValues))},
       {"WIDTH_END", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(endxwidthExists)),
          reinterpret_cast<char*>(IDL_KW_OFFSETOF(endxwidth))},
       {"WIDTH_OUT", IDL_TYP_LONG, 1, IDL_KW_OUT, reinterpret_cast<int*>(IDL_KW_OFFSETOF(widthExists)),
@@ -136,298 +1162,781 @@ IDL_VPTR array_to_idl(int argc, IDL_VPTR pArgv[], char* pArgk)
       IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Error could not find array.");
       return IDL_StrToSTRING("");
    }
+   const RasterDataDescriptor* pDesc = dynamic_cast<const RasterDataDescriptor*>(pData->getDataDescriptor());
+   if (pDesc == NULL)
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Error could not find array.");
+      return IDL_StrToSTRING("failure");
+   }
+
    unsigned char* pRawData = NULL;
 
-   int row = 0;
-   int column = 0;
-   int band = 0;
-   EncodingType encoding = INT1SBYTE;
-   InterleaveFormatType iType = BSQ;
+   IDL_MEMINT row = 0;
+   IDL_MEMINT column = 0;
+   IDL_MEMINT band = 0;
+   EncodingType encoding = pDesc->getDataType();
+   InterleaveFormatType iType = pDesc->getInterleaveFormat();
 
    int type = IDL_TYP_UNDEF;
-   int dimensions = 3;
-   RasterElement* pMatrix = NULL;
+   int dimensions = 0;
 
-   bool gotReData = true;
-   pRawData = reinterpret_cast<unsigned char*>(pData->getRawData());
-   if (pRawData == NULL || kw->startyheightExists || kw->endyheightExists || kw->startxwidthExists ||
-      kw->endxwidthExists || kw->bandstartExists || kw->bandendExists)
+   IdlFunctions::Subcube subcube;
+   subcube.mHeightEnd = pDesc->getRowCount()-1;
+   subcube.mWidthEnd = pDesc->getColumnCount()-1;
+   subcube.mBandEnd = pDesc->getBandCount()-1;
+   if (kw->startyheightExists)
+   {
+      subcube.mHeightStart = kw->startyheight;
+   }
+   if (kw->endyheightExists)
+   {
+      subcube.mHeightEnd = kw->endyheight;
+   }
+   if (kw->startxwidthExists)
+   {
+      subcube.mWidthStart = kw->startxwidth;
+   }
+   if (kw->endxwidthExists)
+   {
+      subcube.mWidthEnd = kw->endxwidth;
+   }
+   if (kw->bandstartExists)
+   {
+      subcube.mBandStart = kw->bandstart;
+   }
+   if (kw->bandendExists)
+   {
+      subcube.mBandEnd = kw->bandend;
+   }
+   if ((kw->rowSkipExists && kw->rowSkip < 1) || (kw->columnSkipExists && kw->columnSkip < 1) ||
+      (kw->bandSkipExists && kw->bandSkip < 1))
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "ARRAY_TO_IDL error.  ROW_SKIP, COLUMN_SKIP and BAND_SKIP must be "
+         "at least 1.");
+      return IDL_StrToSTRING("failure");
+   }
+   if (kw->rowSkipExists)
+   {
+      subcube.mRowSkip = kw->rowSkip;
+   }
+   if (kw->columnSkipExists)
    {
-      gotReData = false;
-      pRawData = NULL;
-      // can't get rawdata pointer or subcube selected, have to copy
-      if (pData != NULL)
+      subcube.mColumnSkip = kw->columnSkip;
+   }
+   if (kw->bandSkipExists)
+   {
+      subcube.mBandSkip = kw->bandSkip;
+   }
+   subcube.mConcurrentRows = IdlFunctions::getConcurrentRows();
+   if (kw->concurrentRowsExists)
+   {
+      if (kw->concurrentRows < 0)
       {
-         const RasterDataDescriptor* pDesc = dynamic_cast<const RasterDataDescriptor*>(pData->getDataDescriptor());
-         if (pDesc != NULL)
-         {
-            unsigned int heightStart = 0;
-            unsigned int heightEnd = pDesc->getRowCount()-1;
-            unsigned int widthStart= 0;
-            unsigned int widthEnd = pDesc->getColumnCount()-1;
-            unsigned int bandStart= 0;
-            unsigned int bandEnd = pDesc->getBandCount()-1;
-            encoding = pDesc->getDataType();
-            unsigned int bytesPerElement = pDesc->getBytesPerElement();
-            if (kw->startyheightExists)
-            {
-               heightStart = kw->startyheight;
-            }
-            if (kw->endyheightExists)
-            {
-               heightEnd = kw->endyheight;
-            }
-            if (kw->startxwidthExists)
-            {
-               widthStart = kw->startxwidth;
-            }
-            if (kw->endxwidthExists)
-            {
-               widthEnd = kw->endxwidth;
-            }
-            if (kw->bandstartExists)
-            {
-               bandStart = kw->bandstart;
-            }
-            if (kw->bandendExists)
-            {
-               bandEnd = kw->bandend;
-            }
-            column = widthEnd - widthStart+1;
-            row = heightEnd - heightStart+1;
-            band = bandEnd - bandStart+1;
-            //copy the subcube, determine the type
-            uint64_t totalToAllocate = static_cast<uint64_t>(column)*row*band*bytesPerElement;
-            if (totalToAllocate <= std::numeric_limits<size_t>::max())
-            {
-               pRawData = reinterpret_cast<unsigned char*>(malloc(static_cast<size_t>(totalToAllocate)));
-            }
-            if (pRawData == NULL)
-            {
-               std::string msg = "Not enough memory to allocate array";
-               IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, msg.c_str());
-               return IDL_StrToSTRING("failure");
-            }
-
-            switchOnComplexEncoding(encoding, IdlFunctions::copySubcube, pRawData, pData,
-               heightStart, heightEnd, widthStart, widthEnd, bandStart, bandEnd);
-         }
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "ARRAY_TO_IDL error.  CONCURRENT_ROWS must not be negative.");
+         return IDL_StrToSTRING("failure");
       }
+      subcube.mConcurrentRows = static_cast<unsigned int>(kw->concurrentRows);
    }
-   else
+   if (kw->bandListExists)
    {
-      RasterDataDescriptor* pDesc = dynamic_cast<RasterDataDescriptor*>(pData->getDataDescriptor());
-      if (pDesc == NULL)
+      if (kw->bandstartExists || kw->bandendExists || kw->bandSkipExists)
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "ARRAY_TO_IDL error.  BAND_LIST can not be used with BANDS_START, "
+            "BANDS_END or BAND_SKIP.");
+         return IDL_StrToSTRING("failure");
+      }
+      IDL_VPTR pList = kw->bandList;
+      IDL_VPTR pLongList = IDL_CvtLng(1, &pList);
+      IDL_MEMINT total = 0;
+      char* pValues = NULL;
+      IDL_VarGetData(pLongList, &total, &pValues, 0);
+      std::vector<unsigned int> bands;
+      bool valid = (total > 0);
+      for (IDL_MEMINT i = 0; i < total && valid; ++i)
+      {
+         const IDL_LONG value = reinterpret_cast<IDL_LONG*>(pValues)[i];
+         valid = (value >= 0 && static_cast<unsigned int>(value) < pDesc->getBandCount());
+         bands.push_back(static_cast<unsigned int>(value));
+      }
+      if (pLongList != pList)
+      {
+         IDL_Deltmp(pLongList);
+      }
+      if (!valid)
       {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "ARRAY_TO_IDL error.  BAND_LIST must hold active band numbers.");
          return IDL_StrToSTRING("failure");
       }
+      subcube.setBands(bands);
+   }
+   if (subcube.mHeightStart > subcube.mHeightEnd || subcube.mHeightEnd >= pDesc->getRowCount() ||
+      subcube.mWidthStart > subcube.mWidthEnd || subcube.mWidthEnd >= pDesc->getColumnCount() ||
+      subcube.mBandStart > subcube.mBandEnd || subcube.mBandEnd >= pDesc->getBandCount())
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "ARRAY_TO_IDL error.  The requested subcube is outside of the array.");
+      return IDL_StrToSTRING("failure");
+   }
+   column = subcube.getColumnCount();
+   row = subcube.getRowCount();
+   band = subcube.getBandCount();
 
-      iType = pDesc->getInterleaveFormat();
+   //the returned array defaults to the interleave of the element
+   InterleaveFormatType outInterleave = iType;
+   if (kw->interleaveExists)
+   {
+      bool error = false;
+      outInterleave = StringUtilities::fromXmlString<InterleaveFormatType>(
+         IDL_STRING_STR(&kw->idlInterleave), &error);
+      if (error || !outInterleave.isValid())
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET,
+            "ARRAY_TO_IDL error.  INTERLEAVE argument must be one of the following: BIP, BSQ or BIL");
+         return IDL_StrToSTRING("failure");
+      }
+   }
 
-      row = pDesc->getRowCount();
-      column = pDesc->getColumnCount();
-      band = pDesc->getBandCount();
-      encoding = pDesc->getDataType();
+   //integer complex data has no IDL type so it is always converted
+   type = getIdlType(encoding);
+   if (kw->typeExists)
+   {
+      type = kw->idlType;
+      if (IdlFunctions::getIdlTypeSize(type) == 0)
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "ARRAY_TO_IDL error.  TYPE must be a numeric IDL type code.");
+         return IDL_StrToSTRING("failure");
+      }
    }
 
-   //set the datatype based on the encoding
-   switch (encoding)
+   //the gain and offset of each band are applied while the data is converted to a real type
+   const bool calibrate = (kw->gainExists || kw->offsetExists);
+   std::vector<double> gains(band, 1.0);
+   std::vector<double> offsets(band, 0.0);
+   if (calibrate)
    {
-      case INT1SBYTE:
-         type = IDL_TYP_BYTE;
-         break;
-      case INT1UBYTE:
-         type = IDL_TYP_BYTE;
-         break;
-      case INT2SBYTES:
-         type = IDL_TYP_INT;
-         break;
-      case INT2UBYTES:
-         type = IDL_TYP_UINT;
-         break;
-      case INT4SCOMPLEX:
-         type = IDL_TYP_UNDEF;
-         break;
-      case INT4SBYTES:
-         type = IDL_TYP_LONG;
-         break;
-      case INT4UBYTES:
-         type = IDL_TYP_ULONG;
-         break;
-      case FLT4BYTES:
+      if (encoding == INT4SCOMPLEX || encoding == FLT8COMPLEX || kw->maskExists || kw->splitBandsExists ||
+         kw->detectExists)
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "ARRAY_TO_IDL error.  GAIN and OFFSET can not be used with "
+            "complex data, MASK, SPLIT_BANDS or DETECT.");
+         return IDL_StrToSTRING("failure");
+      }
+      if (kw->typeExists && type != IDL_TYP_FLOAT && type != IDL_TYP_DOUBLE)
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "ARRAY_TO_IDL error.  TYPE must be 4 or 5 with GAIN or OFFSET.");
+         return IDL_StrToSTRING("failure");
+      }
+      if ((kw->gainExists && !getBandValues(kw->gain, pData, subcube, gains)) ||
+         (kw->offsetExists && !getBandValues(kw->offset, pData, subcube, offsets)))
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "ARRAY_TO_IDL error.  GAIN and OFFSET must each have one value, "
+            "a value for each band of the array or a value for each requested band.");
+         return IDL_StrToSTRING("failure");
+      }
+      if (!kw->typeExists)
+      {
          type = IDL_TYP_FLOAT;
-         break;
-      case FLT8COMPLEX:
-         type = IDL_TYP_COMPLEX;
-         break;
-      case FLT8BYTES:
-         type = IDL_TYP_DOUBLE;
-         break;
-      default:
-         type = IDL_TYP_UNDEF;
-         break;
+      }
    }
 
-   if (kw->widthExists)
+   //bad values are replaced while the data is converted
+   IdlFunctions::BadValueFill badValues;
+   if (kw->useBadValuesExists && kw->useBadValues != 0)
    {
-      IDL_ALLTYPES tempVal;
-      tempVal.ul = column;
-      IDL_StoreScalar(kw->width, IDL_TYP_ULONG, &tempVal);
+      const std::vector<int>& elementBadValues = pDesc->getBadValues();
+      badValues.mValues.insert(badValues.mValues.end(), elementBadValues.begin(), elementBadValues.end());
    }
-   if (kw->heightExists)
+   if (kw->badValuesExists)
    {
-      IDL_ALLTYPES tempVal;
-      tempVal.ul = row;
-      IDL_StoreScalar(kw->height, IDL_TYP_ULONG, &tempVal);
+      IDL_VPTR pList = kw->badValues;
+      IDL_VPTR pDoubleList = IDL_CvtDbl(1, &pList);
+      IDL_MEMINT total = 0;
+      char* pValues = NULL;
+      IDL_VarGetData(pDoubleList, &total, &pValues, 0);
+      badValues.mValues.insert(badValues.mValues.end(), reinterpret_cast<double*>(pValues),
+         reinterpret_cast<double*>(pValues) + total);
+      if (pDoubleList != pList)
+      {
+         IDL_Deltmp(pDoubleList);
+      }
    }
-   if (kw->bandsExists)
+   const bool replaceBadValues = !badValues.mValues.empty();
+   if (kw->fillValueExists)
    {
-      IDL_ALLTYPES tempVal;
-      tempVal.ul = band;
-      IDL_StoreScalar(kw->bands, IDL_TYP_ULONG, &tempVal);
+      badValues.mFill = kw->fillValue;
    }
-   IDL_MEMINT dims[] = {0, 0, 0};
-   if (band == 1)
+   else if (replaceBadValues && type != IDL_TYP_FLOAT && type != IDL_TYP_DOUBLE && type != IDL_TYP_COMPLEX &&
+      type != IDL_TYP_DCOMPLEX)
    {
-      dimensions = 2;
-      // set the order for IDL (column major)
-      dims[1] = row;
-      dims[0] = column;
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "ARRAY_TO_IDL error.  FILL_VALUE must be given to replace bad values "
+         "in an integer array, or use TYPE=4 to replace them with NaN.");
+      return IDL_StrToSTRING("failure");
    }
-   else
+
+   //complex data is detected while it is copied so only the float values are returned
+   IdlFunctions::DetectionType detection = IdlFunctions::DETECT_MAGNITUDE;
+   const bool detect = (kw->detectExists != 0);
+   if (detect)
    {
-      switch (iType)
+      const std::string mode = IDL_STRING_STR(&kw->detect);
+      if (mode == "MAGNITUDE")
       {
-      // set the order for IDL (column major)
-      case BSQ:
-         dims[2] = band;
-         dims[1] = row;
-         dims[0] = column;
-         break;
-      case BIL:
-         dims[2] = row;
-         dims[1] = band;
-         dims[0] = column;
-         break;
-      case BIP:
-         dims[2] = row;
-         dims[1] = column;
-         dims[0] = band;
-         break;
-      default:
-         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Invalid interleave.");
+         detection = IdlFunctions::DETECT_MAGNITUDE;
+      }
+      else if (mode == "POWER")
+      {
+         detection = IdlFunctions::DETECT_POWER;
+      }
+      else if (mode == "DB")
+      {
+         detection = IdlFunctions::DETECT_DB;
+      }
+      else if (mode == "PHASE")
+      {
+         detection = IdlFunctions::DETECT_PHASE;
+      }
+      else
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET,
+            "ARRAY_TO_IDL error.  DETECT argument must be one of the following: MAGNITUDE, POWER, DB or PHASE");
+         return IDL_StrToSTRING("failure");
+      }
+      if (encoding != INT4SCOMPLEX && encoding != FLT8COMPLEX)
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "ARRAY_TO_IDL error.  DETECT can only be used with complex data.");
+         return IDL_StrToSTRING("failure");
+      }
+      if (kw->typeExists || kw->maskExists || kw->splitBandsExists || replaceBadValues)
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "ARRAY_TO_IDL error.  DETECT can not be used with TYPE, MASK, "
+            "SPLIT_BANDS, USE_BAD_VALUES or BAD_VALUES.");
          return IDL_StrToSTRING("failure");
       }
+      type = IDL_TYP_FLOAT;
    }
-   IDL_VPTR arrayRef;
-   if (gotReData)
+   const bool convert = (encoding == INT4SCOMPLEX || type != getIdlType(encoding) || replaceBadValues || detect ||
+      calibrate);
+   const bool fillOutArray = (kw->outArrayExists != 0);
+   const bool splitBands = (kw->splitBandsExists && kw->splitBands != 0);
+   if (splitBands && (kw->maskExists || fillOutArray || kw->interleaveExists))
    {
-      arrayRef = IDL_ImportArray(dimensions, dims, type, pRawData, NULL, NULL);
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "ARRAY_TO_IDL error.  SPLIT_BANDS can not be used with MASK, "
+         "OUT_ARRAY or INTERLEAVE.");
+      return IDL_StrToSTRING("failure");
    }
-   else
+   const bool async = (kw->asyncExists && kw->async != 0);
+   if (async && (convert || fillOutArray || splitBands || kw->maskExists || (kw->noCopyExists && kw->noCopy != 0)))
    {
-      arrayRef = IDL_ImportArray(dimensions, dims, type, pRawData,
-         reinterpret_cast<IDL_ARRAY_FREE_CB>(free), NULL);
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "ARRAY_TO_IDL error.  ASYNC can not be used with TYPE, DETECT, "
+         "GAIN, OFFSET, MASK, SPLIT_BANDS, OUT_ARRAY, NO_COPY or bad value replacement.");
+      return IDL_StrToSTRING("failure");
    }
-   return arrayRef;
-}
 
-/**
- * Turn an IDL array into a raster element.
- *
- * @param[in] [1]
- *            A one dimensional IDL array containing the data. The Opticks
- *            data type will be inferred from the IDL data type.
- * @param[in] [2]
- *            The name of the raster element.
- * @param[in] BANDS_END
- *            The number of bands in the array.
- * @param[in] HEIGHT_END
- *            The number of rows in the array.
- * @param[in] WIDTH_END
- *            The number of columns in the array.
- * @param[in] DATASET @opt
- *            The name of the data set which will be the parent of the raster element.
- *            Defaults to no parent.
- * @param[in] INTERLEAVE @opt
- *            The interleave of the data. Defaults to BSQ. Valid values are: BIP, BIL, and BSQ.
- * @param[in] NEW_WINDOW @opt
- *            If this flag is true, a new window is created for the data. If it is
- *            false, a new layer in the active window is created.
- * @param[in] ON_DISK @opt
- *            If this flag is true, the data is stored on the hard disk when pushed back to Opticks. If it is
- *            false, the data is stored in RAM when pushed back to Opticks.
- * @param[in] UNITS @opt
- *            The name of the units represented by the data. Defaults to no units.
- * @param[in] OVERWITE @opt
- *            If this flag is true and the target raster element exists, the data will be
- *            overwritten. If the raster element does not exist or the \p NEW_WINDOW flag
- *            is true, this flag is ignored.
- * @param[in] BANDS_START @opt
- *            The starting band in active band numbers if the \p OVERWRITE flag is specified.
- *            Defaults to 0.
- * @param[in] HEIGHT_START @opt
- *            The starting row in active row numbers if the \p OVERWRITE flag is specified.
- *            Defaults to 0.
- * @param[in] WIDTH_START @opt
- *            The starting column in active column numbers if the \p OVERWRITE flag is specified.
- *            Defaults to 0.
- * @rsof
- * @usage array = indgen(20000,/FLOAT)
- * print,array_to_opticks(array, "new", BANDS_END=2, HEIGHT_END=100, WIDTH_END=100, /NEW_WINDOW)
- * @endusage
- */
-IDL_VPTR array_to_opticks(int argc, IDL_VPTR pArgv[], char* pArgk)
-{
-   IDL_VPTR idlPtr;
-   typedef struct
+   if (kw->maskExists)
    {
-      IDL_KW_RESULT_FIRST_FIELD;
-      int newWindowExists;
-      IDL_LONG newWindow;
-      int onDiskExists;
-      IDL_LONG onDisk;
-      int interleaveExists;
-      IDL_STRING idlInterleave;
-      int unitsExists;
-      IDL_STRING idlUnits;
-      int datasetExists;
-      IDL_STRING idlDataset;
-      int heightExists;
-      IDL_LONG height;
-      int widthExists;
-      IDL_LONG width;
-      int bandsExists;
-      IDL_LONG bands;
-      int overwriteExists;
-      IDL_LONG overwrite;
-      int startxwidthExists;
-      IDL_LONG startxwidth;
-      int bandstartExists;
-      IDL_LONG bandstart;
-      int startyheightExists;
-      IDL_LONG startyheight;
-   } KW_RESULT;
+      if (kw->rowSkipExists || kw->columnSkipExists || kw->interleaveExists || kw->typeExists)
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "ARRAY_TO_IDL error.  MASK can not be used with ROW_SKIP, "
+            "COLUMN_SKIP, INTERLEAVE or TYPE.");
+         return IDL_StrToSTRING("failure");
+      }
+      //look for an AOI of the element before any other element with the name
+      const std::string maskName = IDL_STRING_STR(&kw->maskName);
+      Service<ModelServices> pModel;
+      DataElement* pMask = pModel->getElement(maskName, TypeConverter::toString<AoiElement>(), pData);
+      if (pMask == NULL)
+      {
+         pMask = pModel->getElement(maskName, TypeConverter::toString<AoiElement>(), NULL);
+      }
+      if (pMask == NULL)
+      {
+         pMask = IdlFunctions::getDataset(maskName);
+      }
+      std::vector<unsigned int> maskRows;
+      std::vector<unsigned int> maskColumns;
+      if (pMask == NULL || !IdlFunctions::getMaskedPixels(pMask, subcube, maskRows, maskColumns))
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "ARRAY_TO_IDL error.  MASK must be the name of an AOI or of a "
+            "raster element at least as large as the requested subcube.");
+         return IDL_StrToSTRING("failure");
+      }
+      if (maskRows.empty())
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "ARRAY_TO_IDL error.  MASK does not select any pixels.");
+         return IDL_StrToSTRING("failure");
+      }
 
-   //IDL_KW_FAST_SCAN is the type of scan we are using, following it is the
-   //name of the keyword, followed by the type, the mask(which should be 1),
-   //flags, a boolean whether the value was populated and finally the value itself
-   static IDL_KW_PAR kw_pars[] = {
-      IDL_KW_FAST_SCAN,
-      {"BANDS_END", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(bandsExists)),
-         reinterpret_cast<char*>(IDL_KW_OFFSETOF(bands))},
-      {"BANDS_START", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(bandstartExists)),
-         reinterpret_cast<char*>(IDL_KW_OFFSETOF(bandstart))},
-      {"DATASET", IDL_TYP_STRING, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(datasetExists)),
-         reinterpret_cast<char*>(IDL_KW_OFFSETOF(idlDataset))},
-      {"HEIGHT_END", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(heightExists)),
-         reinterpret_cast<char*>(IDL_KW_OFFSETOF(height))},
-      {"HEIGHT_START", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(startyheightExists)),
-         reinterpret_cast<char*>(IDL_KW_OFFSETOF(startyheight))},
-      {"INTERLEAVE", IDL_TYP_STRING, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(interleaveExists)),
-         reinterpret_cast<char*>(IDL_KW_OFFSETOF(idlInterleave))},
-      {"NEW_WINDOW", IDL_TYP_LONG, 1, IDL_KW_ZERO, reinterpret_cast<int*>(IDL_KW_OFFSETOF(newWindowExists)),
-         reinterpret_cast<char*>(IDL_KW_OFFSETOF(newWindow))},
+      if (fillOutArray)
+      {
+         pRawData = getOutArrayData(kw->outArray, type, static_cast<IDL_MEMINT>(maskRows.size()) * band);
+         if (pRawData == NULL)
+         {
+            IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "ARRAY_TO_IDL error.  OUT_ARRAY must be an array of the "
+               "returned type with an element for each band of each selected pixel.");
+            return IDL_StrToSTRING("failure");
+         }
+      }
+      else
+      {
+         const uint64_t totalToAllocate = static_cast<uint64_t>(maskRows.size()) * band *
+            IdlFunctions::getIdlTypeSize(type);
+         if (totalToAllocate <= std::numeric_limits<size_t>::max())
+         {
+            pRawData = reinterpret_cast<unsigned char*>(malloc(static_cast<size_t>(totalToAllocate)));
+         }
+         if (pRawData == NULL)
+         {
+            IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Not enough memory to allocate array");
+            return IDL_StrToSTRING("failure");
+         }
+      }
+      if (!IdlFunctions::copyMaskedPixels(pRawData, pData, subcube, maskRows, maskColumns,
+         replaceBadValues ? &badValues : NULL))
+      {
+         if (!fillOutArray)
+         {
+            free(pRawData);
+         }
+         return IDL_StrToSTRING("failure");
+      }
+      if ((kw->rowsOutExists && !storeIndices(kw->rowsOut, maskRows)) ||
+         (kw->columnsOutExists && !storeIndices(kw->columnsOut, maskColumns)))
+      {
+         if (!fillOutArray)
+         {
+            free(pRawData);
+         }
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Not enough memory to allocate array");
+         return IDL_StrToSTRING("failure");
+      }
+      if (kw->bandsExists)
+      {
+         IDL_ALLTYPES tempVal;
+         tempVal.ul = static_cast<IDL_ULONG>(band);
+         IDL_StoreScalar(kw->bands, IDL_TYP_ULONG, &tempVal);
+      }
+      if (kw->badCountOutExists)
+      {
+         IDL_ALLTYPES tempVal;
+         tempVal.ul64 = badValues.mCount;
+         IDL_StoreScalar(kw->badCountOut, IDL_TYP_ULONG64, &tempVal);
+      }
+      if (fillOutArray)
+      {
+         return IDL_StrToSTRING("success");
+      }
+      IDL_MEMINT dims[] = {band, static_cast<IDL_MEMINT>(maskRows.size())};
+      return IDL_ImportArray(2, dims, type, pRawData, reinterpret_cast<IDL_ARRAY_FREE_CB>(free), NULL);
+   }
+
+   if (splitBands)
+   {
+      // each band is a separate allocation so no single block has to hold the subcube
+      const uint64_t bandBytes = static_cast<uint64_t>(column) * row * IdlFunctions::getIdlTypeSize(type);
+      std::vector<void*> bandData(static_cast<size_t>(band), static_cast<void*>(NULL));
+      bool allocated = (bandBytes <= std::numeric_limits<size_t>::max());
+      for (size_t index = 0; index < bandData.size() && allocated; ++index)
+      {
+         bandData[index] = malloc(static_cast<size_t>(bandBytes));
+         allocated = (bandData[index] != NULL);
+      }
+      if (!allocated)
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Not enough memory to allocate array");
+      }
+      if (!allocated || !IdlFunctions::copySplitBands(bandData, type, pData, subcube,
+         replaceBadValues ? &badValues : NULL))
+      {
+         for (size_t index = 0; index < bandData.size(); ++index)
+         {
+            free(bandData[index]);
+         }
+         return IDL_StrToSTRING("failure");
+      }
+
+      if (kw->widthExists)
+      {
+         IDL_ALLTYPES tempVal;
+         tempVal.ul = static_cast<IDL_ULONG>(column);
+         IDL_StoreScalar(kw->width, IDL_TYP_ULONG, &tempVal);
+      }
+      if (kw->heightExists)
+      {
+         IDL_ALLTYPES tempVal;
+         tempVal.ul = static_cast<IDL_ULONG>(row);
+         IDL_StoreScalar(kw->height, IDL_TYP_ULONG, &tempVal);
+      }
+      if (kw->bandsExists)
+      {
+         IDL_ALLTYPES tempVal;
+         tempVal.ul = static_cast<IDL_ULONG>(band);
+         IDL_StoreScalar(kw->bands, IDL_TYP_ULONG, &tempVal);
+      }
+      if (kw->badCountOutExists)
+      {
+         IDL_ALLTYPES tempVal;
+         tempVal.ul64 = badValues.mCount;
+         IDL_StoreScalar(kw->badCountOut, IDL_TYP_ULONG64, &tempVal);
+      }
+
+      // the heap variables take over the band arrays so IDL frees each band with PTR_FREE
+      IDL_MEMINT pointerDims[] = {band};
+      IDL_VPTR pPointers = NULL;
+      IDL_HVID* pIds = reinterpret_cast<IDL_HVID*>(IDL_MakeTempArray(IDL_TYP_PTR, 1, pointerDims,
+         IDL_ARR_INI_ZERO, &pPointers));
+      for (size_t index = 0; index < bandData.size(); ++index)
+      {
+         IDL_MEMINT bandDims[] = {column, row};
+         IDL_VPTR pBand = IDL_ImportArray(2, bandDims, type, reinterpret_cast<UCHAR*>(bandData[index]),
+            reinterpret_cast<IDL_ARRAY_FREE_CB>(free), NULL);
+         pIds[index] = IDL_HeapVarNew(IDL_TYP_PTR, pBand, IDL_HEAPNEW_NOCOPY, IDL_MSG_LONGJMP)->hash.id;
+         IDL_Deltmp(pBand);
+      }
+      return pPointers;
+   }
+
+   if (async)
+   {
+      // the copy is always made on a worker thread and the array is returned by opticks_wait
+      IDL_MEMINT dims[] = {0, 0, 0};
+      if (!getIdlDimensions(outInterleave, row, column, band, dims, dimensions))
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Invalid interleave.");
+         return IDL_StrToSTRING("failure");
+      }
+      const uint64_t totalToAllocate = static_cast<uint64_t>(column) * row * band * pDesc->getBytesPerElement();
+      if (totalToAllocate <= std::numeric_limits<size_t>::max())
+      {
+         pRawData = reinterpret_cast<unsigned char*>(malloc(static_cast<size_t>(totalToAllocate)));
+      }
+      if (pRawData == NULL)
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Not enough memory to allocate array");
+         return IDL_StrToSTRING("failure");
+      }
+      const IDL_LONG handle = AsyncTransfers::instance().startRead(pRawData, pData, subcube, outInterleave,
+         dimensions, dims, type);
+      if (handle == 0)
+      {
+         free(pRawData);
+         return IDL_StrToSTRING("failure");
+      }
+      if (kw->widthExists)
+      {
+         IDL_ALLTYPES tempVal;
+         tempVal.ul = static_cast<IDL_ULONG>(column);
+         IDL_StoreScalar(kw->width, IDL_TYP_ULONG, &tempVal);
+      }
+      if (kw->heightExists)
+      {
+         IDL_ALLTYPES tempVal;
+         tempVal.ul = static_cast<IDL_ULONG>(row);
+         IDL_StoreScalar(kw->height, IDL_TYP_ULONG, &tempVal);
+      }
+      if (kw->bandsExists)
+      {
+         IDL_ALLTYPES tempVal;
+         tempVal.ul = static_cast<IDL_ULONG>(band);
+         IDL_StoreScalar(kw->bands, IDL_TYP_ULONG, &tempVal);
+      }
+      if (kw->badCountOutExists)
+      {
+         IDL_ALLTYPES tempVal;
+         tempVal.ul64 = 0;
+         IDL_StoreScalar(kw->badCountOut, IDL_TYP_ULONG64, &tempVal);
+      }
+      return IDL_GettmpLong(handle);
+   }
+
+   bool gotReData = false;
+   unsigned char* pElementData = reinterpret_cast<unsigned char*>(pData->getRawData());
+   if (!convert && !fillOutArray && pElementData != NULL && !(kw->copyExists && kw->copy != 0) &&
+      IdlFunctions::isSameLayout(iType, outInterleave, row, column, band))
+   {
+      uint64_t offset = 0;
+      if (IdlFunctions::getContiguousOffset(pDesc, subcube, offset) &&
+         !ExportRegistry::instance().isExported(pElementData + offset * pDesc->getBytesPerElement()))
+      {
+         // the requested data is one contiguous slab of the element, hand it to IDL directly
+         gotReData = true;
+         pRawData = pElementData + offset * pDesc->getBytesPerElement();
+      }
+   }
+   bool mapped = false;
+   if (!convert && !fillOutArray && pElementData == NULL && kw->noCopyExists && kw->noCopy != 0 &&
+      IdlFunctions::isSameLayout(iType, outInterleave, row, column, band))
+   {
+      // on-disk data stored in a raw file, let the OS page it in as IDL reads it
+      pRawData = IdlFunctions::mapSubcube(pData, subcube);
+      mapped = (pRawData != NULL);
+   }
+   if (!gotReData && !mapped)
+   {
+      // can't get rawdata pointer, subcube is not contiguous or the interleave or type changes, have to copy
+      size_t bytesPerElement = convert ? IdlFunctions::getIdlTypeSize(type) : pDesc->getBytesPerElement();
+      uint64_t totalToAllocate = static_cast<uint64_t>(column)*row*band*bytesPerElement;
+      if (fillOutArray)
+      {
+         pRawData = getOutArrayData(kw->outArray, type, column * row * band);
+         if (pRawData == NULL)
+         {
+            IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "ARRAY_TO_IDL error.  OUT_ARRAY must be an array of the "
+               "returned type with the same number of elements as the requested subcube.");
+            return IDL_StrToSTRING("failure");
+         }
+      }
+      else
+      {
+         if (totalToAllocate <= std::numeric_limits<size_t>::max())
+         {
+            pRawData = reinterpret_cast<unsigned char*>(malloc(static_cast<size_t>(totalToAllocate)));
+         }
+         if (pRawData == NULL)
+         {
+            std::string msg = "Not enough memory to allocate array";
+            IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, msg.c_str());
+            return IDL_StrToSTRING("failure");
+         }
+      }
+
+      // an IDL array referring to the element's data could change it without a signal
+      ResultCache& results = ResultCache::instance();
+      const bool keepResult = !replaceBadValues && !detect && !calibrate &&
+         ExportRegistry::instance().getExportedBytes(pData) == 0 && results.applySettings();
+      const size_t bytes = static_cast<size_t>(totalToAllocate);
+      bool copied = keepResult && results.copy(pData, subcube, outInterleave, type, pRawData, bytes);
+      if (!copied)
+      {
+         if (detect)
+         {
+            copied = IdlFunctions::copyDetectedSubcube(reinterpret_cast<float*>(pRawData), detection, pData,
+               subcube, outInterleave);
+         }
+         else if (calibrate)
+         {
+            copied = IdlFunctions::copyCalibratedSubcube(pRawData, type, pData, subcube, outInterleave, gains,
+               offsets, replaceBadValues ? &badValues : NULL);
+         }
+         else if (convert)
+         {
+            copied = IdlFunctions::copyConvertedSubcube(pRawData, type, pData, subcube, outInterleave,
+               replaceBadValues ? &badValues : NULL);
+         }
+         else if (pElementData == NULL && TileCache::isCacheable(pDesc, subcube) &&
+            TileCache::instance().applySettings())
+         {
+            // on-disk data, keep the tiles around for the next call
+            switchOnComplexEncoding(encoding, copyCachedSubcube, pRawData, pData, subcube, outInterleave, copied);
+         }
+         else
+         {
+            switchOnComplexEncoding(encoding, IdlFunctions::copySubcube, pRawData, pData, subcube, outInterleave,
+               copied);
+         }
+         if (copied && keepResult)
+         {
+            results.insert(pData, subcube, outInterleave, type, pRawData, bytes);
+         }
+      }
+      if (!copied)
+      {
+         if (!fillOutArray)
+         {
+            free(pRawData);
+         }
+         return IDL_StrToSTRING("failure");
+      }
+   }
+
+   if (kw->widthExists)
+   {
+      IDL_ALLTYPES tempVal;
+      tempVal.ul = static_cast<IDL_ULONG>(column);
+      IDL_StoreScalar(kw->width, IDL_TYP_ULONG, &tempVal);
+   }
+   if (kw->heightExists)
+   {
+      IDL_ALLTYPES tempVal;
+      tempVal.ul = static_cast<IDL_ULONG>(row);
+      IDL_StoreScalar(kw->height, IDL_TYP_ULONG, &tempVal);
+   }
+   if (kw->bandsExists)
+   {
+      IDL_ALLTYPES tempVal;
+      tempVal.ul = static_cast<IDL_ULONG>(band);
+      IDL_StoreScalar(kw->bands, IDL_TYP_ULONG, &tempVal);
+   }
+   if (kw->badCountOutExists)
+   {
+      IDL_ALLTYPES tempVal;
+      tempVal.ul64 = badValues.mCount;
+      IDL_StoreScalar(kw->badCountOut, IDL_TYP_ULONG64, &tempVal);
+   }
+   if (fillOutArray)
+   {
+      return IDL_StrToSTRING("success");
+   }
+   IDL_MEMINT dims[] = {0, 0, 0};
+   if (!getIdlDimensions(outInterleave, row, column, band, dims, dimensions))
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Invalid interleave.");
+      if (mapped)
+      {
+         IdlFunctions::unmapSubcube(pRawData);
+      }
+      else if (!gotReData)
+      {
+         free(pRawData);
+      }
+      return IDL_StrToSTRING("failure");
+   }
+   IDL_VPTR arrayRef;
+   if (gotReData)
+   {
+      // the registry copies the data into the array if the element is destroyed first
+      arrayRef = ExportRegistry::instance().importArray(pData, dimensions, dims, type, pRawData);
+      ResultCache::instance().invalidate(pData);
+      OverviewCache::instance().invalidate(pData);
+   }
+   else if (mapped)
+   {
+      arrayRef = IDL_ImportArray(dimensions, dims, type, pRawData, IdlFunctions::unmapSubcube, NULL);
+   }
+   else
+   {
+      arrayRef = IDL_ImportArray(dimensions, dims, type, pRawData,
+         reinterpret_cast<IDL_ARRAY_FREE_CB>(free), NULL);
+   }
+   return arrayRef;
+}
+
+/**
+ * Turn an IDL array into a raster element.
+ *
+ * @param[in] [1]
+ *            A one dimensional IDL array containing the data. The Opticks
+ *            data type will be inferred from the IDL data type.
+ * @param[in] [2]
+ *            The name of the raster element.
+ * @param[in] BANDS_END
+ *            The number of bands in the array.
+ * @param[in] HEIGHT_END
+ *            The number of rows in the array.
+ * @param[in] WIDTH_END
+ *            The number of columns in the array.
+ * @param[in] DATASET @opt
+ *            The name of the data set which will be the parent of the raster element.
+ *            Defaults to no parent.
+ * @param[in] INTERLEAVE @opt
+ *            The interleave of the data. Defaults to BSQ. Valid values are: BIP, BIL, and BSQ.
+ * @param[in] ELEMENT_INTERLEAVE @opt
+ *            The interleave of the new raster element. Defaults to \p INTERLEAVE. Valid values
+ *            are: BIP, BIL, and BSQ. The data is converted from \p INTERLEAVE while it is
+ *            copied so the array does not need to be transposed in IDL. When the \p OVERWRITE
+ *            flag is used the data is always converted to the interleave of the existing
+ *            raster element.
+ * @param[in] NEW_WINDOW @opt
+ *            If this flag is true, a new window is created for the data. If it is
+ *            false, a new layer in the active window is created.
+ * @param[in] ON_DISK @opt
+ *            If this flag is true, the data is stored on the hard disk when pushed back to Opticks. If it is
+ *            false, the data is stored in RAM when pushed back to Opticks.
+ * @param[in] UNITS @opt
+ *            The name of the units represented by the data. Defaults to no units.
+ * @param[in] OVERWITE @opt
+ *            If this flag is true and the target raster element exists, the data will be
+ *            overwritten. If the raster element does not exist or the \p NEW_WINDOW flag
+ *            is true, this flag is ignored.
+ * @param[in] BANDS_START @opt
+ *            The starting band in active band numbers if the \p OVERWRITE flag is specified.
+ *            Defaults to 0.
+ * @param[in] HEIGHT_START @opt
+ *            The starting row in active row numbers if the \p OVERWRITE flag is specified.
+ *            Defaults to 0.
+ * @param[in] WIDTH_START @opt
+ *            The starting column in active column numbers if the \p OVERWRITE flag is specified.
+ *            Defaults to 0.
+ * @param[in] CONCURRENT_ROWS @opt
+ *            The number of rows of the raster element which are paged in at once while the
+ *            data is written. Defaults to the value in the IDL interpreter options, or when
+ *            that is 0, to enough rows to make blocks of about four megabytes.
+ * @param[in] ASYNC @opt
+ *            If this flag is set with \p OVERWRITE, a transfer handle is returned at once and
+ *            the data is written on a background thread while IDL keeps running. The array is
+ *            copied first, so it can be changed as soon as this returns. Pass the handle to
+ *            opticks_wait() to finish the transfer, or to opticks_poll() to see if it has
+ *            finished. The raster element is not updated in Opticks until opticks_wait() is
+ *            called and must not be read or changed before then.
+ * @rsof
+ * @usage array = indgen(20000,/FLOAT)
+ * print,array_to_opticks(array, "new", BANDS_END=2, HEIGHT_END=100, WIDTH_END=100, /NEW_WINDOW)
+ * print,array_to_opticks(array, "new_bip", BANDS_END=2, HEIGHT_END=100, WIDTH_END=100, ELEMENT_INTERLEAVE="BIP", /NEW_WINDOW)
+ * transfer = array_to_opticks(array, "new", BANDS_END=2, HEIGHT_END=100, WIDTH_END=100, /OVERWRITE, /ASYNC)
+ * print,opticks_wait(transfer)
+ * @endusage
+ */
+IDL_VPTR array_to_opticks(int argc, IDL_VPTR pArgv[], char* pArgk)
+{
+   IDL_VPTR idlPtr;
+   typedef struct
+   {
+      IDL_KW_RESULT_FIRST_FIELD;
+      int newWindowExists;
+      IDL_LONG newWindow;
+      int onDiskExists;
+      IDL_LONG onDisk;
+      int interleaveExists;
+      IDL_STRING idlInterleave;
+      int elementInterleaveExists;
+      IDL_STRING idlElementInterleave;
+      int unitsExists;
+      IDL_STRING idlUnits;
+      int datasetExists;
+      IDL_STRING idlDataset;
+      int heightExists;
+      IDL_LONG height;
+      int widthExists;
+      IDL_LONG width;
+      int bandsExists;
+      IDL_LONG bands;
+      int overwriteExists;
+      IDL_LONG overwrite;
+      int startxwidthExists;
+      IDL_LONG startxwidth;
+      int bandstartExists;
+      IDL_LONG bandstart;
+      int startyheightExists;
+      IDL_LONG startyheight;
+      int concurrentRowsExists;
+      IDL_LONG concurrentRows;
+      int asyncExists;
+      IDL_LONG async;
+   } KW_RESULT;
+
+   //IDL_KW_FAST_SCAN is the type of scan we are using, following it is the
+   //name of the keyword, followed by the type, the mask(which should be 1),
+   //flags, a boolean whether the value was populated and finally the value itself
+   static IDL_KW_PAR kw_pars[] = {
+      IDL_KW_FAST_SCAN,
+      {"ASYNC", IDL_TYP_LONG, 1, IDL_KW_ZERO, reinterpret_cast<int*>(IDL_KW_OFFSETOF(asyncExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(async))},
+      {"BANDS_END", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(bandsExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(bands))},
+      {"BANDS_START", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(bandstartExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(bandstart))},
+      {"CONCURRENT_ROWS", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(concurrentRowsExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(concurrentRows))},
+      {"DATASET", IDL_TYP_STRING, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(datasetExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(idlDataset))},
+      {"ELEMENT_INTERLEAVE", IDL_TYP_STRING, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(elementInterleaveExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(idlElementInterleave))},
+      {"HEIGHT_END", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(heightExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(height))},
+      {"HEIGHT_START", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(startyheightExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(startyheight))},
+      {"INTERLEAVE", IDL_TYP_STRING, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(interleaveExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(idlInterleave))},
+      {"NEW_WINDOW", IDL_TYP_LONG, 1, IDL_KW_ZERO, reinterpret_cast<int*>(IDL_KW_OFFSETOF(newWindowExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(newWindow))},
       {"ON_DISK", IDL_TYP_LONG, 1, IDL_KW_ZERO, reinterpret_cast<int*>(IDL_KW_OFFSETOF(onDiskExists)),
          reinterpret_cast<char*>(IDL_KW_OFFSETOF(onDisk))},
       {"OVERWRITE", IDL_TYP_LONG, 1, IDL_KW_ZERO, reinterpret_cast<int*>(IDL_KW_OFFSETOF(overwriteExists)),
@@ -513,12 +2022,25 @@ IDL_VPTR array_to_opticks(int argc, IDL_VPTR pArgv[], char* pArgk)
          return IDL_StrToSTRING("failure");
       }
    }
-   uint64_t dimensionTotal = static_cast<uint64_t>(height)*width*bands;
-   if (total != dimensionTotal)
+   InterleaveFormatType elementInterleave = iType;
+   if (kw->elementInterleaveExists)
    {
-      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET,
-         "ARRAY_TO_OPTICKS error.  Passed in array size does not match size keywords.");
-      return IDL_StrToSTRING("failure");
+      bool error = false;
+      elementInterleave = StringUtilities::fromXmlString<InterleaveFormatType>(
+         IDL_STRING_STR(&kw->idlElementInterleave), &error);
+      if (error || !elementInterleave.isValid())
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET,
+            "ARRAY_TO_OPTICKS error.  ELEMENT_INTERLEAVE argument must be one of the following: BIP, BSQ or BIL");
+         return IDL_StrToSTRING("failure");
+      }
+   }
+   uint64_t dimensionTotal = static_cast<uint64_t>(height)*width*bands;
+   if (static_cast<uint64_t>(total) != dimensionTotal)
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET,
+         "ARRAY_TO_OPTICKS error.  Passed in array size does not match size keywords.");
+      return IDL_StrToSTRING("failure");
    }
    if (kw->overwriteExists)
    {
@@ -535,216 +2057,861 @@ IDL_VPTR array_to_opticks(int argc, IDL_VPTR pArgv[], char* pArgk)
          inMemory = false;
       }
    }
+   unsigned int concurrentRows = IdlFunctions::getConcurrentRows();
+   if (kw->concurrentRowsExists)
+   {
+      if (kw->concurrentRows < 0)
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "ARRAY_TO_OPTICKS error.  CONCURRENT_ROWS must not be negative.");
+         return IDL_StrToSTRING("failure");
+      }
+      concurrentRows = static_cast<unsigned int>(kw->concurrentRows);
+   }
+
+   if (!getEncoding(type, encoding))
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "unable to determine type.");
+      return IDL_StrToSTRING("failure");
+   }
+
+   //an overwritten raster element keeps its own interleave
+   RasterElement* pOverwriteRaster = NULL;
+   if (newWindow == 0 && overwrite != 0)
+   {
+      RasterElement* pParent = dynamic_cast<RasterElement*>(IdlFunctions::getDataset(datasetName));
+      pOverwriteRaster = static_cast<RasterElement*>(Service<ModelServices>()->getElement(newDataName,
+         TypeConverter::toString<RasterElement>(), pParent));
+      if (pOverwriteRaster == NULL)
+      {
+         pOverwriteRaster = pParent;
+      }
+      const RasterDataDescriptor* pDesc = (pOverwriteRaster == NULL) ? NULL :
+         dynamic_cast<const RasterDataDescriptor*>(pOverwriteRaster->getDataDescriptor());
+      if (pDesc == NULL)
+      {
+         return IDL_StrToSTRING("failure");
+      }
+      if (pDesc->getDataType() != encoding)
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET,
+            "ARRAY_TO_OPTICKS error.  data type of new array is not the same as the old.");
+         return IDL_StrToSTRING("failure");
+      }
+      elementInterleave = pDesc->getInterleaveFormat();
+   }
+   const bool async = (kw->asyncExists && kw->async != 0);
+   if (async && pOverwriteRaster == NULL)
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET,
+         "ARRAY_TO_OPTICKS error.  ASYNC can only be used to OVERWRITE an existing raster element.");
+      return IDL_StrToSTRING("failure");
+   }
+
+   //rearrange the array into the interleave of the raster element
+   char* pConvertedData = NULL;
+   if (!IdlFunctions::isSameLayout(iType, elementInterleave, height, width, bands))
+   {
+      pConvertedData = reinterpret_cast<char*>(malloc(static_cast<size_t>(total) * pArgv[0]->value.arr->elt_len));
+      if (pConvertedData == NULL)
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Not enough memory to allocate array");
+         return IDL_StrToSTRING("failure");
+      }
+      switchOnComplexEncoding(encoding, IdlFunctions::convertInterleave, pConvertedData, elementInterleave,
+         pRawData, iType, height, width, bands);
+      pRawData = pConvertedData;
+   }
+   iType = elementInterleave;
 
    //add the data as a new results matrix and view to the current dataset and window
-   switch (type)
+   if (!newWindow && !overwrite)
    {
-      case IDL_TYP_BYTE :
-         encoding = INT1SBYTE;
-         if (!newWindow && !overwrite)
-         {
+      switch (type)
+      {
+         case IDL_TYP_BYTE :
             IdlFunctions::addMatrixToCurrentView(reinterpret_cast<char*>(pRawData), newDataName, width,
-               height, bands, unitName, encoding, inMemory, iType, datasetName);
-            bSuccess = true;
-         }
-         break;
-      case IDL_TYP_INT :
-         encoding = INT2SBYTES;
-         if (!newWindow && !overwrite)
-         {
+               height, bands, unitName, encoding, inMemory, iType, datasetName,
+               concurrentRows);
+            break;
+         case IDL_TYP_INT :
             IdlFunctions::addMatrixToCurrentView(reinterpret_cast<short*>(pRawData), newDataName, width,
-               height, bands, unitName, encoding, inMemory, iType, datasetName);
-            bSuccess = true;
-         }
-         break;
-      case IDL_TYP_UINT :
-         encoding = INT2UBYTES;
-         if (!newWindow && !overwrite)
-         {
+               height, bands, unitName, encoding, inMemory, iType, datasetName,
+               concurrentRows);
+            break;
+         case IDL_TYP_UINT :
             IdlFunctions::addMatrixToCurrentView(reinterpret_cast<unsigned short*>(pRawData), newDataName,
-               width, height, bands, unitName, encoding, inMemory, iType, datasetName);
-            bSuccess = true;
-         }
-         break;
-      case IDL_TYP_LONG :
-         encoding = INT4SBYTES;
-         if (!newWindow && !overwrite)
-         {
+               width, height, bands, unitName, encoding, inMemory, iType, datasetName,
+               concurrentRows);
+            break;
+         case IDL_TYP_LONG :
             IdlFunctions::addMatrixToCurrentView(reinterpret_cast<int*>(pRawData), newDataName, width,
-               height, bands, unitName, encoding, inMemory, iType, datasetName);
-            bSuccess = true;
-         }
-         break;
-      case IDL_TYP_ULONG :
-         encoding = INT4UBYTES;
-         if (!newWindow && !overwrite)
-         {
+               height, bands, unitName, encoding, inMemory, iType, datasetName,
+               concurrentRows);
+            break;
+         case IDL_TYP_ULONG :
             IdlFunctions::addMatrixToCurrentView(reinterpret_cast<unsigned int*>(pRawData), newDataName,
-               width, height, bands, unitName, encoding, inMemory, iType, datasetName);
-            bSuccess = true;
+               width, height, bands, unitName, encoding, inMemory, iType, datasetName,
+               concurrentRows);
+            break;
+         case IDL_TYP_FLOAT :
+            IdlFunctions::addMatrixToCurrentView(reinterpret_cast<float*>(pRawData), newDataName,
+               width, height, bands, unitName, encoding, inMemory, iType, datasetName,
+               concurrentRows);
+            break;
+         case IDL_TYP_DOUBLE :
+            IdlFunctions::addMatrixToCurrentView(reinterpret_cast<double*>(pRawData), newDataName,
+               width, height, bands, unitName, encoding, inMemory, iType, datasetName,
+               concurrentRows);
+            break;
+         case IDL_TYP_COMPLEX:
+            IdlFunctions::addMatrixToCurrentView(reinterpret_cast<FloatComplex*>(pRawData), newDataName,
+               width, height, bands, unitName, encoding, inMemory, iType, datasetName,
+               concurrentRows);
+            break;
+      }
+      bSuccess = true;
+   }
+   else if (newWindow != 0)
+   {
+      //user wants to create a new RasterElement and window
+      RasterElement* pRaster = IdlFunctions::createRasterElement(pRawData, datasetName,
+         newDataName, encoding, inMemory, iType, unitName, height, width, bands, concurrentRows);
+      if (pRaster != NULL)
+      {
+         //----- Now create the spatial data window to display the data
+         SpatialDataWindow* pWindow = static_cast<SpatialDataWindow*>(
+            Service<DesktopServices>()->createWindow(newDataName, SPATIAL_DATA_WINDOW));
+
+         if (pWindow != NULL)
+         {
+            SpatialDataView* pView = pWindow->getSpatialDataView();
+
+            if (pView != NULL)
+            {
+               UndoLock undo(pView);
+               //----- Set the spatial data in the view
+               pView->setPrimaryRasterElement(pRaster);
+               //----- Create the cube layer
+               RasterLayer* pLayer = static_cast<RasterLayer*>(pView->createLayer(RASTER, pRaster));
+               bSuccess = true;
+            }
          }
+      }
+   }
+   else if (pOverwriteRaster != NULL)
+   {
+      //the user wants to replace the spectral cube of the RasterElement with all new data
+      unsigned int heightStart = 0;
+      unsigned int widthStart= 0;
+      unsigned int bandStart= 0;
+      if (kw->startyheightExists)
+      {
+         heightStart = kw->startyheight;
+      }
+      if (kw->startxwidthExists)
+      {
+         widthStart = kw->startxwidth;
+      }
+      if (kw->bandstartExists)
+      {
+         bandStart = kw->bandstart;
+      }
+      if (async)
+      {
+         return startAsyncWrite(pOverwriteRaster, pRawData, pConvertedData, static_cast<size_t>(total) *
+            pArgv[0]->value.arr->elt_len, heightStart, height, widthStart, width, bandStart, bands, concurrentRows);
+      }
+      bSuccess = IdlFunctions::changeRasterElement(pOverwriteRaster, pRawData, encoding, iType, heightStart,
+         height, widthStart, width, bandStart, bands, encoding, concurrentRows);
+   }
+   free(pConvertedData);
+   if (bSuccess)
+   {
+      idlPtr = IDL_StrToSTRING("success");
+   }
+   else
+   {
+      idlPtr = IDL_StrToSTRING("failure");
+   }
+
+   return idlPtr;
+}
+
+/**
+ * Run an IDL function over a raster element one tile at a time and store the results
+ * in a new raster element.
+ *
+ * Each tile holds every band of a block of rows and columns and is passed to the
+ * function laid out as array_to_idl() would return it. The function must return an
+ * array with the same number of rows and columns in the same interleave. The number
+ * of bands and the data type of the result are taken from the first tile and must be
+ * the same for every tile. The next tile is read while the function runs on the
+ * current one, so only a few tiles are held in memory regardless of the size of the
+ * raster element. The tile passed to the function is only valid during the call.
+ *
+ * @param[in] [1]
+ *            The name of the IDL function to call. It takes the tile as its only argument.
+ * @param[in] [2]
+ *            The name of the new raster element.
+ * @param[in] DATASET @opt
+ *            The name of the raster element to process. It is also the parent of the
+ *            new raster element. Defaults to the primary raster element of the active window.
+ * @param[in] TILE_HEIGHT @opt
+ *            The number of rows in each tile. Defaults to 512.
+ * @param[in] TILE_WIDTH @opt
+ *            The number of columns in each tile. Defaults to the number of columns in
+ *            the raster element.
+ * @param[in] ON_DISK @opt
+ *            If this flag is true, the new raster element is stored on the hard disk. If it is
+ *            false, it is stored in RAM.
+ * @rsof
+ * @usage
+ * function double_tile, tile
+ *    return, tile * 2.0
+ * end
+ * print,opticks_tile_map("double_tile", "doubled", TILE_HEIGHT=256, /ON_DISK)
+ * @endusage
+ */
+IDL_VPTR opticks_tile_map(int argc, IDL_VPTR pArgv[], char* pArgk)
+{
+   typedef struct
+   {
+      IDL_KW_RESULT_FIRST_FIELD;
+      int datasetExists;
+      IDL_STRING idlDataset;
+      int onDiskExists;
+      IDL_LONG onDisk;
+      int tileHeightExists;
+      IDL_LONG tileHeight;
+      int tileWidthExists;
+      IDL_LONG tileWidth;
+   } KW_RESULT;
+
+   //IDL_KW_FAST_SCAN is the type of scan we are using, following it is the
+   //name of the keyword, followed by the type, the mask(which should be 1),
+   //flags, a boolean whether the value was populated and finally the value itself
+   static IDL_KW_PAR kw_pars[] = {
+      IDL_KW_FAST_SCAN,
+      {"DATASET", IDL_TYP_STRING, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(datasetExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(idlDataset))},
+      {"ON_DISK", IDL_TYP_LONG, 1, IDL_KW_ZERO, reinterpret_cast<int*>(IDL_KW_OFFSETOF(onDiskExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(onDisk))},
+      {"TILE_HEIGHT", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(tileHeightExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(tileHeight))},
+      {"TILE_WIDTH", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(tileWidthExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(tileWidth))},
+      {NULL}
+   };
+
+   IdlFunctions::IdlKwResource<KW_RESULT> kw(argc, pArgv, pArgk, kw_pars, 0, 1);
+
+   if (argc < 2)
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "OPTICKS_TILE_MAP takes the name of an IDL function and the name "
+         "of the new raster element.  It has DATASET, TILE_HEIGHT, TILE_WIDTH and ON_DISK keywords.");
+      return IDL_StrToSTRING("failure");
+   }
+   const std::string functionName = IDL_VarGetString(pArgv[0]);
+   const std::string newDataName = IDL_VarGetString(pArgv[1]);
+
+   std::string datasetName;
+   if (kw->datasetExists)
+   {
+      datasetName = IDL_STRING_STR(&kw->idlDataset);
+   }
+   RasterElement* pSource = IdlFunctions::getDataset(datasetName);
+   const RasterDataDescriptor* pDesc = (pSource == NULL) ? NULL :
+      dynamic_cast<const RasterDataDescriptor*>(pSource->getDataDescriptor());
+   if (pDesc == NULL)
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Error could not find array.");
+      return IDL_StrToSTRING("failure");
+   }
+   const unsigned int rows = pDesc->getRowCount();
+   const unsigned int columns = pDesc->getColumnCount();
+   const unsigned int bands = pDesc->getBandCount();
+   const InterleaveFormatType interleave = pDesc->getInterleaveFormat();
+   //tiles are passed to IDL in the element's own type, which IDL does not have for integer complex data
+   const int type = getIdlType(pDesc->getDataType());
+   if (type == IDL_TYP_UNDEF || pDesc->getDataType() == INT4SCOMPLEX)
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "unable to determine type.");
+      return IDL_StrToSTRING("failure");
+   }
+
+   unsigned int tileHeight = std::min(512U, rows);
+   unsigned int tileWidth = columns;
+   if ((kw->tileHeightExists && kw->tileHeight < 1) || (kw->tileWidthExists && kw->tileWidth < 1))
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "OPTICKS_TILE_MAP error.  TILE_HEIGHT and TILE_WIDTH must be "
+         "at least 1.");
+      return IDL_StrToSTRING("failure");
+   }
+   if (kw->tileHeightExists)
+   {
+      tileHeight = std::min(static_cast<unsigned int>(kw->tileHeight), rows);
+   }
+   if (kw->tileWidthExists)
+   {
+      tileWidth = std::min(static_cast<unsigned int>(kw->tileWidth), columns);
+   }
+   bool inMemory = true;
+   if (kw->onDiskExists && kw->onDisk != 0)
+   {
+      inMemory = false;
+   }
+   if (Service<ModelServices>()->getElement(newDataName, TypeConverter::toString<RasterElement>(), pSource) != NULL)
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "matrix already exists.");
+      return IDL_StrToSTRING("failure");
+   }
+
+   //tiles are visited in row major order so the element is read sequentially
+   std::vector<IdlFunctions::Subcube> tiles;
+   for (unsigned int row = 0; row < rows; row += tileHeight)
+   {
+      for (unsigned int column = 0; column < columns; column += tileWidth)
+      {
+         IdlFunctions::Subcube tile;
+         tile.mHeightStart = row;
+         tile.mHeightEnd = std::min(row + tileHeight, rows) - 1;
+         tile.mWidthStart = column;
+         tile.mWidthEnd = std::min(column + tileWidth, columns) - 1;
+         tile.mBandEnd = bands - 1;
+         tiles.push_back(tile);
+      }
+   }
+
+   static char spInputName[] = "OPTICKS_TILE_MAP_IN";
+   static char spOutputName[] = "OPTICKS_TILE_MAP_OUT";
+   const std::string command = std::string(spOutputName) + " = " + functionName + "(" + spInputName + ")";
+   const unsigned int threadCount = IdlFunctions::getThreadCount();
+   const size_t bytesPerElement = pDesc->getBytesPerElement();
+
+   RasterElement* pResult = NULL;
+   int resultType = IDL_TYP_UNDEF;
+   unsigned int resultBands = 0;
+   bool bSuccess = true;
+
+   IdlFunctions::SubcubeReader reader;
+   unsigned char* pNext = reinterpret_cast<unsigned char*>(malloc(static_cast<size_t>(tiles[0].getRowCount()) *
+      tiles[0].getColumnCount() * bands * bytesPerElement));
+   if (pNext == NULL)
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Not enough memory to allocate array");
+      return IDL_StrToSTRING("failure");
+   }
+   reader.start(pNext, pSource, tiles[0], threadCount);
+   for (std::vector<IdlFunctions::Subcube>::size_type tile = 0; tile < tiles.size(); ++tile)
+   {
+      if (!reader.wait())
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "error in copying array values to IDL.");
+         bSuccess = false;
          break;
-      case IDL_TYP_FLOAT :
-         encoding = FLT4BYTES;
-         if (!newWindow && !overwrite)
+      }
+      unsigned char* pTile = pNext;
+      pNext = NULL;
+
+      //read the next tile while IDL works on this one
+      if (tile + 1 < tiles.size())
+      {
+         pNext = reinterpret_cast<unsigned char*>(malloc(static_cast<size_t>(tiles[tile + 1].getRowCount()) *
+            tiles[tile + 1].getColumnCount() * bands * bytesPerElement));
+         if (pNext == NULL)
          {
-            IdlFunctions::addMatrixToCurrentView(reinterpret_cast<float*>(pRawData), newDataName,
-               width, height, bands, unitName, encoding, inMemory, iType, datasetName);
-            bSuccess = true;
+            free(pTile);
+            IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Not enough memory to allocate array");
+            bSuccess = false;
+            break;
          }
+         reader.start(pNext, pSource, tiles[tile + 1], threadCount);
+      }
+
+      //IDL frees the tile when the variable is reassigned
+      const IdlFunctions::Subcube& current = tiles[tile];
+      IDL_MEMINT dims[] = {0, 0, 0};
+      int dimensions = 0;
+      getIdlDimensions(interleave, current.getRowCount(), current.getColumnCount(), bands, dims, dimensions);
+      if (IDL_ImportNamedArray(spInputName, dimensions, dims, type, pTile, reinterpret_cast<IDL_ARRAY_FREE_CB>(free),
+         NULL) == NULL)
+      {
+         free(pTile);
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "OPTICKS_TILE_MAP error.  The tile could not be passed to IDL.");
+         bSuccess = false;
+         break;
+      }
+      if (IDL_ExecuteStr(const_cast<char*>(command.c_str())) != 0)
+      {
+         bSuccess = false;
+         break;
+      }
+
+      IDL_VPTR pOutput = IDL_GetVarAddr(spOutputName);
+      unsigned int outputBands = 0;
+      if (pOutput == NULL || (pOutput->flags & IDL_V_ARR) == 0 || !hasTileDimensions(pOutput->value.arr, interleave,
+         current.getRowCount(), current.getColumnCount(), outputBands))
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "OPTICKS_TILE_MAP error.  The function must return an array with "
+            "the same number of rows and columns as the tile, in the same interleave.");
+         bSuccess = false;
          break;
-      case IDL_TYP_DOUBLE :
-         encoding = FLT8BYTES;
-         if (!newWindow && !overwrite)
+      }
+      if (pResult == NULL)
+      {
+         EncodingType encoding;
+         if (!getEncoding(pOutput->type, encoding))
          {
-            IdlFunctions::addMatrixToCurrentView(reinterpret_cast<double*>(pRawData), newDataName,
-               width, height, bands, unitName, encoding, inMemory, iType, datasetName);
-            bSuccess = true;
+            IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "unable to determine type.");
+            bSuccess = false;
+            break;
          }
-         break;
-      case IDL_TYP_COMPLEX:
-         encoding = FLT8COMPLEX;
-         if (!newWindow && !overwrite)
+         resultType = pOutput->type;
+         resultBands = outputBands;
+         pResult = RasterUtilities::createRasterElement(newDataName, rows, columns, resultBands, encoding,
+            interleave, inMemory, pSource);
+         if (pResult == NULL)
          {
-            IdlFunctions::addMatrixToCurrentView(reinterpret_cast<FloatComplex*>(pRawData), newDataName,
-               width, height, bands, unitName, encoding, inMemory, iType, datasetName);
-            bSuccess = true;
+            IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Could not create new RasterElement, may already exist.");
+            bSuccess = false;
+            break;
          }
+      }
+      else if (pOutput->type != resultType || outputBands != resultBands)
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "OPTICKS_TILE_MAP error.  Every tile must return the same "
+            "type and number of bands.");
+         bSuccess = false;
          break;
-      case IDL_TYP_UNDEF :
-         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "unable to determine type.");
+      }
+
+      IdlFunctions::Subcube target = current;
+      target.mBandEnd = resultBands - 1;
+      if (!IdlFunctions::writeSubcube(pResult, reinterpret_cast<const char*>(pOutput->value.arr->data), target,
+         threadCount))
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "error in copying array values to Opticks.");
+         bSuccess = false;
          break;
+      }
+      if (spProgress != NULL)
+      {
+         spProgress->updateProgress("Processing tiles", static_cast<int>(100 * (tile + 1) / tiles.size()), NORMAL);
+      }
    }
-   if (newWindow != 0)
+   reader.wait();
+   free(pNext);
+
+   //release the last tile and result
+   IDL_ExecuteStr(const_cast<char*>((std::string(spInputName) + " = 0").c_str()));
+   IDL_ExecuteStr(const_cast<char*>((std::string(spOutputName) + " = 0").c_str()));
+
+   if (!bSuccess)
    {
-      //user wants to create a new RasterElement and window
-      RasterElement* pRaster = IdlFunctions::createRasterElement(pRawData, datasetName,
-         newDataName, encoding, inMemory, iType, unitName, height, width, bands);
-      if (pRaster != NULL)
+      if (pResult != NULL)
       {
-         //----- Now create the spatial data window to display the data
-         SpatialDataWindow* pWindow = static_cast<SpatialDataWindow*>(
-            Service<DesktopServices>()->createWindow(newDataName, SPATIAL_DATA_WINDOW));
+         Service<ModelServices>()->destroyElement(pResult);
+      }
+      return IDL_StrToSTRING("failure");
+   }
+   pResult->updateData();
+
+   //show the results with the source data if it is in the active window
+   SpatialDataWindow* pWindow = dynamic_cast<SpatialDataWindow*>(
+      Service<DesktopServices>()->getCurrentWorkspaceWindow());
+   SpatialDataView* pView = (pWindow == NULL) ? NULL : pWindow->getSpatialDataView();
+   LayerList* pList = (pView == NULL) ? NULL : pView->getLayerList();
+   if (pList != NULL && pList->getPrimaryRasterElement() == pSource)
+   {
+      UndoLock undo(pView);
+      pView->createLayer(RASTER, pResult, newDataName);
+   }
+   return IDL_StrToSTRING("success");
+}
+
+/**
+ * Return details about Opticks raster data.  This is very useful to determine the amount
+ * and layout of the data that is returned from array_to_idl() without having to copy the
+ * data into IDL.
+ *
+ * @param[in] DATASET @opt
+ *            The name of the raster element to get. Defaults to
+ *            the primary raster element of the active window.
+ * @param[out] BANDS_OUT @opt
+ *             Returns the number of active bands.
+ * @param[out] HEIGHT_OUT @opt
+ *             Returns the number of active rows.
+ * @param[out] WIDTH_OUT @opt
+ *             Returns the number of active columns.
+ * @param[out] INTERLEAVE_OUT @opt
+ *             Returns "BIP", "BSQ" or "BIL".  See the following table for the dimension
+ *             arrangement of the IDL array that will be returned when array_to_idl() is
+ *             called for the same \p DATASET without the \p INTERLEAVE keyword.
+ *                - BIP - BANDS_OUT, WIDTH_OUT, HEIGHT_OUT
+ *                - BSQ - WIDTH_OUT, HEIGHT_OUT, BANDS_OUT
+ *                - BIL - WIDTH_OUT, BANDS_OUT, HEIGHT_OUT
+ * @param[out] BPE_OUT @opt
+ *             Returns number of bytes required to store a single value in the IDL array
+ *             that will be returned when array_to_idl() is called for the same \p DATASET.
+ * @rsof
+ * @usage
+ * print,opticks_array_dimensions(BANDS_OUT=num_bands, HEIGHT_OUT=num_rows, WIDTH_OUT=num_columns)
+ * print,num_bands
+ * print,num_rows
+ * print,num_columns
+ * @endusage
+ */
+IDL_VPTR opticks_array_dimensions(int argc, IDL_VPTR pArgv[], char* pArgk)
+{
+   typedef struct
+   {
+      IDL_KW_RESULT_FIRST_FIELD;
+      int datasetExists;
+      IDL_STRING datasetName;
+      int heightExists;
+      IDL_VPTR height;
+      int widthExists;
+      IDL_VPTR width;
+      int bandsExists;
+      IDL_VPTR bands;
+      int interleaveExists;
+      IDL_VPTR interleave;
+      int bpeExists;
+      IDL_VPTR bpe;
+   } KW_RESULT;
+
+   //IDL_KW_FAST_SCAN is the type of scan we are using, following it is the
+   //name of the keyword, followed by the type, the mask(which should be 1),
+   //flags, a boolean whether the value was populated and finally the value itself
+   static IDL_KW_PAR kw_pars[] = {
+      IDL_KW_FAST_SCAN,
+      {"BANDS_OUT", IDL_TYP_UNDEF, 1, IDL_KW_OUT, reinterpret_cast<int*>(IDL_KW_OFFSETOF(bandsExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(bands))},
+      {"BPE_OUT", IDL_TYP_UNDEF, 1, IDL_KW_OUT, reinterpret_cast<int*>(IDL_KW_OFFSETOF(bpeExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(bpe))},
+      {"DATASET", IDL_TYP_STRING, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(datasetExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(datasetName))},
+      {"HEIGHT_OUT", IDL_TYP_UNDEF, 1, IDL_KW_OUT, reinterpret_cast<int*>(IDL_KW_OFFSETOF(heightExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(height))},
+      {"INTERLEAVE_OUT", IDL_TYP_UNDEF, 1, IDL_KW_OUT, reinterpret_cast<int*>(IDL_KW_OFFSETOF(interleaveExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(interleave))},
+      {"WIDTH_OUT", IDL_TYP_UNDEF, 1, IDL_KW_OUT, reinterpret_cast<int*>(IDL_KW_OFFSETOF(widthExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(width))},
+      {NULL}
+   };
+
+   IdlFunctions::IdlKwResource<KW_RESULT> kw(argc, pArgv, pArgk, kw_pars, 0, 1);
+
+   std::string filename;
+   if (kw->datasetExists)
+   {
+      filename = IDL_STRING_STR(&kw->datasetName);
+   }
+   RasterElement* pData = dynamic_cast<RasterElement*>(IdlFunctions::getDataset(filename));
+   if (pData == NULL)
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Error could not find array.");
+      return IDL_StrToSTRING("failure");
+   }
+   RasterDataDescriptor* pDesc = dynamic_cast<RasterDataDescriptor*>(pData->getDataDescriptor());
+   if (pDesc == NULL)
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Error could not find array.");
+      return IDL_StrToSTRING("failure");
+   }
+
+   if (kw->widthExists)
+   {
+      unsigned int column = pDesc->getColumnCount();
+      IDL_ALLTYPES tempVal;
+      tempVal.ul = column;
+      IDL_StoreScalar(kw->width, IDL_TYP_ULONG, &tempVal);
+   }
+   if (kw->heightExists)
+   {
+      unsigned int row = pDesc->getRowCount();
+      IDL_ALLTYPES tempVal;
+      tempVal.ul = row;
+      IDL_StoreScalar(kw->height, IDL_TYP_ULONG, &tempVal);
+   }
+   if (kw->bandsExists)
+   {
+      unsigned int band = pDesc->getBandCount();
+      IDL_ALLTYPES tempVal;
+      tempVal.ul = band;
+      IDL_StoreScalar(kw->bands, IDL_TYP_ULONG, &tempVal);
+   }
+   if (kw->interleaveExists)
+   {
+      InterleaveFormatType iType = pDesc->getInterleaveFormat();
+      bool error = false;
+      std::string value = StringUtilities::toXmlString(iType, &error);
+      if (error)
+      {
+         const char* pMsg = "Array has an invalid interleave type. This is a bug in the application, not IDL.";
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, pMsg);
+         return IDL_StrToSTRING("failure");
+      }
+      IDL_ALLTYPES tempVal;
+      IDL_StrStore(&(tempVal.str), const_cast<char*>(value.c_str()));
+      IDL_StoreScalar(kw->interleave, IDL_TYP_STRING, &tempVal);
+   }
+   if (kw->bpeExists)
+   {
+      EncodingType encoding = pDesc->getDataType();
+      unsigned char type = IDL_TYP_UNDEF;
+
+      //set the datatype based on the encoding
+      switch (encoding)
+      {
+         case INT1SBYTE:
+            type = IDL_TYP_BYTE;
+            break;
+         case INT1UBYTE:
+            type = IDL_TYP_BYTE;
+            break;
+         case INT2SBYTES:
+            type = IDL_TYP_INT;
+            break;
+         case INT2UBYTES:
+            type = IDL_TYP_UINT;
+            break;
+         case INT4SCOMPLEX:
+            type = IDL_TYP_UNDEF;
+            break;
+         case INT4SBYTES:
+            type = IDL_TYP_LONG;
+            break;
+         case INT4UBYTES:
+            type = IDL_TYP_ULONG;
+            break;
+         case FLT4BYTES:
+            type = IDL_TYP_FLOAT;
+            break;
+         case FLT8COMPLEX:
+            type = IDL_TYP_COMPLEX;
+            break;
+         case FLT8BYTES:
+            type = IDL_TYP_DOUBLE;
+            break;
+         default:
+            type = IDL_TYP_UNDEF;
+            break;
+      }
+      IDL_ALLTYPES temp;
+      temp.l = IDL_TypeSizeFunc(type);
+      IDL_StoreScalar(kw->bpe, IDL_TYP_LONG, &temp);
+   }
+   return IDL_StrToSTRING("success");
+}
+
+/**
+ * Return details about the on-disk row numbers for an Opticks raster data.
+ *
+ * This will return an IDL array, where the value for each item in the
+ * array is the on-disk row number for that given loaded row.  This functionality
+ * is provided because some Opticks wizard items require the on-disk number
+ * in order to function properly.  The Opticks IDL API does not require this
+ * number to function properly.
+ *
+ * @param[in] DATASET @opt
+ *            The name of the raster element to get. Defaults to
+ *            the primary raster element of the active window.
+ * @return An IDL array containing the on-disk row numbers.  If the \b DATASET could not
+ *         found, then the IDL string of "failure" will be returned.
+ * @usage 
+ * print,opticks_array_dimensions(HEIGHT_OUT=num_rows)
+ * print,num_rows
+ * row_list = opticks_array_ondisk_rows()
+ * ; n_elements(row_list) would be equal to num_rows
+ * ; row_list[0] would return the on-disk number of the first row
+ * @endusage
+ */
+IDL_VPTR opticks_array_ondisk_rows(int argc, IDL_VPTR pArgv[], char* pArgk)
+{
+   if (argc<0)
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "OPTICKS_ARRAY_ONDISK_ROWS takes a 'dataset' name as a keyword.");
+   }
+   typedef struct
+   {
+      IDL_KW_RESULT_FIRST_FIELD;
+      int datasetExists;
+      IDL_STRING datasetName;
+   } KW_RESULT;
+
+   //IDL_KW_FAST_SCAN is the type of scan we are using, following it is the
+   //name of the keyword, followed by the type, the mask(which should be 1),
+   //flags, a boolean whether the value was populated and finally the value itself
+   static IDL_KW_PAR kw_pars[] = {
+      IDL_KW_FAST_SCAN,
+      {"DATASET", IDL_TYP_STRING, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(datasetExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(datasetName))},
+      {NULL}
+   };
+
+   IdlFunctions::IdlKwResource<KW_RESULT> kw(argc, pArgv, pArgk, kw_pars, 0, 1);
+
+   std::string filename;
+   if (kw->datasetExists)
+   {
+      filename = IDL_STRING_STR(&kw->datasetName);
+   }
+   RasterElement* pData = dynamic_cast<RasterElement*>(IdlFunctions::getDataset(filename));
+
+   if (pData == NULL)
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Error could not find array.");
+      return IDL_StrToSTRING("failure");
+   }
+
+   RasterDataDescriptor* pDesc = dynamic_cast<RasterDataDescriptor*>(pData->getDataDescriptor());
+   if (pDesc == NULL)
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Error could not find array.");
+      return IDL_StrToSTRING("failure");
+   }
+
+   const std::vector<DimensionDescriptor>& rows = pDesc->getRows();
+   if (rows.empty())
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Error could not find array.");
+      return IDL_StrToSTRING("failure");
+   }
+   UCHAR* pCopyvec = reinterpret_cast<UCHAR*>(malloc(rows.size() * sizeof(unsigned int)));
+   VERIFYRV(pCopyvec, NULL);
+   unsigned int* pTempPtr = reinterpret_cast<unsigned int*>(pCopyvec);
+   for (std::vector<DimensionDescriptor>::const_iterator rowIter = rows.begin();
+        rowIter != rows.end();
+        ++rowIter, ++pTempPtr)
+   {
+      *pTempPtr = rowIter->getOnDiskNumber();
+   }
+   IDL_MEMINT pDims[] = {static_cast<IDL_MEMINT>(rows.size())};
+   return IDL_ImportArray(1, pDims, IDL_TYP_ULONG, pCopyvec,
+      reinterpret_cast<IDL_ARRAY_FREE_CB>(free), NULL);
+}
+
+/**
+ * Return details about the on-disk column numbers for an Opticks raster data.
+ *
+ * This will return an IDL array, where the value for each item in the
+ * array is the on-disk column number for that given loaded column.  This functionality
+ * is provided because some Opticks wizard items require the on-disk number
+ * in order to function properly.  The Opticks IDL API does not require this
+ * number to function properly.
+ *
+ * @param[in] DATASET @opt
+ *            The name of the raster element to get. Defaults to
+ *            the primary raster element of the active window.
+ * @return An IDL array containing the on-disk column numbers.  If the \b DATASET could not
+ *         found, then the IDL string of "failure" will be returned.
+ * @usage 
+ * print,opticks_array_dimensions(WIDTH_OUT=num_columns)
+ * print,num_columns
+ * col_list = opticks_array_ondisk_columns()
+ * ; n_elements(col_list) would be equal to num_columns
+ * ; col_list[0] would return the on-disk number of the first column
+ * @endusage
+ */
+IDL_VPTR opticks_array_ondisk_columns(int argc, IDL_VPTR pArgv[], char* pArgk)
+{
+   if (argc<0)
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "OPTICKS_ARRAY_ONDISK_COLUMNS takes a 'dataset' name as a keyword.");
+   }
+   typedef struct
+   {
+      IDL_KW_RESULT_FIRST_FIELD;
+      int datasetExists;
+      IDL_STRING datasetName;
+   } KW_RESULT;
+
+   //IDL_KW_FAST_SCAN is the type of scan we are using, following it is the
+   //name of the keyword, followed by the type, the mask(which should be 1),
+   //flags, a boolean whether the value was populated and finally the value itself
+   static IDL_KW_PAR kw_pars[] = {
+      IDL_KW_FAST_SCAN,
+      {"DATASET", IDL_TYP_STRING, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(datasetExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(datasetName))},
+      {NULL}
+   };
 
-         if (pWindow != NULL)
-         {
-            SpatialDataView* pView = pWindow->getSpatialDataView();
+   IdlFunctions::IdlKwResource<KW_RESULT> kw(argc, pArgv, pArgk, kw_pars, 0, 1);
 
-            if (pView != NULL)
-            {
-               UndoLock undo(pView);
-               //----- Set the spatial data in the view
-               pView->setPrimaryRasterElement(pRaster);
-               //----- Create the cube layer
-               RasterLayer* pLayer = static_cast<RasterLayer*>(pView->createLayer(RASTER, pRaster));
-               bSuccess = true;
-            }
-         }
-      }
-   }
-   else if (overwrite != 0)
+   std::string filename;
+   if (kw->datasetExists)
    {
-      //the user wants to replace the spectral cube of the RasterElement with all new data
-      RasterElement* pParent = dynamic_cast<RasterElement*>(IdlFunctions::getDataset(datasetName));
-      RasterElement* pRaster = static_cast<RasterElement*>(Service<ModelServices>()->getElement(newDataName,
-         TypeConverter::toString<RasterElement>(), pParent));
-      if (pRaster == NULL)
-      {
-         pRaster = pParent;
-      }
-      if (pRaster != NULL)
-      {
-         RasterDataDescriptor* pDesc = dynamic_cast<RasterDataDescriptor*>(pRaster->getDataDescriptor());
-         if (pDesc != NULL)
-         {
-            unsigned int heightStart = 0;
-            unsigned int widthStart= 0;
-            unsigned int bandStart= 0;
-            if (kw->startyheightExists)
-            {
-               heightStart = kw->startyheight;
-            }
-            if (kw->startxwidthExists)
-            {
-               widthStart = kw->startxwidth;
-            }
-            if (kw->bandstartExists)
-            {
-               bandStart = kw->bandstart;
-            }
-            EncodingType oldType = pDesc->getDataType();
-            if (oldType != encoding)
-            {
-               IDL_Message(IDL_M_GENERIC, IDL_MSG_RET,
-                  "ARRAY_TO_OPTICKS error.  data type of new array is not the same as the old.");
-               return IDL_StrToSTRING("failure");
-            }
-            bSuccess = IdlFunctions::changeRasterElement(pRaster, pRawData, encoding, iType, heightStart,
-               height, widthStart, width, bandStart, bands, oldType);
-         }
-      }
+      filename = IDL_STRING_STR(&kw->datasetName);
    }
-   if (bSuccess)
+   RasterElement* pData = dynamic_cast<RasterElement*>(IdlFunctions::getDataset(filename));
+
+   if (pData == NULL)
    {
-      idlPtr = IDL_StrToSTRING("success");
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Error could not find array.");
+      return IDL_StrToSTRING("failure");
    }
-   else
+
+   RasterDataDescriptor* pDesc = dynamic_cast<RasterDataDescriptor*>(pData->getDataDescriptor());
+   if (pDesc == NULL)
    {
-      idlPtr = IDL_StrToSTRING("failure");
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Error could not find array.");
+      return IDL_StrToSTRING("failure");
    }
 
-   return idlPtr;
+   const std::vector<DimensionDescriptor>& columns = pDesc->getColumns();
+   if (columns.empty())
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Error could not find array.");
+      return IDL_StrToSTRING("failure");
+   }
+   UCHAR* pCopyvec = reinterpret_cast<UCHAR*>(malloc(columns.size() * sizeof(unsigned int)));
+   VERIFYRV(pCopyvec, NULL);
+   unsigned int* pTempPtr = reinterpret_cast<unsigned int*>(pCopyvec);
+   for (std::vector<DimensionDescriptor>::const_iterator colIter = columns.begin();
+        colIter != columns.end();
+        ++colIter, ++pTempPtr)
+   {
+      *pTempPtr = colIter->getOnDiskNumber();
+   }
+   IDL_MEMINT pDims[] = {static_cast<IDL_MEMINT>(columns.size())};
+   return IDL_ImportArray(1, pDims, IDL_TYP_ULONG, pCopyvec,
+      reinterpret_cast<IDL_ARRAY_FREE_CB>(free), NULL);
 }
 
 /**
- * Return details about Opticks raster data.  This is very useful to determine the amount
- * and layout of the data that is returned from array_to_idl() without having to copy the
- * data into IDL.
+ * Return details about the on-disk band numbers for an Opticks raster data.
+ *
+ * This will return an IDL array, where the value for each item in the
+ * array is the on-disk band number for that given loaded band.  This functionality
+ * is provided because some Opticks wizard items require the on-disk number
+ * in order to function properly.  The Opticks IDL API does not require this
+ * number to function properly.
  *
  * @param[in] DATASET @opt
  *            The name of the raster element to get. Defaults to
  *            the primary raster element of the active window.
- * @param[out] BANDS_OUT @opt
- *             Returns the number of active bands.
- * @param[out] HEIGHT_OUT @opt
- *             Returns the number of active rows.
- * @param[out] WIDTH_OUT @opt
- *             Returns the number of active columns.
- * @param[out] INTERLEAVE_OUT @opt
- *             Returns "BIP", "BSQ" or "BIL".  See the following table for the dimension
- *             arrangement of the IDL array that will be returned when array_to_idl() is
- *             called for the same \p DATASET.
- *                - BIP - BANDS_OUT, WIDTH_OUT, HEIGHT_OUT
- *                - BSQ - WIDTH_OUT, HEIGHT_OUT, BANDS_OUT
- *                - BIL - WIDTH_OUT, BANDS_OUT, HEIGHT_OUT
- * @param[out] BPE_OUT @opt
- *             Returns number of bytes required to store a single value in the IDL array
- *             that will be returned when array_to_idl() is called for the same \p DATASET.
- * @rsof
- * @usage
- * print,opticks_array_dimensions(BANDS_OUT=num_bands, HEIGHT_OUT=num_rows, WIDTH_OUT=num_columns)
+ * @return An IDL array containing the on-disk band numbers.  If the \b DATASET could not
+ *         found, then the IDL string of "failure" will be returned.
+ * @usage 
+ * print,opticks_array_dimensions(BANDS_OUT=num_bands)
  * print,num_bands
- * print,num_rows
- * print,num_columns
+ * band_list = opticks_array_ondisk_bands()
+ * ; n_elements(band_list) would be equal to num_bands
+ * ; band_list[0] would return the on-disk number of the first band
  * @endusage
  */
-IDL_VPTR opticks_array_dimensions(int argc, IDL_VPTR pArgv[], char* pArgk)
+IDL_VPTR opticks_array_ondisk_bands(int argc, IDL_VPTR pArgv[], char* pArgk)
 {
+   if (argc<0)
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "OPTICKS_ARRAY_ONDISK_BANDS takes a 'dataset' name as a keyword.");
+   }
    typedef struct
    {
       IDL_KW_RESULT_FIRST_FIELD;
       int datasetExists;
       IDL_STRING datasetName;
-      int heightExists;
-      IDL_VPTR height;
-      int widthExists;
-      IDL_VPTR width;
-      int bandsExists;
-      IDL_VPTR bands;
-      int interleaveExists;
-      IDL_VPTR interleave;
-      int bpeExists;
-      IDL_VPTR bpe;
    } KW_RESULT;
 
    //IDL_KW_FAST_SCAN is the type of scan we are using, following it is the
@@ -752,18 +2919,8 @@ IDL_VPTR opticks_array_dimensions(int argc, IDL_VPTR pArgv[], char* pArgk)
    //flags, a boolean whether the value was populated and finally the value itself
    static IDL_KW_PAR kw_pars[] = {
       IDL_KW_FAST_SCAN,
-      {"BANDS_OUT", IDL_TYP_UNDEF, 1, IDL_KW_OUT, reinterpret_cast<int*>(IDL_KW_OFFSETOF(bandsExists)),
-         reinterpret_cast<char*>(IDL_KW_OFFSETOF(bands))},
-      {"BPE_OUT", IDL_TYP_UNDEF, 1, IDL_KW_OUT, reinterpret_cast<int*>(IDL_KW_OFFSETOF(bpeExists)),
-         reinterpret_cast<char*>(IDL_KW_OFFSETOF(bpe))},
       {"DATASET", IDL_TYP_STRING, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(datasetExists)),
          reinterpret_cast<char*>(IDL_KW_OFFSETOF(datasetName))},
-      {"HEIGHT_OUT", IDL_TYP_UNDEF, 1, IDL_KW_OUT, reinterpret_cast<int*>(IDL_KW_OFFSETOF(heightExists)),
-         reinterpret_cast<char*>(IDL_KW_OFFSETOF(height))},
-      {"INTERLEAVE_OUT", IDL_TYP_UNDEF, 1, IDL_KW_OUT, reinterpret_cast<int*>(IDL_KW_OFFSETOF(interleaveExists)),
-         reinterpret_cast<char*>(IDL_KW_OFFSETOF(interleave))},
-      {"WIDTH_OUT", IDL_TYP_UNDEF, 1, IDL_KW_OUT, reinterpret_cast<int*>(IDL_KW_OFFSETOF(widthExists)),
-         reinterpret_cast<char*>(IDL_KW_OFFSETOF(width))},
       {NULL}
    };
 
@@ -775,11 +2932,13 @@ IDL_VPTR opticks_array_dimensions(int argc, IDL_VPTR pArgv[], char* pArgk)
       filename = IDL_STRING_STR(&kw->datasetName);
    }
    RasterElement* pData = dynamic_cast<RasterElement*>(IdlFunctions::getDataset(filename));
+
    if (pData == NULL)
    {
       IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Error could not find array.");
       return IDL_StrToSTRING("failure");
    }
+
    RasterDataDescriptor* pDesc = dynamic_cast<RasterDataDescriptor*>(pData->getDataDescriptor());
    if (pDesc == NULL)
    {
@@ -787,118 +2946,53 @@ IDL_VPTR opticks_array_dimensions(int argc, IDL_VPTR pArgv[], char* pArgk)
       return IDL_StrToSTRING("failure");
    }
 
-   if (kw->widthExists)
-   {
-      unsigned int column = pDesc->getColumnCount();
-      IDL_ALLTYPES tempVal;
-      tempVal.ul = column;
-      IDL_StoreScalar(kw->width, IDL_TYP_ULONG, &tempVal);
-   }
-   if (kw->heightExists)
-   {
-      unsigned int row = pDesc->getRowCount();
-      IDL_ALLTYPES tempVal;
-      tempVal.ul = row;
-      IDL_StoreScalar(kw->height, IDL_TYP_ULONG, &tempVal);
-   }
-   if (kw->bandsExists)
-   {
-      unsigned int band = pDesc->getBandCount();
-      IDL_ALLTYPES tempVal;
-      tempVal.ul = band;
-      IDL_StoreScalar(kw->bands, IDL_TYP_ULONG, &tempVal);
-   }
-   if (kw->interleaveExists)
+   const std::vector<DimensionDescriptor>& bands = pDesc->getBands();
+   if (bands.empty())
    {
-      InterleaveFormatType iType = pDesc->getInterleaveFormat();
-      bool error = false;
-      std::string value = StringUtilities::toXmlString(iType, &error);
-      if (error)
-      {
-         const char* pMsg = "Array has an invalid interleave type. This is a bug in the application, not IDL.";
-         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, pMsg);
-         return IDL_StrToSTRING("failure");
-      }
-      IDL_ALLTYPES tempVal;
-      IDL_StrStore(&(tempVal.str), const_cast<char*>(value.c_str()));
-      IDL_StoreScalar(kw->interleave, IDL_TYP_STRING, &tempVal);
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Error could not find array.");
+      return IDL_StrToSTRING("failure");
    }
-   if (kw->bpeExists)
+   UCHAR* pCopyvec = reinterpret_cast<UCHAR*>(malloc(bands.size() * sizeof(unsigned int)));
+   VERIFYRV(pCopyvec, NULL);
+   unsigned int* pTempPtr = reinterpret_cast<unsigned int*>(pCopyvec);
+   for (std::vector<DimensionDescriptor>::const_iterator bandIter = bands.begin();
+        bandIter != bands.end();
+        ++bandIter, ++pTempPtr)
    {
-      EncodingType encoding = pDesc->getDataType();
-      unsigned char type = IDL_TYP_UNDEF;
-
-      //set the datatype based on the encoding
-      switch (encoding)
-      {
-         case INT1SBYTE:
-            type = IDL_TYP_BYTE;
-            break;
-         case INT1UBYTE:
-            type = IDL_TYP_BYTE;
-            break;
-         case INT2SBYTES:
-            type = IDL_TYP_INT;
-            break;
-         case INT2UBYTES:
-            type = IDL_TYP_UINT;
-            break;
-         case INT4SCOMPLEX:
-            type = IDL_TYP_UNDEF;
-            break;
-         case INT4SBYTES:
-            type = IDL_TYP_LONG;
-            break;
-         case INT4UBYTES:
-            type = IDL_TYP_ULONG;
-            break;
-         case FLT4BYTES:
-            type = IDL_TYP_FLOAT;
-            break;
-         case FLT8COMPLEX:
-            type = IDL_TYP_COMPLEX;
-            break;
-         case FLT8BYTES:
-            type = IDL_TYP_DOUBLE;
-            break;
-         default:
-            type = IDL_TYP_UNDEF;
-            break;
-      }
-      IDL_ALLTYPES temp;
-      temp.l = IDL_TypeSizeFunc(type);
-      IDL_StoreScalar(kw->bpe, IDL_TYP_LONG, &temp);
+      *pTempPtr = bandIter->getOnDiskNumber();
    }
-   return IDL_StrToSTRING("success");
+   IDL_MEMINT pDims[] = {static_cast<IDL_MEMINT>(bands.size())};
+   return IDL_ImportArray(1, pDims, IDL_TYP_ULONG, pCopyvec,
+      reinterpret_cast<IDL_ARRAY_FREE_CB>(free), NULL);
 }
 
 /**
- * Return details about the on-disk row numbers for an Opticks raster data.
+ * Return details about the original row numbers for an Opticks raster data.
  *
  * This will return an IDL array, where the value for each item in the
- * array is the on-disk row number for that given loaded row.  This functionality
- * is provided because some Opticks wizard items require the on-disk number
+ * array is the original row number for that given loaded row.  This functionality
+ * is provided because some Opticks wizard items require the original number
  * in order to function properly.  The Opticks IDL API does not require this
  * number to function properly.
  *
  * @param[in] DATASET @opt
  *            The name of the raster element to get. Defaults to
  *            the primary raster element of the active window.
- * @return An IDL array containing the on-disk row numbers.  If the \b DATASET could not
+ * @return An IDL array containing the original row numbers.  If the \b DATASET could not
  *         found, then the IDL string of "failure" will be returned.
  * @usage 
  * print,opticks_array_dimensions(HEIGHT_OUT=num_rows)
  * print,num_rows
- * row_list = opticks_array_ondisk_rows()
+ * row_list = opticks_array_original_rows()
  * ; n_elements(row_list) would be equal to num_rows
- * ; row_list[0] would return the on-disk number of the first row
+ * ; row_list[0] would return the original number of the first row
  * @endusage
  */
-IDL_VPTR opticks_array_ondisk_rows(int argc, IDL_VPTR pArgv[], char* pArgk)
+IDL_VPTR opticks_array_original_rows(int argc, IDL_VPTR pArgv[], char* pArgk)
 {
    if (argc<0)
    {
-      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "OPTICKS_ARRAY_ONDISK_ROWS takes a 'dataset' name as a keyword.");
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "OPTICKS_ARRAY_ORIGINAL_ROWS takes a 'dataset' name as a keyword.");
    }
    typedef struct
    {
@@ -952,40 +3046,40 @@ IDL_VPTR opticks_array_ondisk_rows(int argc, IDL_VPTR pArgv[], char* pArgk)
         rowIter != rows.end();
         ++rowIter, ++pTempPtr)
    {
-      *pTempPtr = rowIter->getOnDiskNumber();
+      *pTempPtr = rowIter->getOriginalNumber();
    }
-   IDL_MEMINT pDims[] = {rows.size()};
+   IDL_MEMINT pDims[] = {static_cast<IDL_MEMINT>(rows.size())};
    return IDL_ImportArray(1, pDims, IDL_TYP_ULONG, pCopyvec,
       reinterpret_cast<IDL_ARRAY_FREE_CB>(free), NULL);
 }
 
 /**
- * Return details about the on-disk column numbers for an Opticks raster data.
+ * Return details about the original column numbers for an Opticks raster data.
  *
  * This will return an IDL array, where the value for each item in the
- * array is the on-disk column number for that given loaded column.  This functionality
- * is provided because some Opticks wizard items require the on-disk number
+ * array is the original column number for that given loaded column.  This functionality
+ * is provided because some Opticks wizard items require the original number
  * in order to function properly.  The Opticks IDL API does not require this
  * number to function properly.
  *
  * @param[in] DATASET @opt
  *            The name of the raster element to get. Defaults to
  *            the primary raster element of the active window.
- * @return An IDL array containing the on-disk column numbers.  If the \b DATASET could not
+ * @return An IDL array containing the original column numbers.  If the \b DATASET could not
  *         found, then the IDL string of "failure" will be returned.
  * @usage 
  * print,opticks_array_dimensions(WIDTH_OUT=num_columns)
  * print,num_columns
- * col_list = opticks_array_ondisk_columns()
+ * col_list = opticks_array_original_columns()
  * ; n_elements(col_list) would be equal to num_columns
- * ; col_list[0] would return the on-disk number of the first column
+ * ; col_list[0] would return the original number of the first column
  * @endusage
  */
-IDL_VPTR opticks_array_ondisk_columns(int argc, IDL_VPTR pArgv[], char* pArgk)
+IDL_VPTR opticks_array_original_columns(int argc, IDL_VPTR pArgv[], char* pArgk)
 {
    if (argc<0)
    {
-      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "OPTICKS_ARRAY_ONDISK_COLUMNS takes a 'dataset' name as a keyword.");
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "OPTICKS_ARRAY_ORIGINAL_COLUMNS takes a 'dataset' name as a keyword.");
    }
    typedef struct
    {
@@ -1039,40 +3133,40 @@ IDL_VPTR opticks_array_ondisk_columns(int argc, IDL_VPTR pArgv[], char* pArgk)
         colIter != columns.end();
         ++colIter, ++pTempPtr)
    {
-      *pTempPtr = colIter->getOnDiskNumber();
+      *pTempPtr = colIter->getOriginalNumber();
    }
-   IDL_MEMINT pDims[] = {columns.size()};
+   IDL_MEMINT pDims[] = {static_cast<IDL_MEMINT>(columns.size())};
    return IDL_ImportArray(1, pDims, IDL_TYP_ULONG, pCopyvec,
       reinterpret_cast<IDL_ARRAY_FREE_CB>(free), NULL);
 }
 
 /**
- * Return details about the on-disk band numbers for an Opticks raster data.
+ * Return details about the original band numbers for an Opticks raster data.
  *
  * This will return an IDL array, where the value for each item in the
- * array is the on-disk band number for that given loaded band.  This functionality
- * is provided because some Opticks wizard items require the on-disk number
+ * array is the original band number for that given loaded band.  This functionality
+ * is provided because some Opticks wizard items require the original number
  * in order to function properly.  The Opticks IDL API does not require this
  * number to function properly.
  *
  * @param[in] DATASET @opt
  *            The name of the raster element to get. Defaults to
  *            the primary raster element of the active window.
- * @return An IDL array containing the on-disk band numbers.  If the \b DATASET could not
+ * @return An IDL array containing the original band numbers.  If the \b DATASET could not
  *         found, then the IDL string of "failure" will be returned.
  * @usage 
  * print,opticks_array_dimensions(BANDS_OUT=num_bands)
  * print,num_bands
- * band_list = opticks_array_ondisk_bands()
+ * band_list = opticks_array_original_bands()
  * ; n_elements(band_list) would be equal to num_bands
- * ; band_list[0] would return the on-disk number of the first band
+ * ; band_list[0] would return the original number of the first band
  * @endusage
  */
-IDL_VPTR opticks_array_ondisk_bands(int argc, IDL_VPTR pArgv[], char* pArgk)
+IDL_VPTR opticks_array_original_bands(int argc, IDL_VPTR pArgv[], char* pArgk)
 {
    if (argc<0)
    {
-      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "OPTICKS_ARRAY_ONDISK_BANDS takes a 'dataset' name as a keyword.");
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "OPTICKS_ARRAY_ORIGINAL_BANDS takes a 'dataset' name as a keyword.");
    }
    typedef struct
    {
@@ -1126,46 +3220,534 @@ IDL_VPTR opticks_array_ondisk_bands(int argc, IDL_VPTR pArgv[], char* pArgk)
         bandIter != bands.end();
         ++bandIter, ++pTempPtr)
    {
-      *pTempPtr = bandIter->getOnDiskNumber();
+      *pTempPtr = bandIter->getOriginalNumber();
    }
-   IDL_MEMINT pDims[] = {bands.size()};
+   IDL_MEMINT pDims[] = {static_cast<IDL_MEMINT>(bands.size())};
    return IDL_ImportArray(1, pDims, IDL_TYP_ULONG, pCopyvec,
       reinterpret_cast<IDL_ARRAY_FREE_CB>(free), NULL);
 }
 
 /**
- * Return details about the original row numbers for an Opticks raster data.
+ * Return the number of bytes of raster data which IDL arrays refer to directly.
  *
- * This will return an IDL array, where the value for each item in the
- * array is the original row number for that given loaded row.  This functionality
- * is provided because some Opticks wizard items require the original number
- * in order to function properly.  The Opticks IDL API does not require this
- * number to function properly.
+ * Arrays returned from array_to_idl() which refer to the data of a raster element
+ * instead of a copy are counted until the IDL variable is freed or reassigned.
  *
  * @param[in] DATASET @opt
- *            The name of the raster element to get. Defaults to
+ *            The name of the raster element to count. Defaults to all raster elements.
+ * @return The number of bytes as an unsigned 64-bit integer.
+ * @usage
+ * data = array_to_idl(DATASET="cube.ice.h5")
+ * print,opticks_exported_bytes(DATASET="cube.ice.h5")
+ * data = 0
+ * print,opticks_exported_bytes()
+ * @endusage
+ */
+IDL_VPTR opticks_exported_bytes(int argc, IDL_VPTR pArgv[], char* pArgk)
+{
+   typedef struct
+   {
+      IDL_KW_RESULT_FIRST_FIELD;
+      int datasetExists;
+      IDL_STRING datasetName;
+   } KW_RESULT;
+
+   //IDL_KW_FAST_SCAN is the type of scan we are using, following it is the
+   //name of the keyword, followed by the type, the mask(which should be 1),
+   //flags, a boolean whether the value was populated and finally the value itself
+   static IDL_KW_PAR kw_pars[] = {
+      IDL_KW_FAST_SCAN,
+      {"DATASET", IDL_TYP_STRING, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(datasetExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(datasetName))},
+      {NULL}
+   };
+
+   IdlFunctions::IdlKwResource<KW_RESULT> kw(argc, pArgv, pArgk, kw_pars, 0, 1);
+
+   uint64_t bytes = 0;
+   if (kw->datasetExists)
+   {
+      RasterElement* pData = dynamic_cast<RasterElement*>(
+         IdlFunctions::getDataset(IDL_STRING_STR(&kw->datasetName)));
+      if (pData == NULL)
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Error could not find array.");
+         return IDL_StrToSTRING("failure");
+      }
+      bytes = ExportRegistry::instance().getExportedBytes(pData);
+   }
+   else
+   {
+      bytes = ExportRegistry::instance().getExportedBytes();
+   }
+   IDL_VPTR idlPtr = IDL_Gettmp();
+   idlPtr->type = IDL_TYP_ULONG64;
+   idlPtr->value.ul64 = bytes;
+   return idlPtr;
+}
+
+/**
+ * Compute the statistics of each band of a raster element in Opticks.
+ *
+ * The data is not copied into IDL. Statistics which Opticks has already calculated
+ * at full resolution, with the same bad values and from the magnitude of complex
+ * values, are used instead of reading the band. The other bands are read once, on the
+ * number of threads set in the Opticks options. Bad values of the raster element
+ * are not included, and complex values use their magnitude.
+ *
+ * @param[in] DATASET @opt
+ *            The name of the raster element. Defaults to
  *            the primary raster element of the active window.
- * @return An IDL array containing the original row numbers.  If the \b DATASET could not
- *         found, then the IDL string of "failure" will be returned.
- * @usage 
- * print,opticks_array_dimensions(HEIGHT_OUT=num_rows)
- * print,num_rows
- * row_list = opticks_array_original_rows()
- * ; n_elements(row_list) would be equal to num_rows
- * ; row_list[0] would return the original number of the first row
+ * @param[in] HISTOGRAM @opt
+ *            If this flag is set, a histogram of each band between its minimum and maximum
+ *            is also returned. This reads the data once more, unless Opticks had already
+ *            calculated the statistics of every band.
+ * @param[in] BIN_COUNT @opt
+ *            The number of bins in each histogram. Defaults to 256.
+ * @param[in] RECALCULATE @opt
+ *            If this flag is set, the statistics of every band are computed even if Opticks
+ *            has already calculated them.
+ * @return A structure with the tags MIN, MAX, MEAN and STDDEV, each a DOUBLE array with
+ *         a value for each active band. STDDEV is the sample standard deviation, as from
+ *         STDDEV(). When \p HISTOGRAM is set, the tag HISTOGRAM holds a ULONG64 array of
+ *         bins by bands and BIN_CENTERS holds the center of each bin. If the statistics can't
+ *         be computed, the IDL string of "failure" is returned.
+ * @usage
+ * stats = opticks_band_stats(DATASET="cube.ice.h5")
+ * normalized = (array_to_idl(BANDS_START=7, BANDS_END=7) - stats.mean[7]) / stats.stddev[7]
+ * stats = opticks_band_stats(/HISTOGRAM, BIN_COUNT=100)
+ * plot, stats.bin_centers[*, 0], stats.histogram[*, 0]
+ * @endusage
+ */
+IDL_VPTR opticks_band_stats(int argc, IDL_VPTR pArgv[], char* pArgk)
+{
+   typedef struct
+   {
+      IDL_KW_RESULT_FIRST_FIELD;
+      int datasetExists;
+      IDL_STRING datasetName;
+      int histogramExists;
+      IDL_LONG histogram;
+      int binCountExists;
+      IDL_LONG binCount;
+      int recalculateExists;
+      IDL_LONG recalculate;
+   } KW_RESULT;
+
+   //IDL_KW_FAST_SCAN is the type of scan we are using, following it is the
+   //name of the keyword, followed by the type, the mask(which should be 1),
+   //flags, a boolean whether the value was populated and finally the value itself
+   static IDL_KW_PAR kw_pars[] = {
+      IDL_KW_FAST_SCAN,
+      {"BIN_COUNT", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(binCountExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(binCount))},
+      {"DATASET", IDL_TYP_STRING, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(datasetExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(datasetName))},
+      {"HISTOGRAM", IDL_TYP_LONG, 1, IDL_KW_ZERO, reinterpret_cast<int*>(IDL_KW_OFFSETOF(histogramExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(histogram))},
+      {"RECALCULATE", IDL_TYP_LONG, 1, IDL_KW_ZERO, reinterpret_cast<int*>(IDL_KW_OFFSETOF(recalculateExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(recalculate))},
+      {NULL}
+   };
+
+   IdlFunctions::IdlKwResource<KW_RESULT> kw(argc, pArgv, pArgk, kw_pars, 0, 1);
+
+   std::string filename;
+   if (kw->datasetExists)
+   {
+      filename = IDL_STRING_STR(&kw->datasetName);
+   }
+   RasterElement* pData = dynamic_cast<RasterElement*>(IdlFunctions::getDataset(filename));
+   const RasterDataDescriptor* pDesc = (pData == NULL) ? NULL :
+      dynamic_cast<const RasterDataDescriptor*>(pData->getDataDescriptor());
+   if (pDesc == NULL)
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Error could not find array.");
+      return IDL_StrToSTRING("failure");
+   }
+   const bool histogram = (kw->histogramExists && kw->histogram != 0);
+   const unsigned int binCount = kw->binCountExists ? static_cast<unsigned int>(std::max<IDL_LONG>(kw->binCount, 0)) :
+      256;
+   if (histogram && binCount == 0)
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "OPTICKS_BAND_STATS error.  BIN_COUNT must be at least 1.");
+      return IDL_StrToSTRING("failure");
+   }
+
+   //use the statistics Opticks has already calculated the same way
+   const unsigned int bands = pDesc->getBandCount();
+   std::vector<double> minimums(bands, 0.0);
+   std::vector<double> maximums(bands, 0.0);
+   std::vector<double> means(bands, 0.0);
+   std::vector<double> deviations(bands, 0.0);
+   std::vector<unsigned int> computeBands;
+   for (unsigned int band = 0; band < bands; ++band)
+   {
+      Statistics* pStatistics = (kw->recalculateExists && kw->recalculate != 0) ? NULL :
+         pData->getStatistics(pDesc->getActiveBand(band));
+      if (!getCalculatedStatistics(pStatistics, pDesc, minimums[band], maximums[band], means[band], deviations[band]))
+      {
+         computeBands.push_back(band);
+      }
+   }
+
+   const std::vector<int>& elementBadValues = pDesc->getBadValues();
+   const std::vector<double> badValues(elementBadValues.begin(), elementBadValues.end());
+   IdlFunctions::Subcube subcube;
+   subcube.mHeightEnd = pDesc->getRowCount() - 1;
+   subcube.mWidthEnd = pDesc->getColumnCount() - 1;
+   subcube.mBandEnd = bands - 1;
+   subcube.mConcurrentRows = IdlFunctions::getConcurrentRows();
+   if (!computeBands.empty())
+   {
+      IdlFunctions::Subcube computeSubcube = subcube;
+      computeSubcube.setBands(computeBands);
+      std::vector<BandMoments> moments;
+      bool success = false;
+      switchOnComplexEncoding(pDesc->getDataType(), computeBandMoments, NULL, pData, computeSubcube, badValues,
+         moments, success);
+      if (!success)
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "OPTICKS_BAND_STATS error.  The data could not be read.");
+         return IDL_StrToSTRING("failure");
+      }
+      for (size_t index = 0; index < computeBands.size(); ++index)
+      {
+         const unsigned int band = computeBands[index];
+         const BandMoments& bandMoments = moments[index];
+         const double nan = std::numeric_limits<double>::quiet_NaN();
+         minimums[band] = (bandMoments.mCount > 0) ? bandMoments.mMin : nan;
+         maximums[band] = (bandMoments.mCount > 0) ? bandMoments.mMax : nan;
+         means[band] = (bandMoments.mCount > 0) ? bandMoments.mMean : nan;
+         deviations[band] = (bandMoments.mCount > 1) ? sqrt(bandMoments.mM2 / (bandMoments.mCount - 1)) : 0.0;
+      }
+   }
+
+   std::vector<uint64_t> histograms;
+   if (histogram)
+   {
+      bool success = false;
+      switchOnComplexEncoding(pDesc->getDataType(), computeBandHistograms, NULL, pData, subcube, badValues,
+         minimums, maximums, binCount, histograms, success);
+      if (!success)
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "OPTICKS_BAND_STATS error.  The data could not be read.");
+         return IDL_StrToSTRING("failure");
+      }
+   }
+
+   IDL_MEMINT bandDims[] = {1, bands};
+   IDL_MEMINT histogramDims[] = {2, binCount, bands};
+   IDL_STRUCT_TAG_DEF tags[] = {
+      {const_cast<char*>("MIN"), bandDims, reinterpret_cast<void*>(static_cast<IDL_MEMINT>(IDL_TYP_DOUBLE)), 0},
+      {const_cast<char*>("MAX"), bandDims, reinterpret_cast<void*>(static_cast<IDL_MEMINT>(IDL_TYP_DOUBLE)), 0},
+      {const_cast<char*>("MEAN"), bandDims, reinterpret_cast<void*>(static_cast<IDL_MEMINT>(IDL_TYP_DOUBLE)), 0},
+      {const_cast<char*>("STDDEV"), bandDims, reinterpret_cast<void*>(static_cast<IDL_MEMINT>(IDL_TYP_DOUBLE)), 0},
+      {const_cast<char*>("HISTOGRAM"), histogramDims,
+         reinterpret_cast<void*>(static_cast<IDL_MEMINT>(IDL_TYP_ULONG64)), 0},
+      {const_cast<char*>("BIN_CENTERS"), histogramDims,
+         reinterpret_cast<void*>(static_cast<IDL_MEMINT>(IDL_TYP_DOUBLE)), 0},
+      {NULL}
+   };
+   if (!histogram)
+   {
+      tags[4].name = NULL;
+   }
+   IDL_StructDefPtr pDefinition = IDL_MakeStruct(NULL, tags);
+   IDL_VPTR pResult = NULL;
+   char* pStruct = IDL_MakeTempStructVector(pDefinition, 1, &pResult, IDL_TRUE);
+   std::copy(minimums.begin(), minimums.end(), reinterpret_cast<double*>(pStruct +
+      IDL_StructTagInfoByName(pDefinition, const_cast<char*>("MIN"), IDL_MSG_LONGJMP, NULL)));
+   std::copy(maximums.begin(), maximums.end(), reinterpret_cast<double*>(pStruct +
+      IDL_StructTagInfoByName(pDefinition, const_cast<char*>("MAX"), IDL_MSG_LONGJMP, NULL)));
+   std::copy(means.begin(), means.end(), reinterpret_cast<double*>(pStruct +
+      IDL_StructTagInfoByName(pDefinition, const_cast<char*>("MEAN"), IDL_MSG_LONGJMP, NULL)));
+   std::copy(deviations.begin(), deviations.end(), reinterpret_cast<double*>(pStruct +
+      IDL_StructTagInfoByName(pDefinition, const_cast<char*>("STDDEV"), IDL_MSG_LONGJMP, NULL)));
+   if (histogram)
+   {
+      std::copy(histograms.begin(), histograms.end(), reinterpret_cast<IDL_ULONG64*>(pStruct +
+         IDL_StructTagInfoByName(pDefinition, const_cast<char*>("HISTOGRAM"), IDL_MSG_LONGJMP, NULL)));
+      double* pCenters = reinterpret_cast<double*>(pStruct +
+         IDL_StructTagInfoByName(pDefinition, const_cast<char*>("BIN_CENTERS"), IDL_MSG_LONGJMP, NULL));
+      for (unsigned int band = 0; band < bands; ++band)
+      {
+         const double width = (maximums[band] - minimums[band]) / binCount;
+         for (unsigned int bin = 0; bin < binCount; ++bin)
+         {
+            *pCenters++ = minimums[band] + (bin + 0.5) * width;
+         }
+      }
+   }
+   return pResult;
+}
+
+/**
+ * Stack the same subcube of several raster elements into a single IDL array.
+ *
+ * The array is allocated once and the subcube of each raster element is copied
+ * directly into its slice, so the rasters do not need to be concatenated in IDL.
+ * When there are at least as many raster elements as threads set in the Opticks
+ * options, the raster elements are read in parallel. Otherwise each raster element
+ * is read on every thread in turn.
+ *
+ * @param[in] [1]
+ *            An array of the names of the raster elements, which must all hold the
+ *            requested subcube.
+ * @param[in] BANDS_START @opt
+ *            The starting band in active band numbers. Defaults to 0.
+ * @param[in] BANDS_END @opt
+ *            The end band in active band numbers. Defaults to the last band of the
+ *            first raster element.
+ * @param[in] HEIGHT_START @opt
+ *            The starting row in active row numbers. Defaults to 0.
+ * @param[in] HEIGHT_END @opt
+ *            The end row in active row numbers. Defaults to the last row of the
+ *            first raster element.
+ * @param[in] WIDTH_START @opt
+ *            The starting column in active column numbers. Defaults to 0.
+ * @param[in] WIDTH_END @opt
+ *            The end column in active column numbers. Defaults to the last column of
+ *            the first raster element.
+ * @param[in] TYPE @opt
+ *            The IDL type code of the returned array, as for array_to_idl(). Defaults to the
+ *            type of the raster elements, and must be given when their types differ.
+ * @return An array of columns by rows by raster elements when a single band is requested,
+ *         or of columns by rows by bands by raster elements otherwise. If the raster elements
+ *         can't be stacked, the IDL string of "failure" is returned.
+ * @usage
+ * series = opticks_stack_arrays(["jan.tif", "feb.tif", "mar.tif"], BANDS_START=3, BANDS_END=3)
+ * change = series[*, *, 2] - series[*, *, 0]
+ * @endusage
+ */
+IDL_VPTR opticks_stack_arrays(int argc, IDL_VPTR pArgv[], char* pArgk)
+{
+   typedef struct
+   {
+      IDL_KW_RESULT_FIRST_FIELD;
+      int bandstartExists;
+      IDL_LONG bandstart;
+      int bandendExists;
+      IDL_LONG bandend;
+      int startyheightExists;
+      IDL_LONG startyheight;
+      int endyheightExists;
+      IDL_LONG endyheight;
+      int startxwidthExists;
+      IDL_LONG startxwidth;
+      int endxwidthExists;
+      IDL_LONG endxwidth;
+      int typeExists;
+      IDL_LONG idlType;
+   } KW_RESULT;
+
+   //IDL_KW_FAST_SCAN is the type of scan we are using, following it is the
+   //name of the keyword, followed by the type, the mask(which should be 1),
+   //flags, a boolean whether the value was populated and finally the value itself
+   static IDL_KW_PAR kw_pars[] = {
+      IDL_KW_FAST_SCAN,
+      {"BANDS_END", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(bandendExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(bandend))},
+      {"BANDS_START", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(bandstartExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(bandstart))},
+      {"HEIGHT_END", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(endyheightExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(endyheight))},
+      {"HEIGHT_START", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(startyheightExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(startyheight))},
+      {"TYPE", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(typeExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(idlType))},
+      {"WIDTH_END", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(endxwidthExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(endxwidth))},
+      {"WIDTH_START", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(startxwidthExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(startxwidth))},
+      {NULL}
+   };
+
+   IDL_VPTR pNames[] = {NULL};
+   IdlFunctions::IdlKwResource<KW_RESULT> kw(argc, pArgv, pArgk, kw_pars, pNames, 1);
+   if (pNames[0] == NULL || pNames[0]->type != IDL_TYP_STRING)
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "OPTICKS_STACK_ARRAYS takes an array of raster element names.");
+      return IDL_StrToSTRING("failure");
+   }
+
+   IDL_MEMINT nameCount = 0;
+   char* pNameData = NULL;
+   IDL_VarGetData(pNames[0], &nameCount, &pNameData, 0);
+   std::vector<RasterElement*> elements;
+   for (IDL_MEMINT i = 0; i < nameCount; ++i)
+   {
+      const std::string name = IDL_STRING_STR(reinterpret_cast<IDL_STRING*>(pNameData) + i);
+      RasterElement* pElement = IdlFunctions::getDataset(name);
+      if (pElement == NULL || pElement->getDataDescriptor() == NULL)
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, ("Error could not find array " + name + ".").c_str());
+         return IDL_StrToSTRING("failure");
+      }
+      elements.push_back(pElement);
+   }
+   if (elements.empty())
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "OPTICKS_STACK_ARRAYS takes an array of raster element names.");
+      return IDL_StrToSTRING("failure");
+   }
+
+   const RasterDataDescriptor* pFirstDesc =
+      static_cast<const RasterDataDescriptor*>(elements.front()->getDataDescriptor());
+   IdlFunctions::Subcube subcube;
+   subcube.mHeightEnd = pFirstDesc->getRowCount() - 1;
+   subcube.mWidthEnd = pFirstDesc->getColumnCount() - 1;
+   subcube.mBandEnd = pFirstDesc->getBandCount() - 1;
+   if (kw->startyheightExists)
+   {
+      subcube.mHeightStart = kw->startyheight;
+   }
+   if (kw->endyheightExists)
+   {
+      subcube.mHeightEnd = kw->endyheight;
+   }
+   if (kw->startxwidthExists)
+   {
+      subcube.mWidthStart = kw->startxwidth;
+   }
+   if (kw->endxwidthExists)
+   {
+      subcube.mWidthEnd = kw->endxwidth;
+   }
+   if (kw->bandstartExists)
+   {
+      subcube.mBandStart = kw->bandstart;
+   }
+   if (kw->bandendExists)
+   {
+      subcube.mBandEnd = kw->bandend;
+   }
+   subcube.mConcurrentRows = IdlFunctions::getConcurrentRows();
+
+   int type = getIdlType(pFirstDesc->getDataType());
+   if (kw->typeExists)
+   {
+      type = kw->idlType;
+      if (IdlFunctions::getIdlTypeSize(type) == 0)
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "OPTICKS_STACK_ARRAYS error.  TYPE must be a numeric IDL type code.");
+         return IDL_StrToSTRING("failure");
+      }
+   }
+   for (std::vector<RasterElement*>::const_iterator element = elements.begin(); element != elements.end(); ++element)
+   {
+      const RasterDataDescriptor* pDesc = static_cast<const RasterDataDescriptor*>((*element)->getDataDescriptor());
+      if (subcube.mHeightStart > subcube.mHeightEnd || subcube.mHeightEnd >= pDesc->getRowCount() ||
+         subcube.mWidthStart > subcube.mWidthEnd || subcube.mWidthEnd >= pDesc->getColumnCount() ||
+         subcube.mBandStart > subcube.mBandEnd || subcube.mBandEnd >= pDesc->getBandCount())
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, ("OPTICKS_STACK_ARRAYS error.  The requested subcube is outside "
+            "of " + (*element)->getName() + ".").c_str());
+         return IDL_StrToSTRING("failure");
+      }
+      if (!kw->typeExists && getIdlType(pDesc->getDataType()) != type)
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "OPTICKS_STACK_ARRAYS error.  TYPE must be given when the raster "
+            "elements have different data types.");
+         return IDL_StrToSTRING("failure");
+      }
+   }
+
+   const IDL_MEMINT column = subcube.getColumnCount();
+   const IDL_MEMINT row = subcube.getRowCount();
+   const IDL_MEMINT band = subcube.getBandCount();
+   const IDL_MEMINT count = static_cast<IDL_MEMINT>(elements.size());
+   const uint64_t totalToAllocate = static_cast<uint64_t>(column) * row * band * count *
+      IdlFunctions::getIdlTypeSize(type);
+   UCHAR* pRawData = NULL;
+   if (totalToAllocate <= std::numeric_limits<size_t>::max())
+   {
+      pRawData = reinterpret_cast<UCHAR*>(malloc(static_cast<size_t>(totalToAllocate)));
+   }
+   if (pRawData == NULL)
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Not enough memory to allocate array");
+      return IDL_StrToSTRING("failure");
+   }
+
+   //read the elements in parallel when there are enough of them to keep every thread busy
+   const unsigned int threadCount = IdlFunctions::getThreadCount();
+   const bool parallelElements = (elements.size() >= threadCount);
+   bool success = false;
+   try
+   {
+      StackTask task(elements, subcube, type, pRawData, parallelElements ? 1 : threadCount);
+      success = IdlFunctions::runChunks(task, elements.size(), parallelElements ? threadCount : 1);
+   }
+   catch (const std::bad_alloc&)
+   {
+      success = false;
+   }
+   if (!success)
+   {
+      free(pRawData);
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "error in copying array values to IDL.");
+      return IDL_StrToSTRING("failure");
+   }
+
+   if (band == 1)
+   {
+      IDL_MEMINT dims[] = {column, row, count};
+      return IDL_ImportArray(3, dims, type, pRawData, reinterpret_cast<IDL_ARRAY_FREE_CB>(free), NULL);
+   }
+   IDL_MEMINT dims[] = {column, row, band, count};
+   return IDL_ImportArray(4, dims, type, pRawData, reinterpret_cast<IDL_ARRAY_FREE_CB>(free), NULL);
+}
+
+/**
+ * Return the part of a raster element shown in a view at the resolution of the screen.
+ *
+ * The visible extent of the view is returned with about one value for each screen pixel,
+ * so the cost of the call depends on the size of the view and not on the size of the
+ * raster element. When the view is zoomed out, the values are taken from a pyramid of
+ * reduced resolution copies of each band, in which each value is the mean of the values
+ * it covers. The pyramid is built the first time a band is needed and is kept until the
+ * raster element is modified, so panning and zooming a large raster element only reads
+ * it once. The pyramids kept are limited by the Overview Cache Size in the IDL options,
+ * and bands too large for it are read again each time. When the view is zoomed in, the
+ * visible values are returned at full resolution.
+ *
+ * @param[in] WINDOW @opt
+ *            The name of the window. Defaults to the active window.
+ * @param[in] LAYER @opt
+ *            The name of the raster layer whose raster element is returned. Defaults to
+ *            the top most raster layer.
+ * @param[in] BANDS_START @opt
+ *            The first band to return in active band numbers. Defaults to the bands
+ *            displayed in the layer.
+ * @param[in] BANDS_END @opt
+ *            The last band to return in active band numbers. Defaults to \p BANDS_START.
+ * @param[out] EXTENT_OUT @opt
+ *             Returns the first column, first row, last column and last row of the
+ *             visible part of the raster element in active numbers.
+ * @return A float array of columns by rows, or of columns by rows by bands when more than
+ *         one band is returned. If there is no view of the raster element or the view does
+ *         not show any of it, the IDL string of "failure" is returned.
+ * @usage
+ * quicklook = opticks_view_array(EXTENT_OUT=extent)
+ * tv, bytscl(quicklook)
  * @endusage
  */
-IDL_VPTR opticks_array_original_rows(int argc, IDL_VPTR pArgv[], char* pArgk)
+IDL_VPTR opticks_view_array(int argc, IDL_VPTR pArgv[], char* pArgk)
 {
-   if (argc<0)
-   {
-      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "OPTICKS_ARRAY_ORIGINAL_ROWS takes a 'dataset' name as a keyword.");
-   }
    typedef struct
    {
       IDL_KW_RESULT_FIRST_FIELD;
-      int datasetExists;
-      IDL_STRING datasetName;
+      int bandstartExists;
+      IDL_LONG bandstart;
+      int bandendExists;
+      IDL_LONG bandend;
+      int extentOutExists;
+      IDL_VPTR extentOut;
+      int layerNameExists;
+      IDL_STRING layerName;
+      int windowExists;
+      IDL_STRING windowName;
    } KW_RESULT;
 
    //IDL_KW_FAST_SCAN is the type of scan we are using, following it is the
@@ -1173,84 +3755,268 @@ IDL_VPTR opticks_array_original_rows(int argc, IDL_VPTR pArgv[], char* pArgk)
    //flags, a boolean whether the value was populated and finally the value itself
    static IDL_KW_PAR kw_pars[] = {
       IDL_KW_FAST_SCAN,
-      {"DATASET", IDL_TYP_STRING, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(datasetExists)),
-         reinterpret_cast<char*>(IDL_KW_OFFSETOF(datasetName))},
+      {"BANDS_END", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(bandendExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(bandend))},
+      {"BANDS_START", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(bandstartExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(bandstart))},
+      {"EXTENT_OUT", IDL_TYP_UNDEF, 1, IDL_KW_OUT, reinterpret_cast<int*>(IDL_KW_OFFSETOF(extentOutExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(extentOut))},
+      {"LAYER", IDL_TYP_STRING, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(layerNameExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(layerName))},
+      {"WINDOW", IDL_TYP_STRING, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(windowExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(windowName))},
       {NULL}
    };
 
    IdlFunctions::IdlKwResource<KW_RESULT> kw(argc, pArgv, pArgk, kw_pars, 0, 1);
 
-   std::string filename;
-   if (kw->datasetExists)
+   std::string windowName;
+   std::string layerName;
+   if (kw->windowExists)
    {
-      filename = IDL_STRING_STR(&kw->datasetName);
+      windowName = IDL_STRING_STR(&kw->windowName);
    }
-   RasterElement* pData = dynamic_cast<RasterElement*>(IdlFunctions::getDataset(filename));
+   if (kw->layerNameExists)
+   {
+      layerName = IDL_STRING_STR(&kw->layerName);
+   }
+   SpatialDataView* pView = dynamic_cast<SpatialDataView*>(IdlFunctions::getViewByWindowName(windowName));
+   RasterLayer* pLayer = (pView == NULL) ? NULL :
+      dynamic_cast<RasterLayer*>(IdlFunctions::getLayerByName(windowName, layerName));
+   RasterElement* pElement = (pLayer == NULL) ? NULL : dynamic_cast<RasterElement*>(pLayer->getDataElement());
+   const RasterDataDescriptor* pDesc = (pElement == NULL) ? NULL :
+      dynamic_cast<const RasterDataDescriptor*>(pElement->getDataDescriptor());
+   if (pDesc == NULL)
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Error could not find the raster layer.");
+      return IDL_StrToSTRING("failure");
+   }
+   const unsigned int rows = pDesc->getRowCount();
+   const unsigned int columns = pDesc->getColumnCount();
 
-   if (pData == NULL)
+   //default to the bands the user is looking at
+   std::vector<unsigned int> bands;
+   if (kw->bandstartExists || kw->bandendExists)
    {
-      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Error could not find array.");
+      const IDL_LONG bandStart = kw->bandstartExists ? kw->bandstart : 0;
+      const IDL_LONG bandEnd = kw->bandendExists ? kw->bandend : bandStart;
+      if (bandStart < 0 || bandStart > bandEnd || static_cast<unsigned int>(bandEnd) >= pDesc->getBandCount())
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "OPTICKS_VIEW_ARRAY error.  The requested bands are outside of "
+            "the array.");
+         return IDL_StrToSTRING("failure");
+      }
+      for (IDL_LONG band = bandStart; band <= bandEnd; ++band)
+      {
+         bands.push_back(static_cast<unsigned int>(band));
+      }
+   }
+   else
+   {
+      std::vector<RasterChannelType> channels;
+      if (pLayer->getDisplayMode() == RGB_MODE)
+      {
+         channels.push_back(RED);
+         channels.push_back(GREEN);
+         channels.push_back(BLUE);
+      }
+      else
+      {
+         channels.push_back(GRAY);
+      }
+      for (std::vector<RasterChannelType>::const_iterator channel = channels.begin(); channel != channels.end();
+         ++channel)
+      {
+         const DimensionDescriptor displayed = pLayer->getDisplayedBand(*channel);
+         bands.push_back(displayed.isActiveNumberValid() ? displayed.getActiveNumber() : 0);
+      }
+   }
+
+   //the visible corners may be rotated so the extent is their bounding box
+   LocationType corners[4];
+   pView->getVisibleCorners(corners[0], corners[1], corners[2], corners[3]);
+   double minX = std::numeric_limits<double>::max();
+   double minY = std::numeric_limits<double>::max();
+   double maxX = -std::numeric_limits<double>::max();
+   double maxY = -std::numeric_limits<double>::max();
+   for (int corner = 0; corner < 4; ++corner)
+   {
+      double x = 0.0;
+      double y = 0.0;
+      pLayer->translateWorldToData(corners[corner].mX, corners[corner].mY, x, y);
+      minX = std::min(minX, x);
+      minY = std::min(minY, y);
+      maxX = std::max(maxX, x);
+      maxY = std::max(maxY, y);
+   }
+   if (maxX <= 0.0 || maxY <= 0.0 || minX >= columns || minY >= rows)
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "OPTICKS_VIEW_ARRAY error.  The view does not show the array.");
       return IDL_StrToSTRING("failure");
    }
+   const unsigned int columnStart = static_cast<unsigned int>(std::max(0.0, floor(minX)));
+   const unsigned int rowStart = static_cast<unsigned int>(std::max(0.0, floor(minY)));
+   const unsigned int columnEnd = std::max(columnStart + 1, static_cast<unsigned int>(std::min<double>(columns,
+      ceil(maxX))));
+   const unsigned int rowEnd = std::max(rowStart + 1, static_cast<unsigned int>(std::min<double>(rows,
+      ceil(maxY))));
 
-   RasterDataDescriptor* pDesc = dynamic_cast<RasterDataDescriptor*>(pData->getDataDescriptor());
-   if (pDesc == NULL)
+   //one value for each screen pixel, but never more than the raster element has
+   const double zoom = pView->getZoomPercentage() / 100.0;
+   const unsigned int extentColumns = columnEnd - columnStart;
+   const unsigned int extentRows = rowEnd - rowStart;
+   const unsigned int outColumns = std::max(1U, std::min(extentColumns,
+      static_cast<unsigned int>(ceil(extentColumns * zoom))));
+   const unsigned int outRows = std::max(1U, std::min(extentRows, static_cast<unsigned int>(ceil(extentRows * zoom))));
+   const double columnScale = static_cast<double>(extentColumns) / outColumns;
+   const double rowScale = static_cast<double>(extentRows) / outRows;
+
+   //use the coarsest level which still has at least a value for each returned value
+   const unsigned int levelCount = OverviewCache::getLevelCount(rows, columns);
+   unsigned int level = 0;
+   while (level < levelCount && static_cast<double>(2U << level) <= std::min(columnScale, rowScale))
    {
-      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Error could not find array.");
+      ++level;
+   }
+   const double factor = static_cast<double>(1U << level);
+   const unsigned int sourceColumnStart = (level == 0) ? columnStart : 0;
+   const unsigned int sourceRowStart = (level == 0) ? rowStart : 0;
+   const unsigned int sourceColumns = (level == 0) ? extentColumns : (columns + (1U << level) - 1) >> level;
+   const unsigned int sourceRows = (level == 0) ? extentRows : (rows + (1U << level) - 1) >> level;
+   std::vector<size_t> columnIndices(outColumns);
+   for (unsigned int column = 0; column < outColumns; ++column)
+   {
+      const double x = (columnStart + (column + 0.5) * columnScale) / factor - sourceColumnStart;
+      columnIndices[column] = std::min<size_t>(sourceColumns - 1, static_cast<size_t>(std::max(0.0, x)));
+   }
+   std::vector<size_t> rowIndices(outRows);
+   for (unsigned int row = 0; row < outRows; ++row)
+   {
+      const double y = (rowStart + (row + 0.5) * rowScale) / factor - sourceRowStart;
+      rowIndices[row] = std::min<size_t>(sourceRows - 1, static_cast<size_t>(std::max(0.0, y)));
+   }
+
+   const size_t bandValues = static_cast<size_t>(outColumns) * outRows;
+   float* pRawData = reinterpret_cast<float*>(malloc(bandValues * bands.size() * sizeof(float)));
+   if (pRawData == NULL)
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Not enough memory to allocate array");
       return IDL_StrToSTRING("failure");
    }
 
-   const std::vector<DimensionDescriptor>& rows = pDesc->getRows();
-   if (rows.empty())
+   // an IDL array referring to the element's data could change it without a signal
+   OverviewCache& overviews = OverviewCache::instance();
+   const bool keep = (ExportRegistry::instance().getExportedBytes(pElement) == 0) && overviews.applySettings();
+   bool success = true;
+   for (size_t index = 0; index < bands.size() && success; ++index)
    {
-      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Error could not find array.");
+      std::vector<float> region;
+      OverviewCache::Level built;
+      const float* pSource = NULL;
+      if (level == 0)
+      {
+         //zoomed in far enough that the visible values are read directly
+         IdlFunctions::Subcube subcube;
+         subcube.mHeightStart = rowStart;
+         subcube.mHeightEnd = rowEnd - 1;
+         subcube.mWidthStart = columnStart;
+         subcube.mWidthEnd = columnEnd - 1;
+         subcube.mBandStart = bands[index];
+         subcube.mBandEnd = bands[index];
+         try
+         {
+            region.resize(static_cast<size_t>(extentColumns) * extentRows);
+            success = IdlFunctions::copyConvertedSubcube(&region[0], IDL_TYP_FLOAT, pElement, subcube, BSQ);
+         }
+         catch (const std::bad_alloc&)
+         {
+            success = false;
+         }
+         pSource = success ? &region[0] : NULL;
+      }
+      else
+      {
+         const OverviewCache::Level* pLevel = overviews.getLevel(pElement, bands[index], level, keep, built);
+         success = (pLevel != NULL);
+         pSource = success ? &pLevel->mData[0] : NULL;
+      }
+      float* pOut = pRawData + index * bandValues;
+      for (unsigned int row = 0; row < outRows && success; ++row, pOut += outColumns)
+      {
+         const float* pRow = pSource + rowIndices[row] * sourceColumns;
+         for (unsigned int column = 0; column < outColumns; ++column)
+         {
+            pOut[column] = pRow[columnIndices[column]];
+         }
+      }
+   }
+   if (!success)
+   {
+      free(pRawData);
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "error in copying array values to IDL.");
       return IDL_StrToSTRING("failure");
    }
-   UCHAR* pCopyvec = reinterpret_cast<UCHAR*>(malloc(rows.size() * sizeof(unsigned int)));
-   VERIFYRV(pCopyvec, NULL);
-   unsigned int* pTempPtr = reinterpret_cast<unsigned int*>(pCopyvec);
-   for (std::vector<DimensionDescriptor>::const_iterator rowIter = rows.begin();
-        rowIter != rows.end();
-        ++rowIter, ++pTempPtr)
+
+   if (kw->extentOutExists)
    {
-      *pTempPtr = rowIter->getOriginalNumber();
+      std::vector<unsigned int> extent;
+      extent.push_back(columnStart);
+      extent.push_back(rowStart);
+      extent.push_back(columnEnd - 1);
+      extent.push_back(rowEnd - 1);
+      if (!storeIndices(kw->extentOut, extent))
+      {
+         free(pRawData);
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Not enough memory to allocate array");
+         return IDL_StrToSTRING("failure");
+      }
    }
-   IDL_MEMINT pDims[] = {rows.size()};
-   return IDL_ImportArray(1, pDims, IDL_TYP_ULONG, pCopyvec,
+   if (bands.size() == 1)
+   {
+      IDL_MEMINT dims[] = {outColumns, outRows};
+      return IDL_ImportArray(2, dims, IDL_TYP_FLOAT, reinterpret_cast<UCHAR*>(pRawData),
+         reinterpret_cast<IDL_ARRAY_FREE_CB>(free), NULL);
+   }
+   IDL_MEMINT dims[] = {outColumns, outRows, static_cast<IDL_MEMINT>(bands.size())};
+   return IDL_ImportArray(3, dims, IDL_TYP_FLOAT, reinterpret_cast<UCHAR*>(pRawData),
       reinterpret_cast<IDL_ARRAY_FREE_CB>(free), NULL);
 }
 
 /**
- * Return details about the original column numbers for an Opticks raster data.
+ * Copy the bands of many pixels at once.
  *
- * This will return an IDL array, where the value for each item in the
- * array is the original column number for that given loaded column.  This functionality
- * is provided because some Opticks wizard items require the original number
- * in order to function properly.  The Opticks IDL API does not require this
- * number to function properly.
+ * This returns the same values as calling array_to_idl() for each pixel, but the raster
+ * element is found once and each block of rows holding pixels is read once, on separate
+ * threads, so thousands of pixels can be copied in a single call.
  *
+ * @param[in] [1]
+ *            The active row number of each pixel.
+ * @param[in] [2]
+ *            The active column number of each pixel.
  * @param[in] DATASET @opt
- *            The name of the raster element to get. Defaults to
- *            the primary raster element of the active window.
- * @return An IDL array containing the original column numbers.  If the \b DATASET could not
- *         found, then the IDL string of "failure" will be returned.
- * @usage 
- * print,opticks_array_dimensions(WIDTH_OUT=num_columns)
- * print,num_columns
- * col_list = opticks_array_original_columns()
- * ; n_elements(col_list) would be equal to num_columns
- * ; col_list[0] would return the original number of the first column
+ *            The name of the raster element. Defaults to the primary raster element of
+ *            the active window.
+ * @param[in] BANDS_START @opt
+ *            The starting band in active band numbers. Defaults to 0.
+ * @param[in] BANDS_END @opt
+ *            The end band in active band numbers. Defaults to the last band.
+ * @return A two dimensional array of bands by pixels, in the order the pixels are given.
+ *         Complex integer data is returned as COMPLEX. If the pixels can't be copied, the
+ *         IDL string of "failure" is returned.
+ * @usage
+ * spectra = opticks_get_pixels(truth_rows, truth_columns, DATASET="scene.hdr")
+ * plot, spectra[*, 0]
  * @endusage
  */
-IDL_VPTR opticks_array_original_columns(int argc, IDL_VPTR pArgv[], char* pArgk)
+IDL_VPTR opticks_get_pixels(int argc, IDL_VPTR pArgv[], char* pArgk)
 {
-   if (argc<0)
-   {
-      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "OPTICKS_ARRAY_ORIGINAL_COLUMNS takes a 'dataset' name as a keyword.");
-   }
    typedef struct
    {
       IDL_KW_RESULT_FIRST_FIELD;
+      int bandstartExists;
+      IDL_LONG bandstart;
+      int bandendExists;
+      IDL_LONG bandend;
       int datasetExists;
       IDL_STRING datasetName;
    } KW_RESULT;
@@ -1260,138 +4026,176 @@ IDL_VPTR opticks_array_original_columns(int argc, IDL_VPTR pArgv[], char* pArgk)
    //flags, a boolean whether the value was populated and finally the value itself
    static IDL_KW_PAR kw_pars[] = {
       IDL_KW_FAST_SCAN,
+      {"BANDS_END", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(bandendExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(bandend))},
+      {"BANDS_START", IDL_TYP_LONG, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(bandstartExists)),
+         reinterpret_cast<char*>(IDL_KW_OFFSETOF(bandstart))},
       {"DATASET", IDL_TYP_STRING, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(datasetExists)),
          reinterpret_cast<char*>(IDL_KW_OFFSETOF(datasetName))},
       {NULL}
    };
 
-   IdlFunctions::IdlKwResource<KW_RESULT> kw(argc, pArgv, pArgk, kw_pars, 0, 1);
+   IDL_VPTR pPositions[] = {NULL, NULL};
+   IdlFunctions::IdlKwResource<KW_RESULT> kw(argc, pArgv, pArgk, kw_pars, pPositions, 1);
+   if (pPositions[0] == NULL || pPositions[1] == NULL)
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "OPTICKS_GET_PIXELS takes an array of rows and an array of "
+         "columns.");
+      return IDL_StrToSTRING("failure");
+   }
 
    std::string filename;
    if (kw->datasetExists)
    {
       filename = IDL_STRING_STR(&kw->datasetName);
    }
-   RasterElement* pData = dynamic_cast<RasterElement*>(IdlFunctions::getDataset(filename));
-
-   if (pData == NULL)
+   RasterElement* pData = IdlFunctions::getDataset(filename);
+   const RasterDataDescriptor* pDesc = (pData == NULL) ? NULL :
+      dynamic_cast<const RasterDataDescriptor*>(pData->getDataDescriptor());
+   if (pDesc == NULL)
    {
       IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Error could not find array.");
       return IDL_StrToSTRING("failure");
    }
 
-   RasterDataDescriptor* pDesc = dynamic_cast<RasterDataDescriptor*>(pData->getDataDescriptor());
-   if (pDesc == NULL)
+   //the positions are copied so the IDL variables are only converted once
+   std::vector<unsigned int> positions[2];
+   const unsigned int limits[] = {pDesc->getRowCount(), pDesc->getColumnCount()};
+   bool valid = true;
+   for (int axis = 0; axis < 2 && valid; ++axis)
    {
-      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Error could not find array.");
+      IDL_VPTR pList = pPositions[axis];
+      IDL_VPTR pLongList = IDL_CvtLng(1, &pList);
+      IDL_MEMINT total = 0;
+      char* pValues = NULL;
+      IDL_VarGetData(pLongList, &total, &pValues, 0);
+      for (IDL_MEMINT i = 0; i < total && valid; ++i)
+      {
+         const IDL_LONG value = reinterpret_cast<IDL_LONG*>(pValues)[i];
+         valid = (value >= 0 && static_cast<unsigned int>(value) < limits[axis]);
+         positions[axis].push_back(static_cast<unsigned int>(value));
+      }
+      if (pLongList != pList)
+      {
+         IDL_Deltmp(pLongList);
+      }
+   }
+   if (!valid || positions[0].empty() || positions[0].size() != positions[1].size())
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "OPTICKS_GET_PIXELS error.  The rows and columns must be arrays of "
+         "the same length holding active row and column numbers.");
       return IDL_StrToSTRING("failure");
    }
 
-   const std::vector<DimensionDescriptor>& columns = pDesc->getColumns();
-   if (columns.empty())
+   IdlFunctions::Subcube subcube;
+   subcube.mBandEnd = pDesc->getBandCount() - 1;
+   if (kw->bandstartExists)
    {
-      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Error could not find array.");
+      subcube.mBandStart = kw->bandstart;
+   }
+   if (kw->bandendExists)
+   {
+      subcube.mBandEnd = kw->bandend;
+   }
+   if (subcube.mBandStart > subcube.mBandEnd || subcube.mBandEnd >= pDesc->getBandCount())
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "OPTICKS_GET_PIXELS error.  The requested bands are outside of the "
+         "array.");
       return IDL_StrToSTRING("failure");
    }
-   UCHAR* pCopyvec = reinterpret_cast<UCHAR*>(malloc(columns.size() * sizeof(unsigned int)));
-   VERIFYRV(pCopyvec, NULL);
-   unsigned int* pTempPtr = reinterpret_cast<unsigned int*>(pCopyvec);
-   for (std::vector<DimensionDescriptor>::const_iterator colIter = columns.begin();
-        colIter != columns.end();
-        ++colIter, ++pTempPtr)
+
+   const int type = getIdlType(pDesc->getDataType());
+   const IDL_MEMINT band = subcube.getBandCount();
+   const IDL_MEMINT count = static_cast<IDL_MEMINT>(positions[0].size());
+   const uint64_t totalToAllocate = static_cast<uint64_t>(band) * count * IdlFunctions::getIdlTypeSize(type);
+   UCHAR* pRawData = NULL;
+   if (totalToAllocate <= std::numeric_limits<size_t>::max())
    {
-      *pTempPtr = colIter->getOriginalNumber();
+      pRawData = reinterpret_cast<UCHAR*>(malloc(static_cast<size_t>(totalToAllocate)));
    }
-   IDL_MEMINT pDims[] = {columns.size()};
-   return IDL_ImportArray(1, pDims, IDL_TYP_ULONG, pCopyvec,
-      reinterpret_cast<IDL_ARRAY_FREE_CB>(free), NULL);
+   if (pRawData == NULL)
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Not enough memory to allocate array");
+      return IDL_StrToSTRING("failure");
+   }
+   if (!IdlFunctions::copyPixels(pRawData, pData, subcube, positions[0], positions[1]))
+   {
+      free(pRawData);
+      return IDL_StrToSTRING("failure");
+   }
+   IDL_MEMINT dims[] = {band, count};
+   return IDL_ImportArray(2, dims, type, pRawData, reinterpret_cast<IDL_ARRAY_FREE_CB>(free), NULL);
 }
 
 /**
- * Return details about the original band numbers for an Opticks raster data.
+ * Wait for a transfer started by array_to_idl() or array_to_opticks() with the
+ * \p ASYNC flag to finish.
  *
- * This will return an IDL array, where the value for each item in the
- * array is the original band number for that given loaded band.  This functionality
- * is provided because some Opticks wizard items require the original number
- * in order to function properly.  The Opticks IDL API does not require this
- * number to function properly.
+ * The data copied by a transfer must not be used until this returns. Each transfer is
+ * waited for once, after which its handle is no longer valid.
  *
- * @param[in] DATASET @opt
- *            The name of the raster element to get. Defaults to
- *            the primary raster element of the active window.
- * @return An IDL array containing the original band numbers.  If the \b DATASET could not
- *         found, then the IDL string of "failure" will be returned.
- * @usage 
- * print,opticks_array_dimensions(BANDS_OUT=num_bands)
- * print,num_bands
- * band_list = opticks_array_original_bands()
- * ; n_elements(band_list) would be equal to num_bands
- * ; band_list[0] would return the original number of the first band
+ * @param[in] [1]
+ *            The transfer handle.
+ * @return The array for a transfer started by array_to_idl(), or the IDL string of
+ *         "success" for a transfer started by array_to_opticks(). If the transfer
+ *         failed, the IDL string of "failure" is returned.
+ * @usage
+ * transfer = array_to_idl(DATASET="big.raw", /ASYNC)
+ * process, other
+ * data = opticks_wait(transfer)
  * @endusage
  */
-IDL_VPTR opticks_array_original_bands(int argc, IDL_VPTR pArgv[], char* pArgk)
+IDL_VPTR opticks_wait(int argc, IDL_VPTR pArgv[])
 {
-   if (argc<0)
-   {
-      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "OPTICKS_ARRAY_ORIGINAL_BANDS takes a 'dataset' name as a keyword.");
-   }
-   typedef struct
-   {
-      IDL_KW_RESULT_FIRST_FIELD;
-      int datasetExists;
-      IDL_STRING datasetName;
-   } KW_RESULT;
-
-   //IDL_KW_FAST_SCAN is the type of scan we are using, following it is the
-   //name of the keyword, followed by the type, the mask(which should be 1),
-   //flags, a boolean whether the value was populated and finally the value itself
-   static IDL_KW_PAR kw_pars[] = {
-      IDL_KW_FAST_SCAN,
-      {"DATASET", IDL_TYP_STRING, 1, 0, reinterpret_cast<int*>(IDL_KW_OFFSETOF(datasetExists)),
-         reinterpret_cast<char*>(IDL_KW_OFFSETOF(datasetName))},
-      {NULL}
-   };
-
-   IdlFunctions::IdlKwResource<KW_RESULT> kw(argc, pArgv, pArgk, kw_pars, 0, 1);
-
-   std::string filename;
-   if (kw->datasetExists)
+   if (argc < 1)
    {
-      filename = IDL_STRING_STR(&kw->datasetName);
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "OPTICKS_WAIT takes a transfer handle as a parameter.");
+      return IDL_StrToSTRING("failure");
    }
-   RasterElement* pData = dynamic_cast<RasterElement*>(IdlFunctions::getDataset(filename));
-
-   if (pData == NULL)
+   IDL_VPTR pArray = NULL;
+   if (!AsyncTransfers::instance().wait(IDL_LongScalar(pArgv[0]), pArray))
    {
-      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Error could not find array.");
       return IDL_StrToSTRING("failure");
    }
-
-   RasterDataDescriptor* pDesc = dynamic_cast<RasterDataDescriptor*>(pData->getDataDescriptor());
-   if (pDesc == NULL)
+   if (pArray == NULL)
    {
-      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Error could not find array.");
-      return IDL_StrToSTRING("failure");
+      return IDL_StrToSTRING("success");
    }
+   return pArray;
+}
 
-   const std::vector<DimensionDescriptor>& bands = pDesc->getBands();
-   if (bands.empty())
+/**
+ * Determine if a transfer started by array_to_idl() or array_to_opticks() with the
+ * \p ASYNC flag has finished, without waiting for it.
+ *
+ * opticks_wait() must still be called to get the result of the transfer, but it
+ * returns at once when this has returned 1.
+ *
+ * @param[in] [1]
+ *            The transfer handle.
+ * @return 1 if the transfer has finished and 0 if it is still running. If the handle
+ *         is not a transfer which has not been waited for, the IDL string of "failure"
+ *         is returned.
+ * @usage
+ * transfer = array_to_idl(DATASET="big.raw", /ASYNC)
+ * while opticks_poll(transfer) eq 0 do process_next_tile
+ * data = opticks_wait(transfer)
+ * @endusage
+ */
+IDL_VPTR opticks_poll(int argc, IDL_VPTR pArgv[])
+{
+   if (argc < 1)
    {
-      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Error could not find array.");
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "OPTICKS_POLL takes a transfer handle as a parameter.");
       return IDL_StrToSTRING("failure");
    }
-   UCHAR* pCopyvec = reinterpret_cast<UCHAR*>(malloc(bands.size() * sizeof(unsigned int)));
-   VERIFYRV(pCopyvec, NULL);
-   unsigned int* pTempPtr = reinterpret_cast<unsigned int*>(pCopyvec);
-   for (std::vector<DimensionDescriptor>::const_iterator bandIter = bands.begin();
-        bandIter != bands.end();
-        ++bandIter, ++pTempPtr)
+   bool done = false;
+   if (!AsyncTransfers::instance().isDone(IDL_LongScalar(pArgv[0]), done))
    {
-      *pTempPtr = bandIter->getOriginalNumber();
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "The transfer handle is not a transfer which is in progress.");
+      return IDL_StrToSTRING("failure");
    }
-   IDL_MEMINT pDims[] = {bands.size()};
-   return IDL_ImportArray(1, pDims, IDL_TYP_ULONG, pCopyvec,
-      reinterpret_cast<IDL_ARRAY_FREE_CB>(free), NULL);
+   return IDL_GettmpLong(done ? 1 : 0);
 }
 
 /*@}*/
@@ -1399,6 +4203,7 @@ IDL_VPTR opticks_array_original_bands(int argc, IDL_VPTR pArgv[], char* pArgk)
 static IDL_SYSFUN_DEF2 func_definitions[] = {
    {reinterpret_cast<IDL_SYSRTN_GENERIC>(array_to_idl), "ARRAY_TO_IDL",0,12,IDL_SYSFUN_DEF_F_KEYWORDS,0},
    {reinterpret_cast<IDL_SYSRTN_GENERIC>(array_to_opticks), "ARRAY_TO_OPTICKS",0,12,IDL_SYSFUN_DEF_F_KEYWORDS,0},
+   {reinterpret_cast<IDL_SYSRTN_GENERIC>(opticks_tile_map), "OPTICKS_TILE_MAP",0,12,IDL_SYSFUN_DEF_F_KEYWORDS,0},
    {reinterpret_cast<IDL_SYSRTN_GENERIC>(opticks_array_dimensions),
       "OPTICKS_ARRAY_DIMENSIONS",0,12,IDL_SYSFUN_DEF_F_KEYWORDS,0},
    {reinterpret_cast<IDL_SYSRTN_GENERIC>(opticks_array_ondisk_rows),
@@ -1413,6 +4218,18 @@ static IDL_SYSFUN_DEF2 func_definitions[] = {
       "OPTICKS_ARRAY_ORIGINAL_COLUMNS",0,12,IDL_SYSFUN_DEF_F_KEYWORDS,0},
    {reinterpret_cast<IDL_SYSRTN_GENERIC>(opticks_array_original_bands),
       "OPTICKS_ARRAY_ORIGINAL_BANDS",0,12,IDL_SYSFUN_DEF_F_KEYWORDS,0},
+   {reinterpret_cast<IDL_SYSRTN_GENERIC>(opticks_exported_bytes),
+      "OPTICKS_EXPORTED_BYTES",0,12,IDL_SYSFUN_DEF_F_KEYWORDS,0},
+   {reinterpret_cast<IDL_SYSRTN_GENERIC>(opticks_band_stats),
+      "OPTICKS_BAND_STATS",0,12,IDL_SYSFUN_DEF_F_KEYWORDS,0},
+   {reinterpret_cast<IDL_SYSRTN_GENERIC>(opticks_stack_arrays),
+      "OPTICKS_STACK_ARRAYS",1,1,IDL_SYSFUN_DEF_F_KEYWORDS,0},
+   {reinterpret_cast<IDL_SYSRTN_GENERIC>(opticks_view_array),
+      "OPTICKS_VIEW_ARRAY",0,12,IDL_SYSFUN_DEF_F_KEYWORDS,0},
+   {reinterpret_cast<IDL_SYSRTN_GENERIC>(opticks_get_pixels),
+      "OPTICKS_GET_PIXELS",2,2,IDL_SYSFUN_DEF_F_KEYWORDS,0},
+   {reinterpret_cast<IDL_SYSRTN_GENERIC>(opticks_wait), "OPTICKS_WAIT",1,1,0,0},
+   {reinterpret_cast<IDL_SYSRTN_GENERIC>(opticks_poll), "OPTICKS_POLL",1,1,0,0},
    {NULL, NULL, 0, 0, 0, 0}
 };
 
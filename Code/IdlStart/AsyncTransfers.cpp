@@ -0,0 +1,206 @@
+/*
+ * The information in this file is
+ * Copyright(c) 2007 Ball Aerospace & Technologies Corporation
+ * and is subject to the terms and conditions of the
+ * GNU Lesser General Public License Version 2.1
+ * The license text is available from
+ * http://www.gnu.org/licenses/lgpl.html
+ */
+
+#include "AsyncTransfers.h"
+#include "RasterDataDescriptor.h"
+#include "RasterElement.h"
+#include <stdlib.h>
+
+pthread_mutex_t AsyncTransfers::sMutex = PTHREAD_MUTEX_INITIALIZER;
+
+AsyncTransfers::Transfer::Transfer() :
+   mRead(true),
+   mpData(NULL),
+   mpElement(NULL),
+   mInterleave(BSQ),
+   mThreadCount(1),
+   mDimensions(0),
+   mType(IDL_TYP_UNDEF),
+   mRunning(false),
+   mDone(false),
+   mSuccess(false)
+{
+   mDims[0] = mDims[1] = mDims[2] = 0;
+}
+
+AsyncTransfers& AsyncTransfers::instance()
+{
+   static AsyncTransfers sTransfers;
+   return sTransfers;
+}
+
+AsyncTransfers::AsyncTransfers() :
+   mWatcher(*this, false),
+   mNextHandle(1)
+{}
+
+IDL_LONG AsyncTransfers::startRead(void* pData, RasterElement* pElement, const IdlFunctions::Subcube& subcube,
+                                   InterleaveFormatType interleave, int dimensions, const IDL_MEMINT dims[], int type)
+{
+   if (pData == NULL || pElement == NULL || dimensions < 1 || dimensions > 3)
+   {
+      return 0;
+   }
+   Transfer* pTransfer = new Transfer;
+   pTransfer->mpData = pData;
+   pTransfer->mpElement = pElement;
+   pTransfer->mSubcube = subcube;
+   pTransfer->mInterleave = interleave;
+   pTransfer->mDimensions = dimensions;
+   for (int dimension = 0; dimension < dimensions; ++dimension)
+   {
+      pTransfer->mDims[dimension] = dims[dimension];
+   }
+   pTransfer->mType = type;
+   return start(pTransfer);
+}
+
+IDL_LONG AsyncTransfers::startWrite(char* pData, RasterElement* pElement, const IdlFunctions::Subcube& subcube)
+{
+   if (pData == NULL || pElement == NULL)
+   {
+      return 0;
+   }
+   Transfer* pTransfer = new Transfer;
+   pTransfer->mRead = false;
+   pTransfer->mpData = pData;
+   pTransfer->mpElement = pElement;
+   pTransfer->mSubcube = subcube;
+   return start(pTransfer);
+}
+
+bool AsyncTransfers::isDone(IDL_LONG handle, bool& done)
+{
+   std::map<IDL_LONG, Transfer*>::iterator transfer = mTransfers.find(handle);
+   if (transfer == mTransfers.end())
+   {
+      return false;
+   }
+   pthread_mutex_lock(&sMutex);
+   done = transfer->second->mDone;
+   pthread_mutex_unlock(&sMutex);
+   return true;
+}
+
+bool AsyncTransfers::wait(IDL_LONG handle, IDL_VPTR& pArray)
+{
+   pArray = NULL;
+   std::map<IDL_LONG, Transfer*>::iterator transfer = mTransfers.find(handle);
+   if (transfer == mTransfers.end())
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "The transfer handle is not a transfer which is in progress.");
+      return false;
+   }
+   Transfer* pTransfer = transfer->second;
+   mTransfers.erase(transfer);
+   join(pTransfer);
+
+   bool success = pTransfer->mSuccess;
+   if (pTransfer->mpElement == NULL)
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "The raster element was deleted during the transfer.");
+      success = false;
+   }
+   else if (!success)
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, pTransfer->mRead ? "error in copying array values to IDL." :
+         "error in copying array values to Opticks.");
+   }
+   else if (pTransfer->mRead)
+   {
+      pArray = IDL_ImportArray(pTransfer->mDimensions, pTransfer->mDims, pTransfer->mType,
+         reinterpret_cast<UCHAR*>(pTransfer->mpData), reinterpret_cast<IDL_ARRAY_FREE_CB>(free), NULL);
+      pTransfer->mpData = NULL;
+   }
+   else
+   {
+      //the data is only reported as modified once the whole subcube is written
+      pTransfer->mpElement->updateData();
+   }
+   free(pTransfer->mpData);
+   delete pTransfer;
+   return success;
+}
+
+void AsyncTransfers::clear()
+{
+   for (std::map<IDL_LONG, Transfer*>::iterator transfer = mTransfers.begin(); transfer != mTransfers.end();
+      ++transfer)
+   {
+      join(transfer->second);
+      free(transfer->second->mpData);
+      delete transfer->second;
+   }
+   mTransfers.clear();
+   mWatcher.clear();
+}
+
+IDL_LONG AsyncTransfers::start(Transfer* pTransfer)
+{
+   //the settings are read here since the worker thread must not use the services
+   pTransfer->mThreadCount = IdlFunctions::getThreadCount();
+   const IDL_LONG handle = mNextHandle++;
+   mTransfers[handle] = pTransfer;
+   mWatcher.watch(pTransfer->mpElement);
+   pTransfer->mRunning = (pthread_create(&pTransfer->mThread, NULL, AsyncTransfers::run, pTransfer) == 0);
+   if (!pTransfer->mRunning)
+   {
+      run(pTransfer);
+   }
+   return handle;
+}
+
+void* AsyncTransfers::run(void* pArg)
+{
+   Transfer* pTransfer = static_cast<Transfer*>(pArg);
+   bool success = false;
+   if (pTransfer->mRead)
+   {
+      const RasterDataDescriptor* pDesc =
+         static_cast<const RasterDataDescriptor*>(pTransfer->mpElement->getDataDescriptor());
+      if (pDesc != NULL)
+      {
+         switchOnComplexEncoding(pDesc->getDataType(), IdlFunctions::copySubcubeChunks, pTransfer->mpData,
+            pTransfer->mpElement, pTransfer->mSubcube, pTransfer->mInterleave, pTransfer->mThreadCount, success);
+      }
+   }
+   else
+   {
+      success = IdlFunctions::writeSubcube(pTransfer->mpElement, static_cast<const char*>(pTransfer->mpData),
+         pTransfer->mSubcube, pTransfer->mThreadCount);
+   }
+   pthread_mutex_lock(&sMutex);
+   pTransfer->mSuccess = success;
+   pTransfer->mDone = true;
+   pthread_mutex_unlock(&sMutex);
+   return NULL;
+}
+
+void AsyncTransfers::join(Transfer* pTransfer)
+{
+   if (pTransfer->mRunning)
+   {
+      pthread_join(pTransfer->mThread, NULL);
+      pTransfer->mRunning = false;
+   }
+}
+
+void AsyncTransfers::elementDeleted(RasterElement* pElement)
+{
+   //finish the element's transfers before its data is freed, their results are discarded by wait()
+   for (std::map<IDL_LONG, Transfer*>::iterator transfer = mTransfers.begin(); transfer != mTransfers.end();
+      ++transfer)
+   {
+      if (transfer->second->mpElement == pElement)
+      {
+         join(transfer->second);
+         transfer->second->mpElement = NULL;
+      }
+   }
+}
@@ -0,0 +1,129 @@
+/*
+ * The information in this file is
+ * Copyright(c) 2007 Ball Aerospace & Technologies Corporation
+ * and is subject to the terms and conditions of the
+ * GNU Lesser General Public License Version 2.1
+ * The license text is available from
+ * http://www.gnu.org/licenses/lgpl.html
+ */
+
+#ifndef ASYNCTRANSFERS_H
+#define ASYNCTRANSFERS_H
+
+#include "AppConfig.h"
+#include "ElementWatcher.h"
+#include "IdlFunctions.h"
+#include <idl_export.h>
+#include <pthread.h>
+#include <map>
+
+class RasterElement;
+
+/**
+ * These are internal support methods not used in IDL.
+ * \cond INTERNAL
+ */
+
+/**
+ * Copies subcubes between raster elements and buffers on background threads so
+ * IDL can keep running while the data is copied.
+ *
+ * Each transfer is identified by a handle. The worker threads do not call into IDL
+ * or change the raster elements other than their data, so every IDL message, the
+ * returned array and the DataModified signal of a written element are left for
+ * wait() on the IDL thread.
+ */
+class AsyncTransfers : private ElementWatcher::Listener
+{
+public:
+   static AsyncTransfers& instance();
+
+   /**
+    * Start copying a subcube of a raster element into a buffer.
+    *
+    * @param pData
+    *        The destination buffer, allocated with malloc(). It is owned by the transfer
+    *        and is returned as the data of the IDL array created by wait().
+    * @param interleave
+    *        The interleave of the destination buffer.
+    * @param dimensions
+    *        The number of IDL dimensions of the returned array.
+    * @param dims
+    *        The IDL dimensions of the returned array.
+    * @param type
+    *        The IDL type of the returned array, which must match the element's data type.
+    * @return The handle of the transfer, or 0 if it could not be started.
+    */
+   IDL_LONG startRead(void* pData, RasterElement* pElement, const IdlFunctions::Subcube& subcube,
+      InterleaveFormatType interleave, int dimensions, const IDL_MEMINT dims[], int type);
+
+   /**
+    * Start writing a buffer in the element's interleave into a subcube of a raster element.
+    *
+    * @param pData
+    *        The data to write, allocated with malloc(). It is owned by the transfer.
+    * @return The handle of the transfer, or 0 if it could not be started.
+    */
+   IDL_LONG startWrite(char* pData, RasterElement* pElement, const IdlFunctions::Subcube& subcube);
+
+   /**
+    * Determine if a transfer has finished.
+    *
+    * @return \c true if \p handle is a transfer which has not been waited for,
+    *         \c false otherwise.
+    */
+   bool isDone(IDL_LONG handle, bool& done);
+
+   /**
+    * Wait for a transfer to finish and forget it. IDL messages are posted for a
+    * transfer which failed.
+    *
+    * @param pArray
+    *        Set to the IDL array holding the data of a read, or \c NULL for a write.
+    * @return \c true if the transfer succeeded, \c false otherwise.
+    */
+   bool wait(IDL_LONG handle, IDL_VPTR& pArray);
+
+   /**
+    * Wait for every transfer and forget them. This is called before IDL is shut down.
+    */
+   void clear();
+
+private:
+   struct Transfer
+   {
+      Transfer();
+
+      bool mRead;
+      void* mpData;
+      RasterElement* mpElement;
+      IdlFunctions::Subcube mSubcube;
+      InterleaveFormatType mInterleave;
+      unsigned int mThreadCount;
+      int mDimensions;
+      IDL_MEMINT mDims[3];
+      int mType;
+      pthread_t mThread;
+      bool mRunning;
+      bool mDone;
+      bool mSuccess;
+   };
+
+   AsyncTransfers();
+   AsyncTransfers(const AsyncTransfers& rhs);
+   AsyncTransfers& operator=(const AsyncTransfers& rhs);
+
+   IDL_LONG start(Transfer* pTransfer);
+   static void* run(void* pArg);
+   static void join(Transfer* pTransfer);
+   void elementDeleted(RasterElement* pElement);
+
+   static pthread_mutex_t sMutex;
+   ElementWatcher mWatcher;
+   IDL_LONG mNextHandle;
+   std::map<IDL_LONG, Transfer*> mTransfers;
+};
+
+///\endcond INTERNAL
+
+#endif
@@ -0,0 +1,96 @@
+/*
+ * The information in this file is
+ * Copyright(c) 2007 Ball Aerospace & Technologies Corporation
+ * and is subject to the terms and conditions of the
+ * GNU Lesser General Public License Version 2.1
+ * The license text is available from
+ * http://www.gnu.org/licenses/lgpl.html
+ */
+
+#include "ElementWatcher.h"
+#include "RasterElement.h"
+#include "Slot.h"
+#include "Subject.h"
+
+ElementWatcher::ElementWatcher(Listener& listener, bool modifications) :
+   mListener(listener),
+   mModifications(modifications)
+{
+   pthread_mutex_init(&mMutex, NULL);
+}
+
+ElementWatcher::~ElementWatcher()
+{
+   pthread_mutex_destroy(&mMutex);
+}
+
+void ElementWatcher::watch(RasterElement* pElement)
+{
+   pthread_mutex_lock(&mMutex);
+   const bool added = mWatched.insert(pElement).second;
+   pthread_mutex_unlock(&mMutex);
+   if (added)
+   {
+      pElement->attach(SIGNAL_NAME(Subject, Deleted), Slot(this, &ElementWatcher::deleted));
+      if (mModifications)
+      {
+         pElement->attach(SIGNAL_NAME(RasterElement, DataModified), Slot(this, &ElementWatcher::modified));
+      }
+   }
+}
+
+void ElementWatcher::clear()
+{
+   std::set<RasterElement*> watched;
+   pthread_mutex_lock(&mMutex);
+   watched.swap(mWatched);
+   pthread_mutex_unlock(&mMutex);
+
+   for (std::set<RasterElement*>::iterator element = watched.begin(); element != watched.end(); ++element)
+   {
+      (*element)->detach(SIGNAL_NAME(Subject, Deleted), Slot(this, &ElementWatcher::deleted));
+      if (mModifications)
+      {
+         (*element)->detach(SIGNAL_NAME(RasterElement, DataModified), Slot(this, &ElementWatcher::modified));
+      }
+   }
+}
+
+RasterElement* ElementWatcher::find(Subject& subject, bool remove)
+{
+   //the element may be partially destroyed so match the subject against the watched elements
+   RasterElement* pElement = NULL;
+   pthread_mutex_lock(&mMutex);
+   for (std::set<RasterElement*>::iterator element = mWatched.begin(); element != mWatched.end(); ++element)
+   {
+      if (static_cast<Subject*>(*element) == &subject)
+      {
+         pElement = *element;
+         if (remove)
+         {
+            mWatched.erase(element);
+         }
+         break;
+      }
+   }
+   pthread_mutex_unlock(&mMutex);
+   return pElement;
+}
+
+void ElementWatcher::deleted(Subject& subject, const std::string& signal, const boost::any& value)
+{
+   RasterElement* pElement = find(subject, true);
+   if (pElement != NULL)
+   {
+      mListener.elementDeleted(pElement);
+   }
+}
+
+void ElementWatcher::modified(Subject& subject, const std::string& signal, const boost::any& value)
+{
+   RasterElement* pElement = find(subject, false);
+   if (pElement != NULL)
+   {
+      mListener.elementModified(pElement);
+   }
+}
@@ -0,0 +1,88 @@
+/*
+ * The information in this file is
+ * Copyright(c) 2007 Ball Aerospace & Technologies Corporation
+ * and is subject to the terms and conditions of the
+ * GNU Lesser General Public License Version 2.1
+ * The license text is available from
+ * http://www.gnu.org/licenses/lgpl.html
+ */
+
+#ifndef ELEMENTWATCHER_H
+#define ELEMENTWATCHER_H
+
+#include <boost/any.hpp>
+#include <pthread.h>
+#include <set>
+#include <string>
+
+class RasterElement;
+class Subject;
+
+/**
+ * These are internal support methods not used in IDL.
+ * \cond INTERNAL
+ */
+
+/**
+ * Attaches to the raster elements a cache or registry refers to and tells it when
+ * one of them is deleted or has its data modified.
+ *
+ * The watched elements are guarded by their own mutex, which is not held while the
+ * listener is called, so the listener may lock its own mutex in the callbacks.
+ */
+class ElementWatcher
+{
+public:
+   class Listener
+   {
+   public:
+      virtual ~Listener() {}
+
+      /**
+       * Called when a watched element is being deleted. The element is no longer
+       * watched and may be partially destroyed, so it should only be used as a key.
+       */
+      virtual void elementDeleted(RasterElement* pElement) = 0;
+
+      /**
+       * Called when the data of a watched element was modified.
+       */
+      virtual void elementModified(RasterElement* pElement) {}
+   };
+
+   /**
+    * @param listener
+    *        The object told about the watched elements.
+    * @param modifications
+    *        If \c true, the listener is also told when the data of an element is modified.
+    */
+   ElementWatcher(Listener& listener, bool modifications);
+   ~ElementWatcher();
+
+   /**
+    * Start watching an element if it is not already watched.
+    */
+   void watch(RasterElement* pElement);
+
+   /**
+    * Stop watching every element.
+    */
+   void clear();
+
+private:
+   ElementWatcher(const ElementWatcher& rhs);
+   ElementWatcher& operator=(const ElementWatcher& rhs);
+
+   RasterElement* find(Subject& subject, bool remove);
+   void deleted(Subject& subject, const std::string& signal, const boost::any& value);
+   void modified(Subject& subject, const std::string& signal, const boost::any& value);
+
+   Listener& mListener;
+   bool mModifications;
+   pthread_mutex_t mMutex;
+   std::set<RasterElement*> mWatched;
+};
+
+///\endcond INTERNAL
+
+#endif
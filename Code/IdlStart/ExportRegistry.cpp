@@ -0,0 +1,125 @@
+/*
+ * The information in this file is
+ * Copyright(c) 2007 Ball Aerospace & Technologies Corporation
+ * and is subject to the terms and conditions of the
+ * GNU Lesser General Public License Version 2.1
+ * The license text is available from
+ * http://www.gnu.org/licenses/lgpl.html
+ */
+
+#include "ExportRegistry.h"
+#include "RasterElement.h"
+#include <stdlib.h>
+#include <string.h>
+
+namespace
+{
+   //zeroed data for an array which could not be copied, large enough for a DCOMPLEX value
+   double sEmptyData[2] = {0.0, 0.0};
+}
+
+ExportRegistry& ExportRegistry::instance()
+{
+   static ExportRegistry sRegistry;
+   return sRegistry;
+}
+
+ExportRegistry::ExportRegistry() :
+   mWatcher(*this, false)
+{}
+
+IDL_VPTR ExportRegistry::importArray(RasterElement* pElement, int dimensions, IDL_MEMINT dims[], int type,
+                                     UCHAR* pData)
+{
+   if (pElement == NULL || pData == NULL || isExported(pData))
+   {
+      return NULL;
+   }
+   IDL_VPTR pArray = IDL_ImportArray(dimensions, dims, type, pData, ExportRegistry::release, NULL);
+   if (pArray == NULL)
+   {
+      return NULL;
+   }
+
+   Export& exported = mExports[pData];
+   exported.mpElement = pElement;
+   exported.mpArray = pArray->value.arr;
+   mWatcher.watch(pElement);
+   return pArray;
+}
+
+bool ExportRegistry::isExported(const UCHAR* pData) const
+{
+   return mExports.find(const_cast<UCHAR*>(pData)) != mExports.end();
+}
+
+uint64_t ExportRegistry::getExportedBytes(RasterElement* pElement) const
+{
+   uint64_t bytes = 0;
+   for (std::map<UCHAR*, Export>::const_iterator exported = mExports.begin(); exported != mExports.end();
+      ++exported)
+   {
+      if (exported->second.mpElement == pElement)
+      {
+         bytes += exported->second.mpArray->arr_len;
+      }
+   }
+   return bytes;
+}
+
+uint64_t ExportRegistry::getExportedBytes() const
+{
+   uint64_t bytes = 0;
+   for (std::map<UCHAR*, Export>::const_iterator exported = mExports.begin(); exported != mExports.end();
+      ++exported)
+   {
+      bytes += exported->second.mpArray->arr_len;
+   }
+   return bytes;
+}
+
+void ExportRegistry::clear()
+{
+   mWatcher.clear();
+   mExports.clear();
+}
+
+void ExportRegistry::release(UCHAR* pData)
+{
+   instance().mExports.erase(pData);
+}
+
+void ExportRegistry::elementDeleted(RasterElement* pElement)
+{
+   //give each array its own copy of the data before the element frees it
+   std::map<UCHAR*, Export>::iterator exported = mExports.begin();
+   while (exported != mExports.end())
+   {
+      if (exported->second.mpElement != pElement)
+      {
+         ++exported;
+         continue;
+      }
+      IDL_ARRAY* pArray = exported->second.mpArray;
+      UCHAR* pCopy = reinterpret_cast<UCHAR*>(malloc(static_cast<size_t>(pArray->arr_len)));
+      if (pCopy != NULL)
+      {
+         memcpy(pCopy, pArray->data, static_cast<size_t>(pArray->arr_len));
+         pArray->data = pCopy;
+         pArray->free_cb = reinterpret_cast<IDL_ARRAY_FREE_CB>(free);
+      }
+      else
+      {
+         //the element's data is about to be freed so the array is shrunk to a single zero value
+         pArray->data = reinterpret_cast<UCHAR*>(sEmptyData);
+         pArray->free_cb = NULL;
+         pArray->n_elts = 1;
+         pArray->arr_len = pArray->elt_len;
+         pArray->n_dim = 1;
+         pArray->dim[0] = 1;
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Not enough memory to keep an array of a deleted raster "
+            "element. The array has been replaced by a single zero value.");
+      }
+      mExports.erase(exported++);
+   }
+}
@@ -0,0 +1,89 @@
+/*
+ * The information in this file is
+ * Copyright(c) 2007 Ball Aerospace & Technologies Corporation
+ * and is subject to the terms and conditions of the
+ * GNU Lesser General Public License Version 2.1
+ * The license text is available from
+ * http://www.gnu.org/licenses/lgpl.html
+ */
+
+#ifndef EXPORTREGISTRY_H
+#define EXPORTREGISTRY_H
+
+#include "AppConfig.h"
+#include "ElementWatcher.h"
+#include <idl_export.h>
+#include <map>
+
+class RasterElement;
+
+/**
+ * These are internal support methods not used in IDL.
+ * \cond INTERNAL
+ */
+
+/**
+ * Keeps track of the IDL arrays which refer directly to the data of a raster element.
+ *
+ * When such an element is deleted each of its arrays is given its own copy of the
+ * data, so the IDL variables stay valid after the element is gone. An array which
+ * can't be copied is replaced by a single zero value so it never refers to freed data.
+ */
+class ExportRegistry : private ElementWatcher::Listener
+{
+public:
+   static ExportRegistry& instance();
+
+   /**
+    * Create an IDL array which refers to data owned by a raster element.
+    *
+    * @param pElement
+    *        The raster element which owns the data.
+    * @param pData
+    *        The first value of the array within the element's data.
+    * @return The new IDL array or \c NULL if \p pData is already exported.
+    */
+   IDL_VPTR importArray(RasterElement* pElement, int dimensions, IDL_MEMINT dims[], int type, UCHAR* pData);
+
+   /**
+    * Determine if an IDL array already refers to the given data. IDL only passes the
+    * data pointer to the free callback, so each pointer can be exported once.
+    */
+   bool isExported(const UCHAR* pData) const;
+
+   /**
+    * Get the number of bytes of an element's data which IDL arrays refer to.
+    */
+   uint64_t getExportedBytes(RasterElement* pElement) const;
+
+   /**
+    * Get the number of bytes of data of all elements which IDL arrays refer to.
+    */
+   uint64_t getExportedBytes() const;
+
+   /**
+    * Forget every array. This is called once IDL has been shut down.
+    */
+   void clear();
+
+private:
+   struct Export
+   {
+      RasterElement* mpElement;
+      IDL_ARRAY* mpArray;
+   };
+
+   ExportRegistry();
+   ExportRegistry(const ExportRegistry& rhs);
+   ExportRegistry& operator=(const ExportRegistry& rhs);
+
+   static void release(UCHAR* pData);
+   void elementDeleted(RasterElement* pElement);
+
+   ElementWatcher mWatcher;
+   std::map<UCHAR*, Export> mExports;
+};
+
+///\endcond INTERNAL
+
+#endif
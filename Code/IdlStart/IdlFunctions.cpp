@@ -7,6 +7,9 @@
  * http://www.gnu.org/licenses/lgpl.html
  */
 
+#include "AoiElement.h"
+#include "BitMask.h"
+#include "ConfigurationSettings.h"
 #include "DataAccessor.h"
 #include "DataAccessorImpl.h"
 #include "DataRequest.h"
@@ -16,10 +19,12 @@
 #include "LayerList.h"
 #include "ModelServices.h"
 #include "ObjectResource.h"
+#include "PlugIn.h"
 #include "RasterDataDescriptor.h"
 #include "RasterElement.h"
 #include "RasterFileDescriptor.h"
 #include "RasterLayer.h"
+#include "RasterPager.h"
 #include "RasterUtilities.h"
 #include "SpatialDataView.h"
 #include "SpatialDataWindow.h"
@@ -31,10 +36,457 @@
 #include "xmlreader.h"
 #include <stdio.h>
 #include <idl_export.h>
+#include <pthread.h>
 #include <QtCore/QString>
 #include <QtCore/QStringList>
+#include <limits>
+#include <map>
+#include <new>
 #include <string>
+#include <utility>
 #include <vector>
+#if defined(WIN_API)
+#if !defined(NOMINMAX)
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+   // the start and length of each mapping handed out by mapSubcube, keyed by the returned pointer
+   std::map<UCHAR*, std::pair<void*, size_t> > sMappings;
+   pthread_mutex_t sMappingMutex = PTHREAD_MUTEX_INITIALIZER;
+
+   // the pager of the generic raster importers, which reads the file as plain samples
+   const char* const RawPagerName = "RasterPager";
+
+   struct ChunkQueue
+   {
+      IdlFunctions::ChunkTask* mpTask;
+      size_t mChunkCount;
+      size_t mNextChunk;
+      bool mSuccess;
+      pthread_mutex_t mMutex;
+   };
+
+   void* processChunkQueue(void* pArg)
+   {
+      ChunkQueue* pQueue = static_cast<ChunkQueue*>(pArg);
+      for (;;)
+      {
+         pthread_mutex_lock(&pQueue->mMutex);
+         const size_t chunk = pQueue->mNextChunk;
+         const bool done = !pQueue->mSuccess || chunk >= pQueue->mChunkCount;
+         if (!done)
+         {
+            ++pQueue->mNextChunk;
+         }
+         pthread_mutex_unlock(&pQueue->mMutex);
+         if (done)
+         {
+            break;
+         }
+
+         bool success = false;
+         try
+         {
+            success = pQueue->mpTask->processChunk(chunk);
+         }
+         catch (...)
+         {
+            success = false;
+         }
+         if (!success)
+         {
+            pthread_mutex_lock(&pQueue->mMutex);
+            pQueue->mSuccess = false;
+            pthread_mutex_unlock(&pQueue->mMutex);
+         }
+      }
+      return NULL;
+   }
+
+   /**
+    * Writes a packed subcube in the element's interleave into a raster element.
+    *
+    * Each chunk is a block of rows with its own writable accessor. BSQ data and
+    * BIL data which does not cover whole rows are also split by band.
+    */
+   class SubcubeWriter : public IdlFunctions::ChunkTask
+   {
+   public:
+      SubcubeWriter(RasterElement* pRaster, const char* pData, const IdlFunctions::Subcube& subcube,
+         unsigned int threadCount) :
+         mpRaster(pRaster),
+         mpDesc(static_cast<const RasterDataDescriptor*>(pRaster->getDataDescriptor())),
+         mpData(pData),
+         mSubcube(subcube)
+      {
+         mInterleave = mpDesc->getInterleaveFormat();
+         mRows = subcube.getRowCount();
+         mColumns = subcube.getColumnCount();
+         mBands = subcube.getBandCount();
+         mBytesPerElement = mpDesc->getBytesPerElement();
+         mPixelBands = mpDesc->getBandCount();
+         const bool wholeRows = subcube.mWidthStart == 0 && mColumns == mpDesc->getColumnCount() &&
+            mBands == mPixelBands;
+         mBandGroups = (mInterleave == BSQ || (mInterleave == BIL && !wholeRows)) ? mBands : 1;
+         IdlFunctions::getInterleaveStrides(mInterleave, mRows, mColumns, mBands, mStrides);
+         mRowBytes = mColumns * (mBands / mBandGroups) * mBytesPerElement;
+         mRowsPerChunk = IdlFunctions::getRowsPerChunk(mRows, mRowBytes, mBandGroups, threadCount);
+         mRowBlocks = (mRows + mRowsPerChunk - 1) / mRowsPerChunk;
+      }
+
+      size_t getChunkCount() const
+      {
+         return mBandGroups * mRowBlocks;
+      }
+
+      bool processChunk(size_t chunk)
+      {
+         const size_t bandGroup = chunk / mRowBlocks;
+         const size_t row = (chunk % mRowBlocks) * mRowsPerChunk;
+         const size_t count = std::min(mRowsPerChunk, mRows - row);
+         const unsigned int firstRow = mSubcube.mHeightStart + static_cast<unsigned int>(row);
+         unsigned int firstBand = mSubcube.mBandStart;
+         unsigned int lastBand = mSubcube.mBandEnd;
+         if (mBandGroups > 1)
+         {
+            firstBand += static_cast<unsigned int>(bandGroup);
+            lastBand = firstBand;
+         }
+
+         FactoryResource<DataRequest> pRequest;
+         pRequest->setInterleaveFormat(mInterleave);
+         pRequest->setRows(mpDesc->getActiveRow(firstRow),
+            mpDesc->getActiveRow(firstRow + static_cast<unsigned int>(count) - 1),
+            mSubcube.getConcurrentRows(static_cast<unsigned int>(count), mRowBytes));
+         pRequest->setColumns(mpDesc->getActiveColumn(mSubcube.mWidthStart),
+            mpDesc->getActiveColumn(mSubcube.mWidthEnd), static_cast<unsigned int>(mColumns));
+         if (mInterleave != BIP)
+         {
+            pRequest->setBands(mpDesc->getActiveBand(firstBand), mpDesc->getActiveBand(lastBand),
+               lastBand - firstBand + 1);
+         }
+         pRequest->setWritable(true);
+         DataAccessor daImage = mpRaster->getDataAccessor(pRequest.release());
+
+         const size_t srcRowBytes = mStrides[0] * mBytesPerElement;
+         const char* pSrc = mpData + (row * mStrides[0] + bandGroup * mStrides[2]) * mBytesPerElement;
+         for (size_t i = 0; i < count; ++i, pSrc += srcRowBytes)
+         {
+            daImage->toPixel(firstRow + static_cast<unsigned int>(i), mSubcube.mWidthStart);
+            if (!daImage.isValid())
+            {
+               return false;
+            }
+            char* pDst = static_cast<char*>(daImage->getColumn());
+            if (mInterleave == BIP && mBands != mPixelBands)
+            {
+               //only some bands of each pixel are replaced
+               const size_t pixelBytes = mPixelBands * mBytesPerElement;
+               const size_t bandBytes = mBands * mBytesPerElement;
+               pDst += mSubcube.mBandStart * mBytesPerElement;
+               for (size_t col = 0; col < mColumns; ++col)
+               {
+                  memcpy(pDst + col * pixelBytes, pSrc + col * bandBytes, bandBytes);
+               }
+            }
+            else
+            {
+               memcpy(pDst, pSrc, mRowBytes);
+            }
+         }
+         return true;
+      }
+
+   private:
+      RasterElement* mpRaster;
+      const RasterDataDescriptor* mpDesc;
+      const char* mpData;
+      IdlFunctions::Subcube mSubcube;
+      InterleaveFormatType mInterleave;
+      size_t mRows;
+      size_t mColumns;
+      size_t mBands;
+      size_t mBytesPerElement;
+      size_t mPixelBands;
+      size_t mBandGroups;
+      size_t mStrides[3];
+      size_t mRowBytes;
+      size_t mRowsPerChunk;
+      size_t mRowBlocks;
+   };
+
+   /**
+    * The type of the IDL array which holds values of the given type.
+    */
+   template<typename T>
+   struct IdlValue
+   {
+      typedef T Type;
+   };
+
+   template<>
+   struct IdlValue<IntegerComplex>
+   {
+      typedef IDL_COMPLEX Type;
+   };
+
+   template<typename T>
+   void findMaskedPixels(T* pUnused, RasterElement* pMask, const IdlFunctions::Subcube& subcube,
+      std::vector<unsigned int>& rows, std::vector<unsigned int>& columns, bool& success)
+   {
+      success = false;
+      const RasterDataDescriptor* pDesc = static_cast<const RasterDataDescriptor*>(pMask->getDataDescriptor());
+      FactoryResource<DataRequest> pRequest;
+      pRequest->setRows(pDesc->getActiveRow(subcube.mHeightStart), pDesc->getActiveRow(subcube.mHeightEnd), 1);
+      pRequest->setColumns(pDesc->getActiveColumn(subcube.mWidthStart), pDesc->getActiveColumn(subcube.mWidthEnd),
+         subcube.getColumnCount());
+      if (pDesc->getInterleaveFormat() != BIP)
+      {
+         pRequest->setBands(pDesc->getActiveBand(0), pDesc->getActiveBand(0), 1);
+      }
+      DataAccessor daMask = pMask->getDataAccessor(pRequest.release());
+
+      //only the first band of the mask is used
+      const size_t stride = (pDesc->getInterleaveFormat() == BIP) ? pDesc->getBandCount() : 1;
+      for (unsigned int row = subcube.mHeightStart; row <= subcube.mHeightEnd; ++row)
+      {
+         daMask->toPixel(row, subcube.mWidthStart);
+         if (!daMask.isValid())
+         {
+            return;
+         }
+         const T* pValue = static_cast<const T*>(daMask->getColumn());
+         for (unsigned int column = subcube.mWidthStart; column <= subcube.mWidthEnd; ++column, pValue += stride)
+         {
+            if (*pValue != 0)
+            {
+               rows.push_back(row);
+               columns.push_back(column);
+            }
+         }
+      }
+      success = true;
+   }
+
+   template<typename T>
+   void copyMaskedPixelsTo(T* pScratch, void* pData, RasterElement* pElement, const IdlFunctions::Subcube& subcube,
+      const std::vector<unsigned int>& rows, const std::vector<unsigned int>& columns, size_t rowsPerBlock,
+      unsigned int threadCount, IdlFunctions::BadValueFill* pBadValues, bool& success)
+   {
+      typedef typename IdlValue<T>::Type D;
+      D* pDst = static_cast<D*>(pData);
+      const RasterDataDescriptor* pDesc = static_cast<const RasterDataDescriptor*>(pElement->getDataDescriptor());
+      const size_t bands = subcube.getBandCount();
+      success = true;
+      size_t pixel = 0;
+      while (success && pixel < rows.size())
+      {
+         //each block starts at the next row with a selected pixel so empty blocks are never read
+         IdlFunctions::Subcube block = subcube;
+         block.mHeightStart = rows[pixel];
+         block.mHeightEnd = static_cast<unsigned int>(std::min<size_t>(rows[pixel] + rowsPerBlock - 1,
+            subcube.mHeightEnd));
+
+         //only the columns holding selected pixels of the block's rows are read
+         block.mWidthStart = columns[pixel];
+         block.mWidthEnd = columns[pixel];
+         for (size_t next = pixel + 1; next < rows.size() && rows[next] <= block.mHeightEnd; ++next)
+         {
+            block.mWidthStart = std::min(block.mWidthStart, columns[next]);
+            block.mWidthEnd = std::max(block.mWidthEnd, columns[next]);
+         }
+         success = IdlFunctions::readNativeSubcube(pScratch, pElement, block, threadCount);
+
+         size_t strides[3];
+         IdlFunctions::getInterleaveStrides(pDesc->getInterleaveFormat(), block.getRowCount(),
+            block.getColumnCount(), bands, strides);
+         for (; success && pixel < rows.size() && rows[pixel] <= block.mHeightEnd; ++pixel, pDst += bands)
+         {
+            const T* pSrc = pScratch + (rows[pixel] - block.mHeightStart) * strides[0] +
+               (columns[pixel] - block.mWidthStart) * strides[1];
+            if (pBadValues == NULL)
+            {
+               IdlFunctions::copyStridedSpan(pSrc, strides[2], pDst, bands);
+            }
+            else
+            {
+               IdlFunctions::BadValueConverter<T, D> convert(*pBadValues);
+               IdlFunctions::convertSpan(pSrc, strides[2], pDst, bands, convert);
+            }
+         }
+      }
+   }
+   /**
+    * Orders pixels by row and then by column.
+    */
+   struct PixelOrder
+   {
+      PixelOrder(const std::vector<unsigned int>& rows, const std::vector<unsigned int>& columns) :
+         mRows(rows),
+         mColumns(columns)
+      {}
+
+      bool operator()(size_t left, size_t right) const
+      {
+         if (mRows[left] != mRows[right])
+         {
+            return mRows[left] < mRows[right];
+         }
+         return mColumns[left] < mColumns[right];
+      }
+
+      const std::vector<unsigned int>& mRows;
+      const std::vector<unsigned int>& mColumns;
+   };
+
+   /**
+    * Copies the bands of pixels a block at a time. Each chunk reads the rows from the
+    * first to the last pixel of a block, and the columns from the first to the last
+    * column of its pixels, and copies each of its pixels to the pixel's place in the
+    * destination.
+    */
+   template<typename T>
+   class PixelGatherer : public IdlFunctions::ChunkTask
+   {
+   public:
+      typedef typename IdlValue<T>::Type D;
+
+      PixelGatherer(D* pDst, RasterElement* pElement, const IdlFunctions::Subcube& bounds,
+         const std::vector<unsigned int>& rows, const std::vector<unsigned int>& columns,
+         const std::vector<size_t>& order, const std::vector<size_t>& blockStarts) :
+         mpDst(pDst),
+         mpElement(pElement),
+         mBounds(bounds),
+         mRows(rows),
+         mColumns(columns),
+         mOrder(order),
+         mBlockStarts(blockStarts)
+      {}
+
+      bool processChunk(size_t chunk)
+      {
+         const size_t first = mBlockStarts[chunk];
+         const size_t last = mBlockStarts[chunk + 1];
+         IdlFunctions::Subcube block = mBounds;
+         block.mHeightStart = mRows[mOrder[first]];
+         block.mHeightEnd = mRows[mOrder[last - 1]];
+         block.mWidthStart = mColumns[mOrder[first]];
+         block.mWidthEnd = mColumns[mOrder[first]];
+         for (size_t index = first + 1; index < last; ++index)
+         {
+            block.mWidthStart = std::min(block.mWidthStart, mColumns[mOrder[index]]);
+            block.mWidthEnd = std::max(block.mWidthEnd, mColumns[mOrder[index]]);
+         }
+         const size_t bands = block.getBandCount();
+         const RasterDataDescriptor* pDesc =
+            static_cast<const RasterDataDescriptor*>(mpElement->getDataDescriptor());
+         try
+         {
+            std::vector<T> scratch(static_cast<size_t>(block.getRowCount()) * block.getColumnCount() * bands);
+            if (!IdlFunctions::readNativeSubcube(&scratch[0], mpElement, block, 1))
+            {
+               return false;
+            }
+            size_t strides[3];
+            IdlFunctions::getInterleaveStrides(pDesc->getInterleaveFormat(), block.getRowCount(),
+               block.getColumnCount(), bands, strides);
+            for (size_t index = first; index < last; ++index)
+            {
+               const size_t pixel = mOrder[index];
+               const T* pSrc = &scratch[0] + (mRows[pixel] - block.mHeightStart) * strides[0] +
+                  (mColumns[pixel] - block.mWidthStart) * strides[1];
+               IdlFunctions::copyStridedSpan(pSrc, strides[2], mpDst + pixel * bands, bands);
+            }
+         }
+         catch (const std::bad_alloc&)
+         {
+            return false;
+         }
+         return true;
+      }
+
+   private:
+      PixelGatherer(const PixelGatherer& rhs);
+      PixelGatherer& operator=(const PixelGatherer& rhs);
+
+      D* mpDst;
+      RasterElement* mpElement;
+      IdlFunctions::Subcube mBounds;
+      const std::vector<unsigned int>& mRows;
+      const std::vector<unsigned int>& mColumns;
+      const std::vector<size_t>& mOrder;
+      const std::vector<size_t>& mBlockStarts;
+   };
+
+   template<typename T>
+   void gatherPixels(T* pUnused, void* pData, RasterElement* pElement, const IdlFunctions::Subcube& bounds,
+      const std::vector<unsigned int>& rows, const std::vector<unsigned int>& columns,
+      const std::vector<size_t>& order, const std::vector<size_t>& blockStarts, unsigned int threadCount,
+      bool& success)
+   {
+      PixelGatherer<T> gatherer(static_cast<typename IdlValue<T>::Type*>(pData), pElement, bounds, rows, columns,
+         order, blockStarts);
+      success = IdlFunctions::runChunks(gatherer, blockStarts.size() - 1, threadCount);
+   }
+
+   /**
+    * Get the number of rows of a subcube to read into a scratch buffer at a time
+    * so the buffer holds about a chunk of rows for each thread.
+    */
+   size_t getRowsPerBlock(const RasterDataDescriptor* pDesc, const IdlFunctions::Subcube& subcube,
+      unsigned int threadCount, size_t& rowBytes)
+   {
+      rowBytes = static_cast<size_t>(subcube.getColumnCount()) * subcube.getBandCount() *
+         pDesc->getBytesPerElement();
+      return std::max<size_t>(1, std::min<size_t>(subcube.getRowCount(),
+         IdlFunctions::MaxChunkBytes * threadCount / std::max<size_t>(1, rowBytes)));
+   }
+
+   /**
+    * Copy a subcube into a buffer, or into a buffer per band when \p ppBands is not
+    * \c NULL, converting it to an IDL type one block of rows at a time.
+    */
+   bool copyConverted(void* pData, void* const* ppBands, int idlType, RasterElement* pElement,
+      const IdlFunctions::Subcube& subcube, InterleaveFormatType interleave, IdlFunctions::BadValueFill* pBadValues)
+   {
+      const RasterDataDescriptor* pDesc = (pElement == NULL) ? NULL :
+         static_cast<const RasterDataDescriptor*>(pElement->getDataDescriptor());
+      if (pDesc == NULL || IdlFunctions::getIdlTypeSize(idlType) == 0)
+      {
+         return false;
+      }
+
+      //the scratch buffer holds a block of rows in the element's data type
+      const unsigned int threadCount = IdlFunctions::getThreadCount();
+      size_t rowBytes = 0;
+      const size_t rowsPerBlock = getRowsPerBlock(pDesc, subcube, threadCount, rowBytes);
+      bool success = false;
+      try
+      {
+         std::vector<char> scratch(rowsPerBlock * rowBytes);
+         switchOnComplexEncoding(pDesc->getDataType(), IdlFunctions::convertSubcube, &scratch[0], pData, ppBands,
+            idlType, pElement, subcube, interleave, rowsPerBlock, threadCount, pBadValues, success);
+      }
+      catch (const std::bad_alloc&)
+      {
+         success = false;
+      }
+      if (!success)
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "error in copying array values to IDL.");
+      }
+      return success;
+   }
+}
 
 RasterElement* IdlFunctions::getDataset(const std::string& name)
 {
@@ -170,7 +622,8 @@ RasterElement* IdlFunctions::createRasterElement(char* pData,
                                                  const std::string& unit, 
                                                  unsigned int rows,
                                                  unsigned int cols,
-                                                 unsigned int bands)
+                                                 unsigned int bands,
+                                                 unsigned int concurrentRows)
 {
    RasterElement* pInputRaster = getDataset(datasetName);
    DataElement* pParent = NULL;
@@ -196,91 +649,15 @@ RasterElement* IdlFunctions::createRasterElement(char* pData,
       IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Invalid array data provided.");
       return NULL;
    }
-   unsigned int bytesPerElement = pDesc->getBytesPerElement();
-   if (iType == BSQ)
+   Subcube subcube;
+   subcube.mHeightEnd = rows - 1;
+   subcube.mWidthEnd = cols - 1;
+   subcube.mBandEnd = bands - 1;
+   subcube.mConcurrentRows = concurrentRows;
+   if (!writeSubcube(pRaster.get(), pData, subcube, getThreadCount()))
    {
-      for (unsigned int band = 0; band < bands; ++band)
-      {
-         try
-         {
-            FactoryResource<DataRequest> pRequest;
-            pRequest->setInterleaveFormat(BSQ);
-            pRequest->setRows(pDesc->getActiveRow(0), pDesc->getActiveRow(rows-1), 1);
-            pRequest->setColumns(pDesc->getActiveColumn(0), pDesc->getActiveColumn(cols-1), cols);
-            pRequest->setBands(pDesc->getActiveBand(band), pDesc->getActiveBand(band), 1);
-            pRequest->setWritable(true);
-            DataAccessor daImage = pRaster->getDataAccessor(pRequest.release());
-
-            //populate the resultsmatrix with the data
-            for (unsigned int row = 0; row < rows; ++row)
-            {
-               if (!daImage.isValid())
-               {
-                  throw std::exception();
-               }
-               memcpy(daImage->getRow(), pData + (cols * rows * band * bytesPerElement) + (cols * row * bytesPerElement), cols * bytesPerElement);
-               daImage->nextRow();
-            }
-         }
-         catch(...)
-         {
-            IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "error in copying array values to Opticks.");
-            return false;
-         }
-      }
-   }
-   else if (iType == BIP)
-   {
-      try
-      {
-         FactoryResource<DataRequest> pRequest;
-         pRequest->setInterleaveFormat(BIP);
-         pRequest->setRows(pDesc->getActiveRow(0), pDesc->getActiveRow(rows-1), 1);
-         pRequest->setColumns(pDesc->getActiveColumn(0), pDesc->getActiveColumn(cols-1), cols);
-         pRequest->setWritable(true);
-         DataAccessor daImage = pRaster->getDataAccessor(pRequest.release());
-         for (unsigned int row = 0; row < rows; ++row)
-         {
-            if (!daImage.isValid())
-            {
-               throw std::exception();
-            }
-            memcpy(daImage->getRow(), pData + (row * cols * bands * bytesPerElement), cols * bands * bytesPerElement);
-            daImage->nextRow();
-         }
-      }
-      catch (...)
-      {
-         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "error in copying array values to Opticks.");
-         return false;
-      }
-   }
-   else if (iType == BIL)
-   {
-      try
-      {
-         FactoryResource<DataRequest> pRequest;
-         pRequest->setInterleaveFormat(BIL);
-         pRequest->setRows(pDesc->getActiveRow(0), pDesc->getActiveRow(rows-1), 1);
-         pRequest->setColumns(pDesc->getActiveColumn(0), pDesc->getActiveColumn(cols-1), cols);
-         pRequest->setBands(pDesc->getActiveBand(0), pDesc->getActiveBand(bands-1), bands);
-         pRequest->setWritable(true);
-         DataAccessor daImage = pRaster->getDataAccessor(pRequest.release());
-         for (unsigned int row = 0; row < rows; ++row)
-         {
-            if (!daImage.isValid())
-            {
-               throw std::exception();
-            }
-            memcpy(daImage->getRow(), pData + (row * cols * bands * bytesPerElement), cols * bands * bytesPerElement);
-            daImage->nextRow();
-         }
-      }
-      catch (...)
-      {
-         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "error in copying array values to Opticks.");
-         return false;
-      }
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "error in copying array values to Opticks.");
+      return NULL;
    }
    //set the units
    Units* pScale = pDesc->getUnits();
@@ -305,14 +682,9 @@ RasterElement* IdlFunctions::createRasterElement(char* pData,
 bool IdlFunctions::changeRasterElement(RasterElement* pRasterElement, char* pData,
                                        EncodingType datatype, InterleaveFormatType iType, unsigned int startRow, 
                                        unsigned int rows, unsigned int startCol, unsigned int cols, 
-                                       unsigned int startBand, unsigned int bands, EncodingType oldType)
+                                       unsigned int startBand, unsigned int bands, EncodingType oldType,
+                                       unsigned int concurrentRows)
 {
-   int index = 0;
-   unsigned int i = 0;
-   unsigned int stopRow = startRow + rows - 1;
-   unsigned int stopCol = startCol + cols - 1;
-   unsigned int stopBand = startBand + bands - 1;
-
    if (pRasterElement != NULL && pData != NULL)
    {
       RasterDataDescriptor* pDesc = static_cast<RasterDataDescriptor*>(pRasterElement->getDataDescriptor());
@@ -320,117 +692,770 @@ bool IdlFunctions::changeRasterElement(RasterElement* pRasterElement, char* pDat
       {
          return false;
       }
+      if (static_cast<uint64_t>(startRow) + rows > pDesc->getRowCount() ||
+         static_cast<uint64_t>(startCol) + cols > pDesc->getColumnCount() ||
+         static_cast<uint64_t>(startBand) + bands > pDesc->getBandCount())
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "The array does not fit in the raster element.");
+         return false;
+      }
+      if (!isSameLayout(iType, pDesc->getInterleaveFormat(), rows, cols, bands))
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "The interleave of the array does not match the raster element.");
+         return false;
+      }
 
-      try
+      Subcube subcube;
+      subcube.mHeightStart = startRow;
+      subcube.mHeightEnd = startRow + rows - 1;
+      subcube.mWidthStart = startCol;
+      subcube.mWidthEnd = startCol + cols - 1;
+      subcube.mBandStart = startBand;
+      subcube.mBandEnd = startBand + bands - 1;
+      subcube.mConcurrentRows = concurrentRows;
+      if (!writeSubcube(pRasterElement, pData, subcube, getThreadCount()))
+      {
+         std::string msg = "error in copying array values to Opticks.";
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, msg.c_str());
+         return false;
+      }
+      pRasterElement->updateData();
+   }
+
+   return true;
+}
+
+bool IdlFunctions::writeSubcube(RasterElement* pElement, const char* pData, const Subcube& subcube,
+                                unsigned int threadCount)
+{
+   if (pElement == NULL || pData == NULL || pElement->getDataDescriptor() == NULL)
+   {
+      return false;
+   }
+   SubcubeWriter writer(pElement, pData, subcube, threadCount);
+   return runChunks(writer, writer.getChunkCount(), threadCount);
+}
+
+IdlFunctions::SubcubeReader::SubcubeReader() :
+   mRunning(false),
+   mSuccess(false),
+   mpData(NULL),
+   mpElement(NULL),
+   mThreadCount(1)
+{
+}
+
+IdlFunctions::SubcubeReader::~SubcubeReader()
+{
+   wait();
+}
+
+void IdlFunctions::SubcubeReader::start(void* pData, RasterElement* pElement, const Subcube& subcube,
+                                        unsigned int threadCount)
+{
+   wait();
+   mpData = pData;
+   mpElement = pElement;
+   mSubcube = subcube;
+   mThreadCount = threadCount;
+   mSuccess = false;
+   mRunning = (pthread_create(&mThread, NULL, SubcubeReader::run, this) == 0);
+   if (!mRunning)
+   {
+      read();
+   }
+}
+
+bool IdlFunctions::SubcubeReader::wait()
+{
+   if (mRunning)
+   {
+      pthread_join(mThread, NULL);
+      mRunning = false;
+   }
+   return mSuccess;
+}
+
+void* IdlFunctions::SubcubeReader::run(void* pArg)
+{
+   static_cast<SubcubeReader*>(pArg)->read();
+   return NULL;
+}
+
+void IdlFunctions::SubcubeReader::read()
+{
+   mSuccess = readNativeSubcube(mpData, mpElement, mSubcube, mThreadCount);
+}
+
+bool IdlFunctions::readNativeSubcube(void* pData, RasterElement* pElement, const Subcube& subcube,
+                                     unsigned int threadCount)
+{
+   const RasterDataDescriptor* pDesc = (pElement == NULL) ? NULL :
+      static_cast<const RasterDataDescriptor*>(pElement->getDataDescriptor());
+   if (pDesc == NULL || pData == NULL)
+   {
+      return false;
+   }
+   bool success = false;
+   switchOnComplexEncoding(pDesc->getDataType(), copySubcubeChunks, pData, pElement, subcube,
+      pDesc->getInterleaveFormat(), threadCount, success);
+   return success;
+}
+
+size_t IdlFunctions::getIdlTypeSize(int idlType)
+{
+   switch (idlType)
+   {
+      case IDL_TYP_BYTE:
+         return sizeof(UCHAR);
+      case IDL_TYP_INT:
+         return sizeof(IDL_INT);
+      case IDL_TYP_UINT:
+         return sizeof(IDL_UINT);
+      case IDL_TYP_LONG:
+         return sizeof(IDL_LONG);
+      case IDL_TYP_ULONG:
+         return sizeof(IDL_ULONG);
+      case IDL_TYP_LONG64:
+         return sizeof(IDL_LONG64);
+      case IDL_TYP_ULONG64:
+         return sizeof(IDL_ULONG64);
+      case IDL_TYP_FLOAT:
+         return sizeof(float);
+      case IDL_TYP_DOUBLE:
+         return sizeof(double);
+      case IDL_TYP_COMPLEX:
+         return sizeof(IDL_COMPLEX);
+      case IDL_TYP_DCOMPLEX:
+         return sizeof(IDL_DCOMPLEX);
+      default:
+         return 0;
+   }
+}
+
+bool IdlFunctions::copyConvertedSubcube(void* pData, int idlType, RasterElement* pElement, const Subcube& subcube,
+                                        InterleaveFormatType interleave, BadValueFill* pBadValues)
+{
+   if (pData == NULL)
+   {
+      return false;
+   }
+   if (!interleave.isValid())
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Invalid interleave.");
+      return false;
+   }
+   return copyConverted(pData, NULL, idlType, pElement, subcube, interleave, pBadValues);
+}
+
+bool IdlFunctions::copySplitBands(const std::vector<void*>& bands, int idlType, RasterElement* pElement,
+                                  const Subcube& subcube, BadValueFill* pBadValues)
+{
+   if (bands.size() != subcube.getBandCount())
+   {
+      return false;
+   }
+   return copyConverted(NULL, &bands[0], idlType, pElement, subcube, BSQ, pBadValues);
+}
+
+bool IdlFunctions::copyDetectedSubcube(float* pData, DetectionType detection, RasterElement* pElement,
+                                       const Subcube& subcube, InterleaveFormatType interleave)
+{
+   const RasterDataDescriptor* pDesc = (pElement == NULL) ? NULL :
+      static_cast<const RasterDataDescriptor*>(pElement->getDataDescriptor());
+   if (pData == NULL || pDesc == NULL)
+   {
+      return false;
+   }
+   if (!interleave.isValid())
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Invalid interleave.");
+      return false;
+   }
+
+   const unsigned int threadCount = getThreadCount();
+   size_t rowBytes = 0;
+   const size_t rowsPerBlock = getRowsPerBlock(pDesc, subcube, threadCount, rowBytes);
+   bool success = false;
+   try
+   {
+      std::vector<char> scratch(rowsPerBlock * rowBytes);
+      switchOnComplexEncoding(pDesc->getDataType(), detectSubcube, &scratch[0], pData, detection, pElement,
+         subcube, interleave, rowsPerBlock, threadCount, success);
+   }
+   catch (const std::bad_alloc&)
+   {
+      success = false;
+   }
+   if (!success)
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "error in copying array values to IDL.");
+   }
+   return success;
+}
+
+bool IdlFunctions::copyCalibratedSubcube(void* pData, int idlType, RasterElement* pElement, const Subcube& subcube,
+                                         InterleaveFormatType interleave, const std::vector<double>& gains,
+                                         const std::vector<double>& offsets, BadValueFill* pBadValues)
+{
+   const RasterDataDescriptor* pDesc = (pElement == NULL) ? NULL :
+      static_cast<const RasterDataDescriptor*>(pElement->getDataDescriptor());
+   if (pData == NULL || pDesc == NULL || (idlType != IDL_TYP_FLOAT && idlType != IDL_TYP_DOUBLE) ||
+      gains.size() != subcube.getBandCount() || offsets.size() != subcube.getBandCount())
+   {
+      return false;
+   }
+   if (!interleave.isValid())
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Invalid interleave.");
+      return false;
+   }
+
+   const unsigned int threadCount = getThreadCount();
+   size_t rowBytes = 0;
+   const size_t rowsPerBlock = getRowsPerBlock(pDesc, subcube, threadCount, rowBytes);
+   BadValueFill noBadValues;
+   bool success = false;
+   try
+   {
+      std::vector<char> scratch(rowsPerBlock * rowBytes);
+      switchOnComplexEncoding(pDesc->getDataType(), calibrateSubcube, &scratch[0], pData, idlType, pElement,
+         subcube, interleave, rowsPerBlock, threadCount, gains, offsets,
+         pBadValues == NULL ? noBadValues : *pBadValues, success);
+   }
+   catch (const std::bad_alloc&)
+   {
+      success = false;
+   }
+   if (!success)
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "error in copying array values to IDL.");
+   }
+   return success;
+}
+
+bool IdlFunctions::getMaskedPixels(DataElement* pMask, const Subcube& subcube, std::vector<unsigned int>& rows,
+                                   std::vector<unsigned int>& columns)
+{
+   rows.clear();
+   columns.clear();
+   AoiElement* pAoi = dynamic_cast<AoiElement*>(pMask);
+   if (pAoi != NULL)
+   {
+      const BitMask* pPoints = pAoi->getSelectedPoints();
+      if (pPoints == NULL)
+      {
+         return false;
+      }
+      int firstRow = subcube.mHeightStart;
+      int lastRow = subcube.mHeightEnd;
+      int firstColumn = subcube.mWidthStart;
+      int lastColumn = subcube.mWidthEnd;
+      if (!pPoints->isOutsideSelected())
+      {
+         //nothing outside of the bounding box is selected so only it has to be searched
+         int x1 = 0;
+         int y1 = 0;
+         int x2 = 0;
+         int y2 = 0;
+         pPoints->getBoundingBox(x1, y1, x2, y2);
+         firstRow = std::max(firstRow, std::min(y1, y2));
+         lastRow = std::min(lastRow, std::max(y1, y2));
+         firstColumn = std::max(firstColumn, std::min(x1, x2));
+         lastColumn = std::min(lastColumn, std::max(x1, x2));
+      }
+      for (int row = firstRow; row <= lastRow; ++row)
       {
-         unsigned int bytesPerElement = pDesc->getBytesPerElement();
-         if (iType == BSQ)
+         for (int column = firstColumn; column <= lastColumn; ++column)
          {
-            //get the data from the disk, and store it into a new in memory block
-            for (unsigned int band = 0; band < bands; ++band)
+            if (pPoints->getPixel(column, row))
             {
-               FactoryResource<DataRequest> pRequest;
-               pRequest->setInterleaveFormat(BSQ);
-               pRequest->setRows(pDesc->getActiveRow(startRow), pDesc->getActiveRow(stopRow), 1);
-               pRequest->setColumns(pDesc->getActiveColumn(startCol), pDesc->getActiveColumn(stopCol), cols);
-               pRequest->setBands(pDesc->getActiveBand(startBand + band), pDesc->getActiveBand(startBand + band), 1);
-               pRequest->setWritable(true);
-               DataAccessor daImage = pRasterElement->getDataAccessor(pRequest.release());
-               if (!daImage.isValid())
-               {
-                  throw std::exception();
-               }
-
-               for (unsigned int row = 0; row < rows; ++row)
-               {
-                  for (unsigned int col = 0; col < cols; ++col)
-                  {
-                     daImage->toPixel(startRow + row, startCol + col);
-                     if (!daImage.isValid())
-                     {
-                        throw std::exception();
-                     }
-                     memcpy(daImage->getColumn(),
-                        pData + (cols * rows * band * bytesPerElement) + (cols * row * bytesPerElement) + (col * bytesPerElement),
-                        bytesPerElement);
-                  }
-               }
+               rows.push_back(static_cast<unsigned int>(row));
+               columns.push_back(static_cast<unsigned int>(column));
             }
          }
-         else if (iType == BIP)
+      }
+      return true;
+   }
+
+   RasterElement* pRaster = dynamic_cast<RasterElement*>(pMask);
+   const RasterDataDescriptor* pDesc = (pRaster == NULL) ? NULL :
+      static_cast<const RasterDataDescriptor*>(pRaster->getDataDescriptor());
+   if (pDesc == NULL || subcube.mHeightEnd >= pDesc->getRowCount() || subcube.mWidthEnd >= pDesc->getColumnCount())
+   {
+      return false;
+   }
+   bool success = false;
+   switchOnEncoding(pDesc->getDataType(), findMaskedPixels, NULL, pRaster, subcube, rows, columns, success);
+   return success;
+}
+
+bool IdlFunctions::copyMaskedPixels(void* pData, RasterElement* pElement, const Subcube& subcube,
+                                    const std::vector<unsigned int>& rows, const std::vector<unsigned int>& columns,
+                                    BadValueFill* pBadValues)
+{
+   const RasterDataDescriptor* pDesc = (pElement == NULL) ? NULL :
+      static_cast<const RasterDataDescriptor*>(pElement->getDataDescriptor());
+   if (pDesc == NULL || pData == NULL || rows.empty() || rows.size() != columns.size())
+   {
+      return false;
+   }
+
+   //the scratch buffer is sized for the columns of every selected pixel, each block reads fewer
+   Subcube bounds = subcube;
+   bounds.mWidthStart = *std::min_element(columns.begin(), columns.end());
+   bounds.mWidthEnd = *std::max_element(columns.begin(), columns.end());
+
+   const unsigned int threadCount = getThreadCount();
+   const size_t rowBytes = static_cast<size_t>(bounds.getColumnCount()) * bounds.getBandCount() *
+      pDesc->getBytesPerElement();
+   const size_t rowsPerBlock = std::max<size_t>(1, std::min<size_t>(bounds.getRowCount(),
+      MaxChunkBytes * threadCount / std::max<size_t>(1, rowBytes)));
+   bool success = false;
+   try
+   {
+      std::vector<char> scratch(rowsPerBlock * rowBytes);
+      switchOnComplexEncoding(pDesc->getDataType(), copyMaskedPixelsTo, &scratch[0], pData, pElement, bounds,
+         rows, columns, rowsPerBlock, threadCount, pBadValues, success);
+   }
+   catch (const std::bad_alloc&)
+   {
+      success = false;
+   }
+   if (!success)
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "error in copying array values to IDL.");
+   }
+   return success;
+}
+
+bool IdlFunctions::copyPixels(void* pData, RasterElement* pElement, const Subcube& subcube,
+                              const std::vector<unsigned int>& rows, const std::vector<unsigned int>& columns)
+{
+   const RasterDataDescriptor* pDesc = (pElement == NULL) ? NULL :
+      static_cast<const RasterDataDescriptor*>(pElement->getDataDescriptor());
+   if (pDesc == NULL || pData == NULL || rows.empty() || rows.size() != columns.size())
+   {
+      return false;
+   }
+
+   bool success = false;
+   try
+   {
+      //pixels are visited in row order so each block of rows is read once
+      std::vector<size_t> order(rows.size());
+      for (size_t pixel = 0; pixel < order.size(); ++pixel)
+      {
+         order[pixel] = pixel;
+      }
+      std::sort(order.begin(), order.end(), PixelOrder(rows, columns));
+
+      //a block grows until the rows and columns spanned by its pixels would be more than a chunk
+      const size_t pixelBytes = static_cast<size_t>(subcube.getBandCount()) * pDesc->getBytesPerElement();
+      std::vector<size_t> blockStarts(1, 0);
+      unsigned int columnStart = columns[order[0]];
+      unsigned int columnEnd = columnStart;
+      for (size_t index = 1; index < order.size(); ++index)
+      {
+         const size_t pixel = order[index];
+         const unsigned int start = std::min(columnStart, columns[pixel]);
+         const unsigned int end = std::max(columnEnd, columns[pixel]);
+         const uint64_t blockBytes = static_cast<uint64_t>(rows[pixel] - rows[order[blockStarts.back()]] + 1) *
+            (end - start + 1) * pixelBytes;
+         if (blockBytes > MaxChunkBytes)
          {
-            FactoryResource<DataRequest> pRequest;
-            pRequest->setInterleaveFormat(BIP);
-            pRequest->setRows(pDesc->getActiveRow(startRow), pDesc->getActiveRow(stopRow), 1);
-            pRequest->setColumns(pDesc->getActiveColumn(startCol), pDesc->getActiveColumn(stopCol), cols);
-            pRequest->setWritable(true);
-            DataAccessor daImage = pRasterElement->getDataAccessor(pRequest.release());
-            if (!daImage.isValid())
-            {
-               throw std::exception();
-            }
-            for (unsigned int row = 0; row < rows; ++row)
-            {
-               for (unsigned int col = 0; col < cols; ++col)
-               {
-                  daImage->toPixel(startRow + row, startCol + col);
-                  if (!daImage.isValid())
-                  {
-                     throw std::exception();
-                  }
-                  for (unsigned int band = 0; band < bands; ++band)
-                  {
-                     memcpy(static_cast<unsigned char*>(daImage->getColumn()) + ((band + startBand) * bytesPerElement),
-                        pData + (row * cols * bands * bytesPerElement) + (col * bands * bytesPerElement) + (band * bytesPerElement),
-                        bytesPerElement);
-                  }
-               }
-            }
+            blockStarts.push_back(index);
+            columnStart = columns[pixel];
+            columnEnd = columnStart;
          }
-         else if (iType == BIL)
+         else
          {
-            for (unsigned int row = 0; row < rows; ++row)
-            {
-               for (unsigned int band = 0; band < bands; ++band)
-               {
-                  FactoryResource<DataRequest> pRequest;
-                  pRequest->setInterleaveFormat(BIL);
-                  pRequest->setRows(pDesc->getActiveRow(startRow + row), pDesc->getActiveRow(startRow + row), 1);
-                  pRequest->setColumns(pDesc->getActiveColumn(startCol), pDesc->getActiveColumn(stopCol), cols);
-                  pRequest->setBands(pDesc->getActiveBand(startBand + band), pDesc->getActiveBand(startBand + band), 1);
-                  pRequest->setWritable(true);
-                  DataAccessor daImage = pRasterElement->getDataAccessor(pRequest.release());
-                  if (!daImage.isValid())
-                  {
-                     throw std::exception();
-                  }
-                  for (unsigned int col = 0; col < cols; ++col)
-                  {
-                     daImage->toPixel(startRow + row, startCol + col);
-                     if (!daImage.isValid())
-                     {
-                        throw std::exception();
-                     }
-                     memcpy(daImage->getColumn(),
-                        pData + (row * cols * bands * bytesPerElement) + (band * cols * bytesPerElement) + (col * bytesPerElement),
-                        bytesPerElement);
-                  }
-               }
-            }
+            columnStart = start;
+            columnEnd = end;
          }
       }
-      catch (...)
+      blockStarts.push_back(order.size());
+
+      switchOnComplexEncoding(pDesc->getDataType(), gatherPixels, NULL, pData, pElement, subcube, rows, columns,
+         order, blockStarts, getThreadCount(), success);
+   }
+   catch (const std::bad_alloc&)
+   {
+      success = false;
+   }
+   if (!success)
+   {
+      IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "error in copying array values to IDL.");
+   }
+   return success;
+}
+
+bool IdlFunctions::getContiguousOffset(const RasterDataDescriptor* pDesc, const Subcube& subcube, uint64_t& offset)
+{
+   if (pDesc == NULL)
+   {
+      return false;
+   }
+   return getContiguousOffset(pDesc->getInterleaveFormat(), pDesc->getRowCount(), pDesc->getColumnCount(),
+      pDesc->getBandCount(), subcube, offset);
+}
+
+bool IdlFunctions::getContiguousOffset(InterleaveFormatType interleave, unsigned int rows, unsigned int columns,
+                                       unsigned int bands, const Subcube& subcube, uint64_t& offset)
+{
+   //order the dimensions from the slowest to the fastest varying in memory
+   unsigned int starts[3];
+   unsigned int counts[3];
+   unsigned int totals[3];
+   unsigned int rowIndex = 0;
+   unsigned int columnIndex = 0;
+   unsigned int bandIndex = 0;
+   switch (interleave)
+   {
+   case BSQ:
+      bandIndex = 0;
+      rowIndex = 1;
+      columnIndex = 2;
+      break;
+   case BIL:
+      rowIndex = 0;
+      bandIndex = 1;
+      columnIndex = 2;
+      break;
+   case BIP:
+      rowIndex = 0;
+      columnIndex = 1;
+      bandIndex = 2;
+      break;
+   default:
+      return false;
+   }
+   starts[rowIndex] = subcube.mHeightStart;
+   counts[rowIndex] = subcube.getRowCount();
+   totals[rowIndex] = rows;
+   starts[columnIndex] = subcube.mWidthStart;
+   counts[columnIndex] = subcube.getColumnCount();
+   totals[columnIndex] = columns;
+   starts[bandIndex] = subcube.mBandStart;
+   counts[bandIndex] = subcube.getBandCount();
+   totals[bandIndex] = bands;
+   if (!subcube.mBandList.empty() ||
+      (counts[rowIndex] > 1 && subcube.mRowSkip != 1) ||
+      (counts[columnIndex] > 1 && subcube.mColumnSkip != 1) ||
+      (counts[bandIndex] > 1 && subcube.mBandSkip != 1))
+   {
+      return false;
+   }
+
+   //every dimension faster than the first partial one must be complete
+   //and every dimension slower than it must be a single slice
+   int partial = 2;
+   while (partial >= 0 && counts[partial] == totals[partial])
+   {
+      --partial;
+   }
+   for (int dim = 0; dim < partial; ++dim)
+   {
+      if (counts[dim] != 1)
       {
-         std::string msg = "error in copying array values to Opticks.";
-         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, msg.c_str());
          return false;
       }
-      pRasterElement->updateData();
    }
 
+   offset = 0;
+   for (int dim = 0; dim < 3; ++dim)
+   {
+      offset = offset * totals[dim] + starts[dim];
+   }
+   return true;
+}
+
+unsigned char* IdlFunctions::mapSubcube(const RasterElement* pElement, const Subcube& subcube)
+{
+   const RasterDataDescriptor* pDesc = (pElement == NULL) ? NULL :
+      static_cast<const RasterDataDescriptor*>(pElement->getDataDescriptor());
+   if (pDesc == NULL || pDesc->getProcessingLocation() != ON_DISK_READ_ONLY)
+   {
+      return NULL;
+   }
+   //importers with their own pager may compress or rearrange the data in the file
+   const PlugIn* pPager = dynamic_cast<const PlugIn*>(pElement->getPager());
+   if (pPager == NULL || pPager->getName() != RawPagerName)
+   {
+      return NULL;
+   }
+   const RasterFileDescriptor* pFileDesc = dynamic_cast<const RasterFileDescriptor*>(pDesc->getFileDescriptor());
+   if (pFileDesc == NULL || !pFileDesc->getBandFiles().empty() ||
+      pFileDesc->getInterleaveFormat() != pDesc->getInterleaveFormat() ||
+      pFileDesc->getEndian() != Endian::getSystemEndian() ||
+      pFileDesc->getBitsPerElement() != pDesc->getBytesPerElement() * 8)
+   {
+      return NULL;
+   }
+
+   //the subcube has to cover a consecutive range of rows, columns and bands in the file
+   DimensionDescriptor rowStart = pDesc->getActiveRow(subcube.mHeightStart);
+   DimensionDescriptor rowEnd = pDesc->getActiveRow(subcube.mHeightEnd);
+   DimensionDescriptor columnStart = pDesc->getActiveColumn(subcube.mWidthStart);
+   DimensionDescriptor columnEnd = pDesc->getActiveColumn(subcube.mWidthEnd);
+   DimensionDescriptor bandStart = pDesc->getActiveBand(subcube.mBandStart);
+   DimensionDescriptor bandEnd = pDesc->getActiveBand(subcube.mBandEnd);
+   if (!rowStart.isOnDiskNumberValid() || !rowEnd.isOnDiskNumberValid() ||
+      !columnStart.isOnDiskNumberValid() || !columnEnd.isOnDiskNumberValid() ||
+      !bandStart.isOnDiskNumberValid() || !bandEnd.isOnDiskNumberValid() ||
+      rowEnd.getOnDiskNumber() - rowStart.getOnDiskNumber() != subcube.mHeightEnd - subcube.mHeightStart ||
+      columnEnd.getOnDiskNumber() - columnStart.getOnDiskNumber() != subcube.mWidthEnd - subcube.mWidthStart ||
+      bandEnd.getOnDiskNumber() - bandStart.getOnDiskNumber() != subcube.mBandEnd - subcube.mBandStart)
+   {
+      return NULL;
+   }
+   Subcube fileSubcube = subcube;
+   fileSubcube.mHeightStart = rowStart.getOnDiskNumber();
+   fileSubcube.mHeightEnd = rowEnd.getOnDiskNumber();
+   fileSubcube.mWidthStart = columnStart.getOnDiskNumber();
+   fileSubcube.mWidthEnd = columnEnd.getOnDiskNumber();
+   fileSubcube.mBandStart = bandStart.getOnDiskNumber();
+   fileSubcube.mBandEnd = bandEnd.getOnDiskNumber();
+   uint64_t offset = 0;
+   if (!getContiguousOffset(pFileDesc->getInterleaveFormat(), pFileDesc->getRowCount(),
+      pFileDesc->getColumnCount(), pFileDesc->getBandCount(), fileSubcube, offset))
+   {
+      return NULL;
+   }
+
+   const uint64_t bytesPerElement = pDesc->getBytesPerElement();
+   const uint64_t prelineBytes = pFileDesc->getPrelineBytes();
+   const uint64_t postlineBytes = pFileDesc->getPostlineBytes();
+   const uint64_t prebandBytes = pFileDesc->getPrebandBytes();
+   const uint64_t postbandBytes = pFileDesc->getPostbandBytes();
+   uint64_t start = pFileDesc->getHeaderBytes() + offset * bytesPerElement;
+   if (pFileDesc->getInterleaveFormat() == BSQ)
+   {
+      //the padding of each row and band is skipped, so the block can only cross padding which is empty
+      const bool multipleRows = (fileSubcube.mHeightEnd > fileSubcube.mHeightStart);
+      const bool multipleBands = (fileSubcube.mBandEnd > fileSubcube.mBandStart);
+      if (((multipleRows || multipleBands) && prelineBytes + postlineBytes != 0) ||
+         (multipleBands && prebandBytes + postbandBytes != 0))
+      {
+         return NULL;
+      }
+      const uint64_t lineBytes = prelineBytes + pFileDesc->getColumnCount() * bytesPerElement + postlineBytes;
+      const uint64_t bandBytes = prebandBytes + pFileDesc->getRowCount() * lineBytes + postbandBytes;
+      start = pFileDesc->getHeaderBytes() + fileSubcube.mBandStart * bandBytes + prebandBytes +
+         fileSubcube.mHeightStart * lineBytes + prelineBytes + fileSubcube.mWidthStart * bytesPerElement;
+   }
+   else if (prelineBytes + postlineBytes + prebandBytes + postbandBytes != 0)
+   {
+      return NULL;
+   }
+   const uint64_t length = static_cast<uint64_t>(subcube.getRowCount()) * subcube.getColumnCount() *
+      subcube.getBandCount() * pDesc->getBytesPerElement();
+   const std::string filename = pFileDesc->getFilename().getFullPathAndName();
+   void* pMapping = NULL;
+   uint64_t mapStart = 0;
+   uint64_t mapLength = 0;
+#if defined(WIN_API)
+   SYSTEM_INFO systemInfo;
+   GetSystemInfo(&systemInfo);
+   mapStart = start - start % systemInfo.dwAllocationGranularity;
+   mapLength = length + (start - mapStart);
+   if (mapLength > std::numeric_limits<SIZE_T>::max())
+   {
+      return NULL;
+   }
+   HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+      FILE_ATTRIBUTE_NORMAL, NULL);
+   if (file == INVALID_HANDLE_VALUE)
+   {
+      return NULL;
+   }
+   LARGE_INTEGER fileSize;
+   HANDLE mapping = NULL;
+   if (GetFileSizeEx(file, &fileSize) && static_cast<uint64_t>(fileSize.QuadPart) >= start + length)
+   {
+      mapping = CreateFileMapping(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+   }
+   if (mapping != NULL)
+   {
+      //a copy on write view lets IDL change the array without touching the file
+      pMapping = MapViewOfFile(mapping, FILE_MAP_COPY, static_cast<DWORD>(mapStart >> 32),
+         static_cast<DWORD>(mapStart & 0xFFFFFFFF), static_cast<SIZE_T>(mapLength));
+      CloseHandle(mapping);
+   }
+   CloseHandle(file);
+#else
+   const uint64_t pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+   mapStart = start - start % pageSize;
+   mapLength = length + (start - mapStart);
+   if (mapLength > std::numeric_limits<size_t>::max() ||
+      mapStart > static_cast<uint64_t>(std::numeric_limits<off_t>::max()))
+   {
+      return NULL;
+   }
+   int file = open(filename.c_str(), O_RDONLY);
+   if (file < 0)
+   {
+      return NULL;
+   }
+   struct stat fileStat;
+   if (fstat(file, &fileStat) == 0 && static_cast<uint64_t>(fileStat.st_size) >= start + length)
+   {
+      //a private mapping lets IDL change the array without touching the file
+      pMapping = mmap(NULL, static_cast<size_t>(mapLength), PROT_READ | PROT_WRITE, MAP_PRIVATE, file,
+         static_cast<off_t>(mapStart));
+      if (pMapping == MAP_FAILED)
+      {
+         pMapping = NULL;
+      }
+   }
+   close(file);
+#endif
+   if (pMapping == NULL)
+   {
+      return NULL;
+   }
+
+   UCHAR* pData = reinterpret_cast<UCHAR*>(pMapping) + (start - mapStart);
+   pthread_mutex_lock(&sMappingMutex);
+   sMappings[pData] = std::make_pair(pMapping, static_cast<size_t>(mapLength));
+   pthread_mutex_unlock(&sMappingMutex);
+   return pData;
+}
+
+void IdlFunctions::unmapSubcube(UCHAR* pData)
+{
+   pthread_mutex_lock(&sMappingMutex);
+   std::map<UCHAR*, std::pair<void*, size_t> >::iterator mapping = sMappings.find(pData);
+   if (mapping == sMappings.end())
+   {
+      pthread_mutex_unlock(&sMappingMutex);
+      return;
+   }
+   const std::pair<void*, size_t> view = mapping->second;
+   sMappings.erase(mapping);
+   pthread_mutex_unlock(&sMappingMutex);
+#if defined(WIN_API)
+   UnmapViewOfFile(view.first);
+#else
+   munmap(view.first, view.second);
+#endif
+}
+
+bool IdlFunctions::getInterleaveStrides(InterleaveFormatType interleave, size_t rows, size_t columns, size_t bands,
+                                        size_t strides[3])
+{
+   switch (interleave)
+   {
+   case BSQ:
+      strides[0] = columns;
+      strides[1] = 1;
+      strides[2] = rows * columns;
+      break;
+   case BIL:
+      strides[0] = columns * bands;
+      strides[1] = 1;
+      strides[2] = columns;
+      break;
+   case BIP:
+      strides[0] = columns * bands;
+      strides[1] = bands;
+      strides[2] = 1;
+      break;
+   default:
+      return false;
+   }
+   return true;
+}
+
+bool IdlFunctions::isSameLayout(InterleaveFormatType first, InterleaveFormatType second, size_t rows,
+                                size_t columns, size_t bands)
+{
+   size_t firstStrides[3];
+   size_t secondStrides[3];
+   if (!getInterleaveStrides(first, rows, columns, bands, firstStrides) ||
+      !getInterleaveStrides(second, rows, columns, bands, secondStrides))
+   {
+      return false;
+   }
+
+   //a dimension holding a single value can have any stride
+   const size_t counts[3] = {rows, columns, bands};
+   for (int dim = 0; dim < 3; ++dim)
+   {
+      if (counts[dim] > 1 && firstStrides[dim] != secondStrides[dim])
+      {
+         return false;
+      }
+   }
    return true;
 }
 
+int IdlFunctions::getFastestDimension(const size_t strides[3], const size_t counts[3])
+{
+   int fastest = -1;
+   for (int dim = 0; dim < 3; ++dim)
+   {
+      if (counts[dim] > 1 && (fastest < 0 || strides[dim] < strides[fastest]))
+      {
+         fastest = dim;
+      }
+   }
+   return fastest;
+}
+
+bool IdlFunctions::runChunks(ChunkTask& task, size_t chunkCount, unsigned int threadCount)
+{
+   ChunkQueue queue;
+   queue.mpTask = &task;
+   queue.mChunkCount = chunkCount;
+   queue.mNextChunk = 0;
+   queue.mSuccess = true;
+   pthread_mutex_init(&queue.mMutex, NULL);
+
+   std::vector<pthread_t> threads;
+   const size_t workerCount = std::min(static_cast<size_t>(threadCount), chunkCount);
+   for (size_t worker = 1; worker < workerCount; ++worker)
+   {
+      pthread_t thread;
+      if (pthread_create(&thread, NULL, processChunkQueue, &queue) != 0)
+      {
+         //the threads which did start, and this one, will work through the queue
+         break;
+      }
+      threads.push_back(thread);
+   }
+   processChunkQueue(&queue);
+   for (std::vector<pthread_t>::iterator thread = threads.begin(); thread != threads.end(); ++thread)
+   {
+      pthread_join(*thread, NULL);
+   }
+
+   pthread_mutex_destroy(&queue.mMutex);
+   return queue.mSuccess;
+}
+
+unsigned int IdlFunctions::getThreadCount()
+{
+   return std::max(1U, Service<ConfigurationSettings>()->getSettingThreadCount());
+}
+
+unsigned int IdlFunctions::getConcurrentRows()
+{
+   return dv_cast<unsigned int>(Service<ConfigurationSettings>()->getSetting("IdlInterpreter/ConcurrentRows"), 0);
+}
+
+size_t IdlFunctions::getRowsPerChunk(size_t rows, size_t rowBytes, size_t groups, unsigned int threadCount)
+{
+   if (rows == 0 || rowBytes == 0)
+   {
+      return 1;
+   }
+   const size_t chunksPerThread = 4;
+   const size_t totalBytes = rows * rowBytes * groups;
+   const size_t chunkBytes = std::min(MaxChunkBytes, totalBytes / (std::max(1U, threadCount) * chunksPerThread));
+   return std::min(rows, std::max(static_cast<size_t>(1), chunkBytes / rowBytes));
+}
+
 Layer* IdlFunctions::getLayerByRaster(RasterElement* pElement)
 {
    VERIFYRV(pElement != NULL, NULL);
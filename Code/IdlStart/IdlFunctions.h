@@ -10,6 +10,7 @@
 #ifndef IDLFUNCTIONS_H
 #define IDLFUNCTIONS_H
 
+#include "ComplexData.h"
 #include "DataAccessor.h"
 #include "DataAccessorImpl.h"
 #include "DataRequest.h"
@@ -18,8 +19,12 @@
 #include "RasterUtilities.h"
 #include "TypesFile.h"
 #include "Units.h"
+#include <math.h>
 #include <stdio.h>
 #include <idl_export.h>
+#include <pthread.h>
+#include <algorithm>
+#include <limits>
 #include <vector>
 
 class DataElement;
@@ -59,6 +64,130 @@ namespace IdlFunctions
       T kw; // does not start with 'm' so IDL_KW_FREE will work
    };
 
+   /**
+    * A subcube of a raster element in active row, column and band numbers.
+    *
+    * Each dimension starts at its start value and takes every skip'th value
+    * up to and including its end value.
+    */
+   struct Subcube
+   {
+      Subcube() :
+         mHeightStart(0),
+         mHeightEnd(0),
+         mRowSkip(1),
+         mWidthStart(0),
+         mWidthEnd(0),
+         mColumnSkip(1),
+         mBandStart(0),
+         mBandEnd(0),
+         mBandSkip(1),
+         mConcurrentRows(0)
+      {}
+
+      unsigned int getRowCount() const
+      {
+         return (mHeightEnd - mHeightStart) / mRowSkip + 1;
+      }
+
+      unsigned int getColumnCount() const
+      {
+         return (mWidthEnd - mWidthStart) / mColumnSkip + 1;
+      }
+
+      unsigned int getBandCount() const
+      {
+         if (!mBandList.empty())
+         {
+            return static_cast<unsigned int>(mBandList.size());
+         }
+         return (mBandEnd - mBandStart) / mBandSkip + 1;
+      }
+
+      /**
+       * Get the active band number of the n'th band of the subcube.
+       */
+      unsigned int getBand(unsigned int index) const
+      {
+         return mBandList.empty() ? mBandStart + index * mBandSkip : mBandList[index];
+      }
+
+      /**
+       * Get the number of rows a data accessor over \p rows rows of \p rowBytes bytes
+       * each keeps available at once. Unless mConcurrentRows is set, rows are paged in
+       * blocks of about four megabytes so narrow subcubes are read in a few large blocks
+       * and wide subcubes in blocks of a few rows. Skipped rows are never paged in.
+       */
+      unsigned int getConcurrentRows(unsigned int rows, size_t rowBytes) const
+      {
+         const size_t blockBytes = 4 * 1024 * 1024;
+         size_t concurrentRows = mConcurrentRows;
+         if (concurrentRows == 0)
+         {
+            concurrentRows = (mRowSkip > 1) ? 1 : blockBytes / std::max<size_t>(1, rowBytes);
+         }
+         return static_cast<unsigned int>(std::max<size_t>(1, std::min<size_t>(concurrentRows, rows)));
+      }
+
+      /**
+       * Select the bands of the subcube in the given order. Bands which are evenly
+       * spaced in increasing order are stored as a start, end and skip so only
+       * irregular selections have to be gathered through the band list.
+       */
+      void setBands(const std::vector<unsigned int>& bands)
+      {
+         mBandList.clear();
+         if (bands.empty())
+         {
+            return;
+         }
+         mBandStart = bands.front();
+         mBandEnd = bands.back();
+         mBandSkip = 1;
+         if (bands.size() > 1)
+         {
+            if (bands[1] > bands[0])
+            {
+               mBandSkip = bands[1] - bands[0];
+            }
+            for (size_t i = 1; i < bands.size(); ++i)
+            {
+               if (bands[i] != bands[0] + i * mBandSkip)
+               {
+                  mBandList = bands;
+                  mBandStart = *std::min_element(bands.begin(), bands.end());
+                  mBandEnd = *std::max_element(bands.begin(), bands.end());
+                  mBandSkip = 1;
+                  break;
+               }
+            }
+         }
+      }
+
+      unsigned int mHeightStart;
+      unsigned int mHeightEnd;
+      unsigned int mRowSkip;
+      unsigned int mWidthStart;
+      unsigned int mWidthEnd;
+      unsigned int mColumnSkip;
+      unsigned int mBandStart;
+      unsigned int mBandEnd;
+      unsigned int mBandSkip;
+
+      /**
+       * The active band numbers to copy when they can't be given by mBandStart,
+       * mBandEnd and mBandSkip. mBandStart and mBandEnd then hold the lowest and
+       * highest band in the list. Use setBands() to fill this in.
+       */
+      std::vector<unsigned int> mBandList;
+
+      /**
+       * The number of rows each data accessor keeps available at once, or zero to pick
+       * it from the shape of the subcube. This does not change which data is copied.
+       */
+      unsigned int mConcurrentRows;
+   };
+
    RasterElement* getDataset(const std::string& name = "");
    bool clearWizardObject(const std::string& wizardName);
    WizardObject* getWizardObject(const std::string& wizardName);
@@ -72,11 +201,74 @@ namespace IdlFunctions
 
    RasterElement* createRasterElement(char* pData, const std::string& datasetName,
       const std::string& newName, EncodingType datatype, bool inMemory, InterleaveFormatType iType,
-      const std::string& unit, unsigned int rows, unsigned int cols, unsigned int bands);
+      const std::string& unit, unsigned int rows, unsigned int cols, unsigned int bands,
+      unsigned int concurrentRows = 0);
    bool changeRasterElement(RasterElement* pRasterElement, char* pData,
       EncodingType datatype, InterleaveFormatType iType, unsigned int startRow,
       unsigned int rows, unsigned int startCol, unsigned int cols,
-      unsigned int startBand, unsigned int bands, EncodingType oldType);
+      unsigned int startBand, unsigned int bands, EncodingType oldType, unsigned int concurrentRows = 0);
+
+   /**
+    * Get the number of threads used to transfer data, as set in the Opticks options.
+    */
+   unsigned int getThreadCount();
+
+   /**
+    * Get the number of rows data accessors keep available at once, as set in the IDL
+    * interpreter options. Zero picks the number from the shape of each subcube.
+    */
+   unsigned int getConcurrentRows();
+
+   /**
+    * Write a packed subcube, laid out in the element's interleave, into a raster element.
+    *
+    * The subcube must not use skips. Blocks of rows are written on up to
+    * \p threadCount threads. This does not call into IDL.
+    *
+    * @return \c true if the subcube was written, \c false otherwise.
+    */
+   bool writeSubcube(RasterElement* pElement, const char* pData, const Subcube& subcube, unsigned int threadCount);
+
+   /**
+    * Determine if a subcube is a single contiguous block of the element's data.
+    *
+    * @param pDesc
+    *        The descriptor of the element.
+    * @param offset
+    *        Set to the offset of the first value of the subcube, in elements,
+    *        from the start of the element's data.
+    * @return \c true if the subcube is contiguous, \c false otherwise.
+    */
+   bool getContiguousOffset(const RasterDataDescriptor* pDesc, const Subcube& subcube, uint64_t& offset);
+
+   /**
+    * Determine if a subcube is a single contiguous block of a cube with the given
+    * interleave and dimensions.
+    */
+   bool getContiguousOffset(InterleaveFormatType interleave, unsigned int rows, unsigned int columns,
+      unsigned int bands, const Subcube& subcube, uint64_t& offset);
+
+   /**
+    * Map the part of the file of an on-disk raster element which holds a subcube.
+    *
+    * The element must be read only and be read by the pager of the generic raster
+    * importers from a single file of raw samples in the system byte order. The subcube
+    * must be a single contiguous block of that file, which can only cross the padding
+    * of BSQ rows and bands when it is empty. Pages are read from the file when they
+    * are first used. Changes made to the mapped data are not written to the file.
+    *
+    * @param pElement
+    *        The on-disk raster element.
+    * @return A pointer to the first value of the subcube or \c NULL if the subcube can not
+    *         be mapped. The pointer must be released with unmapSubcube().
+    */
+   unsigned char* mapSubcube(const RasterElement* pElement, const Subcube& subcube);
+
+   /**
+    * Release a pointer returned by mapSubcube(). This can be used as the free callback
+    * of IDL_ImportArray().
+    */
+   void unmapSubcube(UCHAR* pData);
 
    template<typename T>
    bool addMatrixToCurrentView(T* pMatrix, const std::string& name,
@@ -84,7 +276,8 @@ namespace IdlFunctions
       unsigned int bands, const std::string& unit, EncodingType type,
       bool inMemory, 
       InterleaveFormatType ftype = BSQ,
-      const std::string& filename = "")
+      const std::string& filename = "",
+      unsigned int concurrentRows = 0)
    {
       bool bReturn  = false;
       SpatialDataView* pView = NULL;
@@ -122,91 +315,15 @@ namespace IdlFunctions
          IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "error in copying array values to Opticks.");
          return false;
       }
-      unsigned int bytesPerElement = pParam->getBytesPerElement();
-      if (ftype == BSQ)
+      Subcube subcube;
+      subcube.mHeightEnd = height - 1;
+      subcube.mWidthEnd = width - 1;
+      subcube.mBandEnd = bands - 1;
+      subcube.mConcurrentRows = concurrentRows;
+      if (!writeSubcube(pRaster, reinterpret_cast<const char*>(pMatrix), subcube, getThreadCount()))
       {
-         for (unsigned int band = 0; band < bands; ++band)
-         {
-            try
-            {
-               FactoryResource<DataRequest> pRequest;
-               pRequest->setInterleaveFormat(BSQ);
-               pRequest->setRows(pParam->getActiveRow(0), pParam->getActiveRow(height-1), 1);
-               pRequest->setColumns(pParam->getActiveColumn(0), pParam->getActiveColumn(width-1), width);
-               pRequest->setBands(pParam->getActiveBand(band), pParam->getActiveBand(band), 1);
-               pRequest->setWritable(true);
-               DataAccessor daImage = pRaster->getDataAccessor(pRequest.release());
-
-               //populate the resultsmatrix with the data
-               for (unsigned int row = 0; row < height; ++row)
-               {
-                  if (!daImage.isValid())
-                  {
-                     throw std::exception();
-                  }
-                  memcpy(daImage->getRow(), pMatrix + (width * height * band) + (width * row), width * bytesPerElement);
-                  daImage->nextRow();
-               }
-            }
-            catch(...)
-            {
-               IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "error in copying array values to Opticks.");
-               return false;
-            }
-         }
-      }
-      else if (ftype == BIP)
-      {
-         try
-         {
-            FactoryResource<DataRequest> pRequest;
-            pRequest->setInterleaveFormat(BIP);
-            pRequest->setRows(pParam->getActiveRow(0), pParam->getActiveRow(height-1), 1);
-            pRequest->setColumns(pParam->getActiveColumn(0), pParam->getActiveColumn(width-1), width);
-            pRequest->setWritable(true);
-            DataAccessor daImage = pRaster->getDataAccessor(pRequest.release());
-            for (unsigned int row = 0; row < height; ++row)
-            {
-               if (!daImage.isValid())
-               {
-                  throw std::exception();
-               }
-               memcpy(daImage->getRow(), pMatrix + (row * width * bands), width * bands * bytesPerElement);
-               daImage->nextRow();
-            }
-         }
-         catch (...)
-         {
-            IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "error in copying array values to Opticks.");
-            return false;
-         }
-      }
-      else if (ftype == BIL)
-      {
-         try
-         {
-            FactoryResource<DataRequest> pRequest;
-            pRequest->setInterleaveFormat(BIL);
-            pRequest->setRows(pParam->getActiveRow(0), pParam->getActiveRow(height-1), 1);
-            pRequest->setColumns(pParam->getActiveColumn(0), pParam->getActiveColumn(width-1), width);
-            pRequest->setBands(pParam->getActiveBand(0), pParam->getActiveBand(bands-1), bands);
-            pRequest->setWritable(true);
-            DataAccessor daImage = pRaster->getDataAccessor(pRequest.release());
-            for (unsigned int row = 0; row < height; ++row)
-            {
-               if (!daImage.isValid())
-               {
-                  throw std::exception();
-               }
-               memcpy(daImage->getRow(), pMatrix + (row * width * bands), width * bands * bytesPerElement);
-               daImage->nextRow();
-            }
-         }
-         catch (...)
-         {
-            IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "error in copying array values to Opticks.");
-            return false;
-         }
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "error in copying array values to Opticks.");
+         return false;
       }
       Units* pScale = pParam->getUnits();
       if (pScale != NULL)
@@ -239,105 +356,1439 @@ namespace IdlFunctions
       return bReturn;
    }
 
+   /**
+    * Copy a contiguous run of values.
+    *
+    * The element type is known at compile time so the compiler can emit a
+    * block move instead of a memcpy() call sized at runtime for every pixel.
+    */
+   template<typename T>
+   inline void copySpan(const T* pSrc, T* pDst, size_t count)
+   {
+      std::copy(pSrc, pSrc + count, pDst);
+   }
+
+   /**
+    * Copy a run of values that are \p srcStride elements apart in the source
+    * into a contiguous run in the destination.
+    */
    template<typename T>
-   static void copySubcube(T* pData, RasterElement* pElement, unsigned int heightStart, unsigned int heightEnd,
-      unsigned int widthStart, unsigned int widthEnd, unsigned int bandStart, unsigned int bandEnd)
+   inline void copyStridedSpan(const T* pSrc, size_t srcStride, T* pDst, size_t count)
+   {
+      if (srcStride == 1)
+      {
+         copySpan(pSrc, pDst, count);
+         return;
+      }
+      for (size_t i = 0; i < count; ++i, pSrc += srcStride)
+      {
+         pDst[i] = *pSrc;
+      }
+   }
+
+   /**
+    * Convert a floating point value to an integer type. The value is truncated toward
+    * zero, values outside the range of the type become its minimum or maximum and NaN
+    * becomes 0.
+    */
+   template<typename D>
+   inline D clampToInteger(double value)
+   {
+      if (value != value)
+      {
+         return 0;
+      }
+      if (value <= static_cast<double>(std::numeric_limits<D>::min()))
+      {
+         return std::numeric_limits<D>::min();
+      }
+      if (value >= static_cast<double>(std::numeric_limits<D>::max()))
+      {
+         return std::numeric_limits<D>::max();
+      }
+      return static_cast<D>(value);
+   }
+
+   /**
+    * Casts a value to another real type, using clampToInteger() when a floating point
+    * value is converted to an integer type.
+    */
+   template<typename S, typename D, bool ToInteger = !std::numeric_limits<S>::is_integer &&
+      std::numeric_limits<D>::is_integer>
+   struct RealCast
+   {
+      static D cast(const S& src)
+      {
+         return static_cast<D>(src);
+      }
+   };
+
+   template<typename S, typename D>
+   struct RealCast<S, D, true>
+   {
+      static D cast(const S& src)
+      {
+         return clampToInteger<D>(static_cast<double>(src));
+      }
+   };
+
+   /**
+    * Convert a value to another type. As with IDL's conversion functions, real
+    * values become the real part of complex values and converting a complex value
+    * to a real type keeps its real part. Floating point values converted to an
+    * integer type are truncated toward zero. Unlike IDL, where the result of
+    * converting NaN or a value outside the range of the integer type depends on the
+    * platform, such values are clamped as clampToInteger() describes.
+    */
+   template<typename S, typename D>
+   inline void convertValue(const S& src, D& dst)
    {
-      unsigned int height = heightEnd - heightStart+1;
-      unsigned int width = widthEnd - widthStart+1;
-      unsigned int bands = bandEnd - bandStart+1;
-      if (pElement != NULL)
+      dst = RealCast<S, D>::cast(src);
+   }
+
+   template<typename S>
+   inline void convertValue(const S& src, IDL_COMPLEX& dst)
+   {
+      dst.r = static_cast<float>(src);
+      dst.i = 0.0f;
+   }
+
+   template<typename S>
+   inline void convertValue(const S& src, IDL_DCOMPLEX& dst)
+   {
+      dst.r = static_cast<double>(src);
+      dst.i = 0.0;
+   }
+
+   template<typename D>
+   inline void convertValue(const IntegerComplex& src, D& dst)
+   {
+      convertValue(src.mReal, dst);
+   }
+
+   template<typename D>
+   inline void convertValue(const FloatComplex& src, D& dst)
+   {
+      convertValue(src.mReal, dst);
+   }
+
+   inline void convertValue(const IntegerComplex& src, IntegerComplex& dst)
+   {
+      dst = src;
+   }
+
+   inline void convertValue(const FloatComplex& src, FloatComplex& dst)
+   {
+      dst = src;
+   }
+
+   inline void convertValue(const IntegerComplex& src, IDL_COMPLEX& dst)
+   {
+      dst.r = src.mReal;
+      dst.i = src.mImaginary;
+   }
+
+   inline void convertValue(const IntegerComplex& src, IDL_DCOMPLEX& dst)
+   {
+      dst.r = src.mReal;
+      dst.i = src.mImaginary;
+   }
+
+   inline void convertValue(const FloatComplex& src, IDL_COMPLEX& dst)
+   {
+      dst.r = src.mReal;
+      dst.i = src.mImaginary;
+   }
+
+   inline void convertValue(const FloatComplex& src, IDL_DCOMPLEX& dst)
+   {
+      dst.r = src.mReal;
+      dst.i = src.mImaginary;
+   }
+
+   /**
+    * Convert a run of values that are \p srcStride elements apart in the source
+    * into a contiguous run of another type in the destination.
+    */
+   template<typename S, typename D>
+   inline void copyStridedSpan(const S* pSrc, size_t srcStride, D* pDst, size_t count)
+   {
+      for (size_t i = 0; i < count; ++i, pSrc += srcStride)
       {
-         try
+         convertValue(*pSrc, pDst[i]);
+      }
+   }
+
+   /**
+    * Get the distance, in elements, between adjacent rows, columns and bands of
+    * a cube stored in the given interleave.
+    *
+    * @param strides
+    *        Set to the row, column and band strides in that order.
+    * @return \c false if the interleave is not valid, \c true otherwise.
+    */
+   bool getInterleaveStrides(InterleaveFormatType interleave, size_t rows, size_t columns, size_t bands,
+      size_t strides[3]);
+
+   /**
+    * Determine if two interleaves store a cube of the given size identically.
+    * This is the case when the interleaves are equal or when the size of the cube
+    * makes them coincide, for example a single band.
+    */
+   bool isSameLayout(InterleaveFormatType first, InterleaveFormatType second, size_t rows, size_t columns,
+      size_t bands);
+
+   /**
+    * Get the dimension with the smallest stride among the dimensions holding more
+    * than one value, or -1 if every dimension holds a single value.
+    */
+   int getFastestDimension(const size_t strides[3], const size_t counts[3]);
+
+   /**
+    * A job which is split into independently processed chunks.
+    */
+   class ChunkTask
+   {
+   public:
+      virtual ~ChunkTask() {}
+
+      /**
+       * Process a single chunk. This is called concurrently for different chunks
+       * and must not call into IDL.
+       *
+       * @return \c true if the chunk was processed, \c false otherwise.
+       */
+      virtual bool processChunk(size_t chunk) = 0;
+   };
+
+   /**
+    * Process chunks 0 to \p chunkCount - 1 of a task.
+    *
+    * The calling thread and up to \p threadCount - 1 additional threads take
+    * chunks from a shared queue until it is empty or a chunk fails.
+    *
+    * @return \c true if every chunk was processed, \c false otherwise.
+    */
+   bool runChunks(ChunkTask& task, size_t chunkCount, unsigned int threadCount);
+
+   /**
+    * The largest chunk a transfer task processes at once.
+    */
+   const size_t MaxChunkBytes = 16 * 1024 * 1024;
+
+   /**
+    * Choose the number of rows in each chunk of a transfer.
+    *
+    * Chunks are at most MaxChunkBytes, and small enough that every thread gets
+    * several of them, but always hold at least one row.
+    *
+    * @param rows
+    *        The number of rows to transfer.
+    * @param rowBytes
+    *        The size of a row within a chunk.
+    * @param groups
+    *        The number of chunks which hold the same rows, such as separate bands.
+    */
+   size_t getRowsPerChunk(size_t rows, size_t rowBytes, size_t groups, unsigned int threadCount);
+
+   /**
+    * Values which are replaced while data is copied.
+    */
+   struct BadValueFill
+   {
+      BadValueFill() :
+         mFill(std::numeric_limits<double>::quiet_NaN()),
+         mCount(0)
+      {}
+
+      /**
+       * The source values to replace. Complex values are compared by their real part.
+       */
+      std::vector<double> mValues;
+
+      /**
+       * The value written in their place. Defaults to NaN.
+       */
+      double mFill;
+
+      /**
+       * The number of values which have been replaced.
+       */
+      uint64_t mCount;
+   };
+
+   /**
+    * Converts each value with convertValue().
+    */
+   template<typename S, typename D>
+   struct ValueConverter
+   {
+      void operator()(const S& src, D& dst)
+      {
+         convertValue(src, dst);
+      }
+   };
+
+   /**
+    * Converts each value with convertValue() and replaces bad values with the fill
+    * value. Every value is compared against every bad value and the fill value is
+    * selected afterwards instead of branched to. The replaced values are counted in
+    * the converter and added to BadValueFill::mCount when it is destroyed.
+    */
+   template<typename S, typename D>
+   class BadValueConverter
+   {
+   public:
+      explicit BadValueConverter(BadValueFill& badValues) :
+         mValues(badValues.mValues),
+         mReplaced(0),
+         mCount(badValues.mCount)
+      {
+         convertValue(badValues.mFill, mFill);
+      }
+
+      ~BadValueConverter()
+      {
+         mCount += mReplaced;
+      }
+
+      void operator()(const S& src, D& dst)
+      {
+         double value = 0.0;
+         convertValue(src, value);
+         bool bad = false;
+         for (std::vector<double>::const_iterator badValue = mValues.begin(); badValue != mValues.end(); ++badValue)
+         {
+            bad |= (value == *badValue);
+         }
+         D converted;
+         convertValue(src, converted);
+         dst = bad ? mFill : converted;
+         mReplaced += bad ? 1 : 0;
+      }
+
+   private:
+      BadValueConverter(const BadValueConverter& rhs);
+      BadValueConverter& operator=(const BadValueConverter& rhs);
+
+      const std::vector<double>& mValues;
+      D mFill;
+      uint64_t mReplaced;
+      uint64_t& mCount;
+   };
+
+   /**
+    * Scales and offsets each value as it is converted to a real type, replacing bad
+    * values with the fill value as BadValueConverter does. Bad values are compared
+    * before the values are scaled.
+    */
+   template<typename S, typename D>
+   class CalibrationConverter
+   {
+   public:
+      CalibrationConverter(double gain, double offset, BadValueFill& badValues) :
+         mGain(static_cast<D>(gain)),
+         mOffset(static_cast<D>(offset)),
+         mFill(static_cast<D>(badValues.mFill)),
+         mValues(badValues.mValues),
+         mReplaced(0),
+         mCount(badValues.mCount)
+      {}
+
+      ~CalibrationConverter()
+      {
+         mCount += mReplaced;
+      }
+
+      void operator()(const S& src, D& dst)
+      {
+         double value = 0.0;
+         convertValue(src, value);
+         bool bad = false;
+         for (std::vector<double>::const_iterator badValue = mValues.begin(); badValue != mValues.end(); ++badValue)
+         {
+            bad |= (value == *badValue);
+         }
+         D converted = 0;
+         convertValue(src, converted);
+         dst = bad ? mFill : mGain * converted + mOffset;
+         mReplaced += bad ? 1 : 0;
+      }
+
+   private:
+      CalibrationConverter(const CalibrationConverter& rhs);
+      CalibrationConverter& operator=(const CalibrationConverter& rhs);
+
+      D mGain;
+      D mOffset;
+      D mFill;
+      const std::vector<double>& mValues;
+      uint64_t mReplaced;
+      uint64_t& mCount;
+   };
+
+   /**
+    * Convert a run of values that are \p srcStride elements apart in the source
+    * into a contiguous run in the destination with the given converter.
+    */
+   template<typename S, typename D, typename C>
+   inline void convertSpan(const S* pSrc, size_t srcStride, D* pDst, size_t count, C& convert)
+   {
+      for (size_t i = 0; i < count; ++i, pSrc += srcStride)
+      {
+         convert(*pSrc, pDst[i]);
+      }
+   }
+
+   template<typename S, typename D>
+   inline void convertSpan(const S* pSrc, size_t srcStride, D* pDst, size_t count, ValueConverter<S, D>& convert)
+   {
+      copyStridedSpan(pSrc, srcStride, pDst, count);
+   }
+
+   /**
+    * Copy a cube between two memory layouts.
+    *
+    * The strides and counts are given for rows, columns and bands in that order.
+    * When both layouts have the same fastest varying dimension whole spans of it
+    * are copied. Otherwise each slice of the remaining dimension is transposed in
+    * square tiles small enough that the reads and writes of a tile stay in cache.
+    * Each value is converted with \p convert.
+    */
+   template<typename S, typename D, typename C>
+   void copyCube(const S* pSrc, const size_t srcStrides[3], D* pDst, const size_t dstStrides[3],
+      const size_t counts[3], C& convert)
+   {
+      if (counts[0] == 0 || counts[1] == 0 || counts[2] == 0)
+      {
+         return;
+      }
+      const int srcFast = getFastestDimension(srcStrides, counts);
+      const int dstFast = getFastestDimension(dstStrides, counts);
+      if (srcFast < 0 || dstFast < 0)
+      {
+         convert(*pSrc, *pDst);
+         return;
+      }
+
+      if (srcFast == dstFast)
+      {
+         const int outer = (srcFast + 1) % 3;
+         const int inner = (srcFast + 2) % 3;
+         const size_t srcStride = srcStrides[srcFast];
+         const size_t dstStride = dstStrides[srcFast];
+         for (size_t i = 0; i < counts[outer]; ++i)
          {
-            RasterDataDescriptor* pParam = static_cast<RasterDataDescriptor*>(pElement->getDataDescriptor());
-            unsigned int bytesPerElement = pParam->getBytesPerElement();
-            InterleaveFormatType interleave = pParam->getInterleaveFormat();
-            if (interleave == BSQ)
+            for (size_t j = 0; j < counts[inner]; ++j)
             {
-               //get the data from the disk, and store it into a new in memory block
-               for (unsigned int band = 0; band < bands; ++band)
+               const S* pS = pSrc + i * srcStrides[outer] + j * srcStrides[inner];
+               D* pD = pDst + i * dstStrides[outer] + j * dstStrides[inner];
+               if (dstStride == 1)
                {
-                  FactoryResource<DataRequest> pRequest;
-                  pRequest->setInterleaveFormat(BSQ);
-                  pRequest->setRows(pParam->getActiveRow(heightStart), pParam->getActiveRow(heightEnd), 1);
-                  pRequest->setColumns(pParam->getActiveColumn(widthStart), pParam->getActiveColumn(widthEnd), width);
-                  pRequest->setBands(pParam->getActiveBand(bandStart + band), pParam->getActiveBand(bandStart + band), 1);
-                  DataAccessor daImage = pElement->getDataAccessor(pRequest.release());
+                  convertSpan(pS, srcStride, pD, counts[srcFast], convert);
+               }
+               else
+               {
+                  for (size_t k = 0; k < counts[srcFast]; ++k, pS += srcStride, pD += dstStride)
+                  {
+                     convert(*pS, *pD);
+                  }
+               }
+            }
+         }
+         return;
+      }
 
-                  for (unsigned int row = 0; row < height; ++row)
+      //each tile is read along the source's fastest dimension and written along the destination's
+      const size_t tileSize = 32;
+      const int other = 3 - srcFast - dstFast;
+      const size_t srcA = srcStrides[srcFast];
+      const size_t srcB = srcStrides[dstFast];
+      const size_t dstA = dstStrides[srcFast];
+      const size_t dstB = dstStrides[dstFast];
+      for (size_t k = 0; k < counts[other]; ++k)
+      {
+         const S* pSrcSlice = pSrc + k * srcStrides[other];
+         D* pDstSlice = pDst + k * dstStrides[other];
+         for (size_t a0 = 0; a0 < counts[srcFast]; a0 += tileSize)
+         {
+            const size_t aEnd = std::min(a0 + tileSize, counts[srcFast]);
+            for (size_t b0 = 0; b0 < counts[dstFast]; b0 += tileSize)
+            {
+               const size_t bEnd = std::min(b0 + tileSize, counts[dstFast]);
+               for (size_t a = a0; a < aEnd; ++a)
+               {
+                  const S* pS = pSrcSlice + a * srcA + b0 * srcB;
+                  D* pD = pDstSlice + a * dstA + b0 * dstB;
+                  for (size_t b = b0; b < bEnd; ++b, pS += srcB, pD += dstB)
                   {
-                     for (unsigned int col = 0; col < width; ++col)
+                     convert(*pS, *pD);
+                  }
+               }
+            }
+         }
+      }
+   }
+
+   /**
+    * Copy a cube between two memory layouts, converting the values with
+    * convertValue() when the source and destination types differ.
+    */
+   template<typename S, typename D>
+   void copyCube(const S* pSrc, const size_t srcStrides[3], D* pDst, const size_t dstStrides[3],
+      const size_t counts[3])
+   {
+      ValueConverter<S, D> convert;
+      copyCube(pSrc, srcStrides, pDst, dstStrides, counts, convert);
+   }
+
+   /**
+    * Copy a packed cube from one interleave to another.
+    *
+    * @param pDst
+    *        The destination buffer. It must not overlap \p pSrc.
+    */
+   template<typename T>
+   void convertInterleave(T* pDst, InterleaveFormatType dstInterleave, const void* pSrc,
+      InterleaveFormatType srcInterleave, size_t rows, size_t columns, size_t bands)
+   {
+      size_t srcStrides[3];
+      size_t dstStrides[3];
+      const size_t counts[3] = {rows, columns, bands};
+      if (getInterleaveStrides(srcInterleave, rows, columns, bands, srcStrides) &&
+         getInterleaveStrides(dstInterleave, rows, columns, bands, dstStrides))
+      {
+         copyCube(static_cast<const T*>(pSrc), srcStrides, pDst, dstStrides, counts);
+      }
+   }
+
+   /**
+    * Copy a subcube of a raster element into a buffer laid out in the
+    * element's native interleave.
+    *
+    * Whole row spans are copied for each accessor step. BSQ data uses one
+    * accessor per band, BIP data uses a single accessor and BIL data uses a
+    * single accessor when every band of full width rows is requested or one
+    * accessor per band otherwise. Skipped rows are never visited and skipped
+    * bands of BSQ and BIL data are never requested from the element. Bands in
+    * the band list of the subcube are gathered from each pixel of BIP data and
+    * from each full width row of BIL data by their index in the list.
+    *
+    * @param pData
+    *        The destination buffer. It must be large enough to hold the subcube.
+    * @param pElement
+    *        The raster element to copy from.
+    * @param subcube
+    *        The active rows, columns and bands to copy.
+    * This does not call into IDL so it may be run on a worker thread.
+    *
+    * @return \c true if the subcube was copied, \c false otherwise.
+    */
+   template<typename T>
+   bool copyNativeSubcube(T* pData, RasterElement* pElement, const Subcube& subcube)
+   {
+      if (pData == NULL || pElement == NULL)
+      {
+         return false;
+      }
+      const unsigned int height = subcube.getRowCount();
+      const unsigned int width = subcube.getColumnCount();
+      const unsigned int bands = subcube.getBandCount();
+      const unsigned int heightStart = subcube.mHeightStart;
+      const unsigned int heightEnd = subcube.mHeightEnd;
+      const unsigned int widthStart = subcube.mWidthStart;
+      const unsigned int widthEnd = subcube.mWidthEnd;
+      const unsigned int bandStart = subcube.mBandStart;
+      const unsigned int rowSkip = subcube.mRowSkip;
+      const unsigned int columnSkip = subcube.mColumnSkip;
+      const unsigned int bandSkip = subcube.mBandSkip;
+      const std::vector<unsigned int>& bandList = subcube.mBandList;
+      try
+      {
+         const RasterDataDescriptor* pParam = static_cast<const RasterDataDescriptor*>(pElement->getDataDescriptor());
+         InterleaveFormatType interleave = pParam->getInterleaveFormat();
+         if (interleave == BSQ)
+         {
+            //each row of a band is contiguous so copy it in one step
+            for (unsigned int band = 0; band < bands; ++band)
+            {
+               const unsigned int sourceBand = subcube.getBand(band);
+               FactoryResource<DataRequest> pRequest;
+               pRequest->setInterleaveFormat(BSQ);
+               pRequest->setRows(pParam->getActiveRow(heightStart), pParam->getActiveRow(heightEnd),
+                  subcube.getConcurrentRows(heightEnd - heightStart + 1, (widthEnd - widthStart + 1) * sizeof(T)));
+               pRequest->setColumns(pParam->getActiveColumn(widthStart), pParam->getActiveColumn(widthEnd),
+                  widthEnd - widthStart + 1);
+               pRequest->setBands(pParam->getActiveBand(sourceBand), pParam->getActiveBand(sourceBand), 1);
+               DataAccessor daImage = pElement->getDataAccessor(pRequest.release());
+
+               T* pDst = pData + static_cast<size_t>(band) * width * height;
+               for (unsigned int row = 0; row < height; ++row, pDst += width)
+               {
+                  daImage->toPixel(heightStart + row * rowSkip, widthStart);
+                  if (!daImage.isValid())
+                  {
+                     throw std::exception();
+                  }
+                  copyStridedSpan(static_cast<const T*>(daImage->getColumn()), columnSkip, pDst, width);
+               }
+            }
+         }
+         else if (interleave == BIP)
+         {
+            //each pixel holds every band so whole rows can be copied when all bands are requested
+            const unsigned int pixelBands = pParam->getBandCount();
+            const size_t pixelStride = static_cast<size_t>(pixelBands) * columnSkip;
+            FactoryResource<DataRequest> pRequest;
+            pRequest->setInterleaveFormat(BIP);
+            pRequest->setRows(pParam->getActiveRow(heightStart), pParam->getActiveRow(heightEnd),
+               subcube.getConcurrentRows(heightEnd - heightStart + 1,
+               static_cast<size_t>(widthEnd - widthStart + 1) * pixelBands * sizeof(T)));
+            pRequest->setColumns(pParam->getActiveColumn(widthStart), pParam->getActiveColumn(widthEnd),
+               widthEnd - widthStart + 1);
+            DataAccessor daImage = pElement->getDataAccessor(pRequest.release());
+
+            T* pDst = pData;
+            for (unsigned int row = 0; row < height; ++row)
+            {
+               daImage->toPixel(heightStart + row * rowSkip, widthStart);
+               if (!daImage.isValid())
+               {
+                  throw std::exception();
+               }
+               const T* pSrc = static_cast<const T*>(daImage->getColumn());
+               if (bands == pixelBands && columnSkip == 1 && bandList.empty())
+               {
+                  copySpan(pSrc, pDst, static_cast<size_t>(width) * bands);
+                  pDst += static_cast<size_t>(width) * bands;
+               }
+               else if (!bandList.empty())
+               {
+                  //gather the listed bands of each pixel through the band list
+                  for (unsigned int col = 0; col < width; ++col, pSrc += pixelStride)
+                  {
+                     for (unsigned int band = 0; band < bands; ++band)
                      {
-                        daImage->toPixel(heightStart + row, widthStart + col);
-                        if (!daImage.isValid())
-                        {
-                           throw std::exception();
-                        }
-                        memcpy(pData + (width * height * band) + (width * row) + col, daImage->getColumn(), bytesPerElement);
+                        *pDst++ = pSrc[bandList[band]];
                      }
                   }
                }
+               else
+               {
+                  pSrc += bandStart;
+                  for (unsigned int col = 0; col < width; ++col, pSrc += pixelStride, pDst += bands)
+                  {
+                     copyStridedSpan(pSrc, bandSkip, pDst, bands);
+                  }
+               }
             }
-            else if (interleave == BIP)
+         }
+         else if (interleave == BIL)
+         {
+            const unsigned int columnCount = pParam->getColumnCount();
+            if (widthStart == 0 && widthEnd == columnCount - 1 && (bandSkip == 1 || !bandList.empty()))
             {
+               //full width rows hold each band line back to back so the requested bands are one span,
+               //or a band line apiece when they are gathered through the band list
+               const unsigned int pixelBands = pParam->getBandCount();
                FactoryResource<DataRequest> pRequest;
-               pRequest->setInterleaveFormat(BIP);
-               pRequest->setRows(pParam->getActiveRow(heightStart), pParam->getActiveRow(heightEnd), 1);
-               pRequest->setColumns(pParam->getActiveColumn(widthStart), pParam->getActiveColumn(widthEnd), width);
+               pRequest->setInterleaveFormat(BIL);
+               pRequest->setRows(pParam->getActiveRow(heightStart), pParam->getActiveRow(heightEnd),
+                  subcube.getConcurrentRows(heightEnd - heightStart + 1,
+                  static_cast<size_t>(columnCount) * pixelBands * sizeof(T)));
+               pRequest->setColumns(pParam->getActiveColumn(0), pParam->getActiveColumn(columnCount - 1), columnCount);
+               pRequest->setBands(pParam->getActiveBand(0), pParam->getActiveBand(pixelBands - 1), pixelBands);
                DataAccessor daImage = pElement->getDataAccessor(pRequest.release());
+
+               T* pDst = pData;
                for (unsigned int row = 0; row < height; ++row)
                {
-                  for (unsigned int col = 0; col < width; ++col)
+                  daImage->toPixel(heightStart + row * rowSkip, 0);
+                  if (!daImage.isValid())
                   {
-                     daImage->toPixel(heightStart + row, widthStart + col);
-                     if (!daImage.isValid())
-                     {
-                        throw std::exception();
-                     }
-                     for (unsigned int band = 0; band < bands; ++band)
+                     throw std::exception();
+                  }
+                  const T* pRow = static_cast<const T*>(daImage->getRow());
+                  if (columnSkip == 1 && bandList.empty())
+                  {
+                     copySpan(pRow + static_cast<size_t>(bandStart) * columnCount, pDst,
+                        static_cast<size_t>(width) * bands);
+                     pDst += static_cast<size_t>(width) * bands;
+                  }
+                  else
+                  {
+                     for (unsigned int band = 0; band < bands; ++band, pDst += width)
                      {
-                        memcpy(pData + (row * width * bands) + (col * bands) + band, static_cast<T*>(daImage->getColumn()) + (band + bandStart), bytesPerElement);
+                        copyStridedSpan(pRow + static_cast<size_t>(subcube.getBand(band)) * columnCount, columnSkip,
+                           pDst, width);
                      }
                   }
                }
             }
-            else if (interleave == BIL)
+            else
             {
-               for (unsigned int row = 0; row < height; ++row)
+               //one accessor per band, each band line of a row is contiguous
+               for (unsigned int band = 0; band < bands; ++band)
                {
-                  for (unsigned int band = 0; band < bands; ++band)
+                  const unsigned int sourceBand = subcube.getBand(band);
+                  FactoryResource<DataRequest> pRequest;
+                  pRequest->setInterleaveFormat(BIL);
+                  pRequest->setRows(pParam->getActiveRow(heightStart), pParam->getActiveRow(heightEnd),
+                     subcube.getConcurrentRows(heightEnd - heightStart + 1,
+                     (widthEnd - widthStart + 1) * sizeof(T)));
+                  pRequest->setColumns(pParam->getActiveColumn(widthStart), pParam->getActiveColumn(widthEnd),
+                     widthEnd - widthStart + 1);
+                  pRequest->setBands(pParam->getActiveBand(sourceBand), pParam->getActiveBand(sourceBand), 1);
+                  DataAccessor daImage = pElement->getDataAccessor(pRequest.release());
+
+                  T* pDst = pData + static_cast<size_t>(band) * width;
+                  for (unsigned int row = 0; row < height; ++row, pDst += static_cast<size_t>(width) * bands)
                   {
-                     FactoryResource<DataRequest> pRequest;
-                     pRequest->setInterleaveFormat(BIL);
-                     pRequest->setRows(pParam->getActiveRow(heightStart + row), pParam->getActiveRow(heightStart + row), 1);
-                     pRequest->setColumns(pParam->getActiveColumn(widthStart), pParam->getActiveColumn(widthEnd), width);
-                     pRequest->setBands(pParam->getActiveBand(bandStart + band), pParam->getActiveBand(bandStart + band), 1);
-                     DataAccessor daImage = pElement->getDataAccessor(pRequest.release());
-                     for (unsigned int col = 0; col < width; ++col)
+                     daImage->toPixel(heightStart + row * rowSkip, widthStart);
+                     if (!daImage.isValid())
                      {
-                        daImage->toPixel(heightStart + row, widthStart + col);
-                        if (!daImage.isValid())
-                        {
-                           throw std::exception();
-                        }
-                        memcpy(pData + (row * width * bands) + (band * width) + col, daImage->getColumn(), bytesPerElement);
+                        throw std::exception();
                      }
+                     copyStridedSpan(static_cast<const T*>(daImage->getColumn()), columnSkip, pDst, width);
                   }
                }
             }
          }
-         catch (...)
+      }
+      catch (...)
+      {
+         return false;
+      }
+      return true;
+   }
+
+   /**
+    * Copies a subcube of a raster element in independent chunks.
+    *
+    * Each chunk is a block of rows, and a single band when BSQ data is copied
+    * without changing its interleave. Every chunk gets its own accessor and
+    * writes a disjoint region of the destination so chunks can be copied on
+    * separate threads. Chunks which change the interleave are extracted into a
+    * scratch buffer of at most MaxChunkBytes and transposed into place with
+    * copyCube().
+    */
+   template<typename T>
+   class SubcubeCopier : public ChunkTask
+   {
+   public:
+      SubcubeCopier(T* pData, RasterElement* pElement, const Subcube& subcube,
+         InterleaveFormatType interleave, unsigned int threadCount) :
+         mpData(pData),
+         mpElement(pElement),
+         mSubcube(subcube),
+         mRows(subcube.getRowCount()),
+         mColumns(subcube.getColumnCount()),
+         mBands(subcube.getBandCount()),
+         mBandGroups(1),
+         mRowsPerChunk(1),
+         mRowBlocks(0)
+      {
+         const RasterDataDescriptor* pDesc = static_cast<const RasterDataDescriptor*>(pElement->getDataDescriptor());
+         mNative = pDesc->getInterleaveFormat();
+         mSameLayout = isSameLayout(mNative, interleave, mRows, mColumns, mBands);
+         getInterleaveStrides(interleave, mRows, mColumns, mBands, mStrides);
+         if (mSameLayout && mNative == BSQ)
          {
-            delete pData;
-            pData = NULL;
-            std::string msg = "error in copying array values to Opticks.";
-            IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, msg.c_str());
-            return;
+            mBandGroups = mBands;
+         }
+         mRowsPerChunk = getRowsPerChunk(mRows, mColumns * (mBands / mBandGroups) * sizeof(T), mBandGroups,
+            threadCount);
+         mRowBlocks = (mRows + mRowsPerChunk - 1) / mRowsPerChunk;
+      }
+
+      size_t getChunkCount() const
+      {
+         return mBandGroups * mRowBlocks;
+      }
+
+      bool processChunk(size_t chunk)
+      {
+         const size_t bandGroup = chunk / mRowBlocks;
+         const size_t row = (chunk % mRowBlocks) * mRowsPerChunk;
+         const size_t count = std::min(mRowsPerChunk, mRows - row);
+         Subcube block = mSubcube;
+         block.mHeightStart = mSubcube.mHeightStart + static_cast<unsigned int>(row) * mSubcube.mRowSkip;
+         block.mHeightEnd = block.mHeightStart + static_cast<unsigned int>(count - 1) * mSubcube.mRowSkip;
+         if (mBandGroups > 1)
+         {
+            block.mBandStart = mSubcube.getBand(static_cast<unsigned int>(bandGroup));
+            block.mBandEnd = block.mBandStart;
+            block.mBandList.clear();
+         }
+
+         T* pDst = mpData + row * mStrides[0] + bandGroup * mStrides[2];
+         if (mSameLayout)
+         {
+            return copyNativeSubcube(pDst, mpElement, block);
+         }
+         std::vector<T> scratch(count * mColumns * mBands);
+         if (!copyNativeSubcube(&scratch[0], mpElement, block))
+         {
+            return false;
          }
+         size_t blockStrides[3];
+         getInterleaveStrides(mNative, count, mColumns, mBands, blockStrides);
+         const size_t counts[3] = {count, mColumns, mBands};
+         copyCube(static_cast<const T*>(&scratch[0]), blockStrides, pDst, mStrides, counts);
+         return true;
       }
+
+   private:
+      T* mpData;
+      RasterElement* mpElement;
+      Subcube mSubcube;
+      InterleaveFormatType mNative;
+      bool mSameLayout;
+      size_t mStrides[3];
+      size_t mRows;
+      size_t mColumns;
+      size_t mBands;
+      size_t mBandGroups;
+      size_t mRowsPerChunk;
+      size_t mRowBlocks;
+   };
+
+   /**
+    * Copy a subcube of a raster element on up to \p threadCount threads.
+    * This does not call into IDL.
+    */
+   template<typename T>
+   void copySubcubeChunks(T* pData, RasterElement* pElement, const Subcube& subcube,
+      InterleaveFormatType interleave, unsigned int threadCount, bool& success)
+   {
+      SubcubeCopier<T> copier(pData, pElement, subcube, interleave, threadCount);
+      success = runChunks(copier, copier.getChunkCount(), threadCount);
    }
 
+   /**
+    * Read a subcube in the element's native interleave on up to \p threadCount threads.
+    * This does not call into IDL.
+    *
+    * @return \c true if the subcube was read, \c false otherwise.
+    */
+   bool readNativeSubcube(void* pData, RasterElement* pElement, const Subcube& subcube, unsigned int threadCount);
+
+   /**
+    * Reads subcubes in the element's native interleave on a background thread so
+    * the next block of data can be read while the current one is processed.
+    */
+   class SubcubeReader
+   {
+   public:
+      SubcubeReader();
+      ~SubcubeReader();
+
+      /**
+       * Start reading a subcube. A read in progress is finished first. If a thread
+       * cannot be started the subcube is read before this returns.
+       *
+       * @param pData
+       *        The destination buffer. It must be large enough to hold the subcube
+       *        and must not be used until wait() returns.
+       */
+      void start(void* pData, RasterElement* pElement, const Subcube& subcube, unsigned int threadCount);
+
+      /**
+       * Wait for the current read to finish.
+       *
+       * @return \c true if the subcube was read, \c false otherwise.
+       */
+      bool wait();
+
+   private:
+      SubcubeReader(const SubcubeReader& rhs);
+      SubcubeReader& operator=(const SubcubeReader& rhs);
+
+      static void* run(void* pArg);
+      void read();
+
+      pthread_t mThread;
+      bool mRunning;
+      bool mSuccess;
+      void* mpData;
+      RasterElement* mpElement;
+      Subcube mSubcube;
+      unsigned int mThreadCount;
+   };
+
+   /**
+    * Copy a subcube of a raster element into a buffer laid out in the given interleave.
+    *
+    * The subcube is split into chunks by SubcubeCopier and the chunks are copied
+    * on getThreadCount() threads.
+    *
+    * @param pData
+    *        The destination buffer. It must be large enough to hold the subcube.
+    * @param pElement
+    *        The raster element to copy from.
+    * @param subcube
+    *        The active rows, columns and bands to copy.
+    * @param interleave
+    *        The interleave of the destination buffer.
+    * @param success
+    *        Set to \c true if the subcube was copied and \c false otherwise.
+    *        An IDL message is posted on failure.
+    */
+   template<typename T>
+   static void copySubcube(T* pData, RasterElement* pElement, const Subcube& subcube,
+      InterleaveFormatType interleave, bool& success)
+   {
+      success = false;
+      if (pData == NULL || pElement == NULL)
+      {
+         return;
+      }
+      if (!interleave.isValid())
+      {
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "Invalid interleave.");
+         return;
+      }
+
+      copySubcubeChunks(pData, pElement, subcube, interleave, getThreadCount(), success);
+      if (!success)
+      {
+         std::string msg = "error in copying array values to IDL.";
+         IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, msg.c_str());
+      }
+   }
+
+   /**
+    * Get the size of a value of an IDL type which copyConvertedSubcube() can
+    * produce, or 0 if the type is not supported.
+    */
+   size_t getIdlTypeSize(int idlType);
+
+   /**
+    * Copy a block of values, replacing bad values when \p pBadValues is not \c NULL.
+    */
+   template<typename S, typename D>
+   void convertCube(const S* pSrc, const size_t srcStrides[3], D* pDst, const size_t dstStrides[3],
+      const size_t counts[3], BadValueFill* pBadValues)
+   {
+      if (pBadValues == NULL)
+      {
+         copyCube(pSrc, srcStrides, pDst, dstStrides, counts);
+      }
+      else
+      {
+         BadValueConverter<S, D> convert(*pBadValues);
+         copyCube(pSrc, srcStrides, pDst, dstStrides, counts, convert);
+      }
+   }
+
+   /**
+    * Converts blocks of a subcube for convertSubcubeWith() with convertCube(), using
+    * the same converter for every band.
+    */
+   template<typename S, typename D>
+   class ValueBlockConverter
+   {
+   public:
+      explicit ValueBlockConverter(BadValueFill* pBadValues) :
+         mpBadValues(pBadValues)
+      {}
+
+      bool isPerBand() const
+      {
+         return false;
+      }
+
+      void operator()(const S* pSrc, const size_t srcStrides[3], D* pDst, const size_t dstStrides[3],
+         const size_t counts[3], size_t band)
+      {
+         convertCube(pSrc, srcStrides, pDst, dstStrides, counts, mpBadValues);
+      }
+
+   private:
+      BadValueFill* mpBadValues;
+   };
+
+   /**
+    * Converts blocks of a subcube for convertSubcubeWith() with a single value
+    * converter for every band.
+    */
+   template<typename S, typename D, typename C>
+   class UniformBlockConverter
+   {
+   public:
+      explicit UniformBlockConverter(C& convert) :
+         mConvert(convert)
+      {}
+
+      bool isPerBand() const
+      {
+         return false;
+      }
+
+      void operator()(const S* pSrc, const size_t srcStrides[3], D* pDst, const size_t dstStrides[3],
+         const size_t counts[3], size_t band)
+      {
+         copyCube(pSrc, srcStrides, pDst, dstStrides, counts, mConvert);
+      }
+
+   private:
+      C& mConvert;
+   };
+
+   /**
+    * Copy a subcube into a buffer of type \p D one block of rows at a time. Each block
+    * is copied into \p pScratch, which holds \p rowsPerBlock rows of the subcube, and
+    * converted from there into the destination while it is still in cache. When
+    * \p ppBands is not \c NULL, each band is written to its own buffer in \p ppBands
+    * instead of \p pDst and \p interleave must be BSQ.
+    *
+    * @param convertBlock
+    *        Converts the values of a block. Its operator() is given the strides and
+    *        counts of the block and of the destination, and the index of the band
+    *        being converted. When its isPerBand() is \c true, or \p ppBands is not
+    *        \c NULL, it is called for one band at a time, otherwise once for every
+    *        band of the block with a band index of 0.
+    */
+   template<typename S, typename D, typename B>
+   void convertSubcubeWith(S* pScratch, D* pDst, void* const* ppBands, RasterElement* pElement,
+      const Subcube& subcube, InterleaveFormatType interleave, size_t rowsPerBlock, unsigned int threadCount,
+      B& convertBlock, bool& success)
+   {
+      const size_t rows = subcube.getRowCount();
+      const size_t columns = subcube.getColumnCount();
+      const size_t bands = subcube.getBandCount();
+      size_t dstStrides[3];
+      success = getInterleaveStrides(interleave, rows, columns, bands, dstStrides);
+      for (size_t row = 0; row < rows && success; row += rowsPerBlock)
+      {
+         const size_t count = std::min(rowsPerBlock, rows - row);
+         Subcube block = subcube;
+         block.mHeightStart = subcube.mHeightStart + static_cast<unsigned int>(row) * subcube.mRowSkip;
+         block.mHeightEnd = block.mHeightStart + static_cast<unsigned int>(count - 1) * subcube.mRowSkip;
+         copySubcubeChunks(pScratch, pElement, block, interleave, threadCount, success);
+         if (!success)
+         {
+            break;
+         }
+
+         size_t srcStrides[3];
+         getInterleaveStrides(interleave, count, columns, bands, srcStrides);
+         const S* pBlock = static_cast<const S*>(pScratch);
+         if (ppBands != NULL)
+         {
+            //each band of the block goes to the same rows of its own buffer
+            const size_t counts[3] = {count, columns, 1};
+            const size_t bandStrides[3] = {columns, 1, 0};
+            for (size_t band = 0; band < bands; ++band)
+            {
+               convertBlock(pBlock + band * srcStrides[2], srcStrides, static_cast<D*>(ppBands[band]) + row * columns,
+                  bandStrides, counts, band);
+            }
+         }
+         else if (convertBlock.isPerBand())
+         {
+            const size_t counts[3] = {count, columns, 1};
+            for (size_t band = 0; band < bands; ++band)
+            {
+               convertBlock(pBlock + band * srcStrides[2], srcStrides,
+                  pDst + row * dstStrides[0] + band * dstStrides[2], dstStrides, counts, band);
+            }
+         }
+         else
+         {
+            const size_t counts[3] = {count, columns, bands};
+            convertBlock(pBlock, srcStrides, pDst + row * dstStrides[0], dstStrides, counts, 0);
+         }
+      }
+   }
+
+   /**
+    * Copy a subcube into a buffer of type \p D with convertSubcubeWith(), converting
+    * the values with convertValue() and replacing bad values when \p pBadValues is
+    * not \c NULL.
+    */
+   template<typename S, typename D>
+   void convertSubcubeTo(S* pScratch, D* pDst, void* const* ppBands, RasterElement* pElement,
+      const Subcube& subcube, InterleaveFormatType interleave, size_t rowsPerBlock, unsigned int threadCount,
+      BadValueFill* pBadValues, bool& success)
+   {
+      ValueBlockConverter<S, D> convertBlock(pBadValues);
+      convertSubcubeWith(pScratch, pDst, ppBands, pElement, subcube, interleave, rowsPerBlock, threadCount,
+         convertBlock, success);
+   }
+
+   /**
+    * Select the destination type of convertSubcubeTo() from an IDL type. This can be
+    * used with switchOnEncoding.
+    */
+   template<typename S>
+   void convertSubcube(S* pScratch, void* pDst, void* const* ppBands, int idlType, RasterElement* pElement,
+      const Subcube& subcube, InterleaveFormatType interleave, size_t rowsPerBlock, unsigned int threadCount,
+      BadValueFill* pBadValues, bool& success)
+   {
+      success = false;
+      switch (idlType)
+      {
+         case IDL_TYP_BYTE:
+            convertSubcubeTo(pScratch, static_cast<UCHAR*>(pDst), ppBands, pElement, subcube, interleave,
+               rowsPerBlock, threadCount, pBadValues, success);
+            break;
+         case IDL_TYP_INT:
+            convertSubcubeTo(pScratch, static_cast<IDL_INT*>(pDst), ppBands, pElement, subcube, interleave,
+               rowsPerBlock, threadCount, pBadValues, success);
+            break;
+         case IDL_TYP_UINT:
+            convertSubcubeTo(pScratch, static_cast<IDL_UINT*>(pDst), ppBands, pElement, subcube, interleave,
+               rowsPerBlock, threadCount, pBadValues, success);
+            break;
+         case IDL_TYP_LONG:
+            convertSubcubeTo(pScratch, static_cast<IDL_LONG*>(pDst), ppBands, pElement, subcube, interleave,
+               rowsPerBlock, threadCount, pBadValues, success);
+            break;
+         case IDL_TYP_ULONG:
+            convertSubcubeTo(pScratch, static_cast<IDL_ULONG*>(pDst), ppBands, pElement, subcube, interleave,
+               rowsPerBlock, threadCount, pBadValues, success);
+            break;
+         case IDL_TYP_LONG64:
+            convertSubcubeTo(pScratch, static_cast<IDL_LONG64*>(pDst), ppBands, pElement, subcube, interleave,
+               rowsPerBlock, threadCount, pBadValues, success);
+            break;
+         case IDL_TYP_ULONG64:
+            convertSubcubeTo(pScratch, static_cast<IDL_ULONG64*>(pDst), ppBands, pElement, subcube, interleave,
+               rowsPerBlock, threadCount, pBadValues, success);
+            break;
+         case IDL_TYP_FLOAT:
+            convertSubcubeTo(pScratch, static_cast<float*>(pDst), ppBands, pElement, subcube, interleave,
+               rowsPerBlock, threadCount, pBadValues, success);
+            break;
+         case IDL_TYP_DOUBLE:
+            convertSubcubeTo(pScratch, static_cast<double*>(pDst), ppBands, pElement, subcube, interleave,
+               rowsPerBlock, threadCount, pBadValues, success);
+            break;
+         case IDL_TYP_COMPLEX:
+            convertSubcubeTo(pScratch, static_cast<IDL_COMPLEX*>(pDst), ppBands, pElement, subcube, interleave,
+               rowsPerBlock, threadCount, pBadValues, success);
+            break;
+         case IDL_TYP_DCOMPLEX:
+            convertSubcubeTo(pScratch, static_cast<IDL_DCOMPLEX*>(pDst), ppBands, pElement, subcube, interleave,
+               rowsPerBlock, threadCount, pBadValues, success);
+            break;
+         default:
+            break;
+      }
+   }
+
+   /**
+    * Converts blocks of a subcube for convertSubcubeWith() one band at a time, applying
+    * the gain and offset of the band with a CalibrationConverter.
+    */
+   template<typename S, typename D>
+   class CalibrationBlockConverter
+   {
+   public:
+      CalibrationBlockConverter(const std::vector<double>& gains, const std::vector<double>& offsets,
+         BadValueFill& badValues) :
+         mGains(gains),
+         mOffsets(offsets),
+         mBadValues(badValues)
+      {}
+
+      bool isPerBand() const
+      {
+         return true;
+      }
+
+      void operator()(const S* pSrc, const size_t srcStrides[3], D* pDst, const size_t dstStrides[3],
+         const size_t counts[3], size_t band)
+      {
+         CalibrationConverter<S, D> convert(mGains[band], mOffsets[band], mBadValues);
+         copyCube(pSrc, srcStrides, pDst, dstStrides, counts, convert);
+      }
+
+   private:
+      const std::vector<double>& mGains;
+      const std::vector<double>& mOffsets;
+      BadValueFill& mBadValues;
+   };
+
+   /**
+    * Copy a subcube into a real buffer with convertSubcubeWith(), applying the gain
+    * and offset of each band of the subcube to its values.
+    */
+   template<typename S, typename D>
+   void calibrateSubcubeTo(S* pScratch, D* pDst, RasterElement* pElement, const Subcube& subcube,
+      InterleaveFormatType interleave, size_t rowsPerBlock, unsigned int threadCount,
+      const std::vector<double>& gains, const std::vector<double>& offsets, BadValueFill& badValues, bool& success)
+   {
+      CalibrationBlockConverter<S, D> convertBlock(gains, offsets, badValues);
+      convertSubcubeWith(pScratch, pDst, NULL, pElement, subcube, interleave, rowsPerBlock, threadCount,
+         convertBlock, success);
+   }
+
+   /**
+    * Select the destination type of calibrateSubcubeTo() from a real IDL type. This
+    * can be used with switchOnEncoding.
+    */
+   template<typename S>
+   void calibrateSubcube(S* pScratch, void* pDst, int idlType, RasterElement* pElement, const Subcube& subcube,
+      InterleaveFormatType interleave, size_t rowsPerBlock, unsigned int threadCount,
+      const std::vector<double>& gains, const std::vector<double>& offsets, BadValueFill& badValues, bool& success)
+   {
+      success = false;
+      if (idlType == IDL_TYP_FLOAT)
+      {
+         calibrateSubcubeTo(pScratch, static_cast<float*>(pDst), pElement, subcube, interleave, rowsPerBlock,
+            threadCount, gains, offsets, badValues, success);
+      }
+      else if (idlType == IDL_TYP_DOUBLE)
+      {
+         calibrateSubcubeTo(pScratch, static_cast<double*>(pDst), pElement, subcube, interleave, rowsPerBlock,
+            threadCount, gains, offsets, badValues, success);
+      }
+   }
+
+   /**
+    * The value computed from each complex value by copyDetectedSubcube().
+    */
+   enum DetectionType
+   {
+      DETECT_MAGNITUDE, /**< The magnitude, as ABS in IDL. */
+      DETECT_POWER,     /**< The squared magnitude. */
+      DETECT_DB,        /**< The power in decibels, as 10 * ALOG10 of the power in IDL. */
+      DETECT_PHASE      /**< The phase in radians, as ATAN with the PHASE keyword in IDL. */
+   };
+
+   /**
+    * Get the real and imaginary parts of a value. Real values have no imaginary part.
+    */
+   template<typename S>
+   inline void getComplexParts(const S& src, float& real, float& imaginary)
+   {
+      real = static_cast<float>(src);
+      imaginary = 0.0f;
+   }
+
+   inline void getComplexParts(const IntegerComplex& src, float& real, float& imaginary)
+   {
+      real = src.mReal;
+      imaginary = src.mImaginary;
+   }
+
+   inline void getComplexParts(const FloatComplex& src, float& real, float& imaginary)
+   {
+      real = src.mReal;
+      imaginary = src.mImaginary;
+   }
+
+   /**
+    * Converts each value to a detected float value. The detection is a template
+    * argument so the switch is resolved when the converter is compiled.
+    */
+   template<typename S, DetectionType T>
+   struct DetectionConverter
+   {
+      void operator()(const S& src, float& dst)
+      {
+         float real = 0.0f;
+         float imaginary = 0.0f;
+         getComplexParts(src, real, imaginary);
+         const float power = real * real + imaginary * imaginary;
+         switch (T)
+         {
+            case DETECT_MAGNITUDE:
+               dst = sqrtf(power);
+               break;
+            case DETECT_POWER:
+               dst = power;
+               break;
+            case DETECT_DB:
+               dst = 10.0f * log10f(power);
+               break;
+            default:
+               dst = atan2f(imaginary, real);
+               break;
+         }
+      }
+   };
+
+   /**
+    * Copy a subcube into a float buffer with convertSubcubeWith(), computing each
+    * value with \p convert.
+    */
+   template<typename S, typename C>
+   void detectSubcubeWith(S* pScratch, float* pDst, RasterElement* pElement, const Subcube& subcube,
+      InterleaveFormatType interleave, size_t rowsPerBlock, unsigned int threadCount, C& convert, bool& success)
+   {
+      UniformBlockConverter<S, float, C> convertBlock(convert);
+      convertSubcubeWith(pScratch, pDst, NULL, pElement, subcube, interleave, rowsPerBlock, threadCount,
+         convertBlock, success);
+   }
+
+   /**
+    * Select the converter of detectSubcubeWith() from a detection. This can be used
+    * with switchOnEncoding.
+    */
+   template<typename S>
+   void detectSubcube(S* pScratch, float* pDst, DetectionType detection, RasterElement* pElement,
+      const Subcube& subcube, InterleaveFormatType interleave, size_t rowsPerBlock, unsigned int threadCount,
+      bool& success)
+   {
+      switch (detection)
+      {
+         case DETECT_MAGNITUDE:
+         {
+            DetectionConverter<S, DETECT_MAGNITUDE> convert;
+            detectSubcubeWith(pScratch, pDst, pElement, subcube, interleave, rowsPerBlock, threadCount, convert,
+               success);
+            break;
+         }
+         case DETECT_POWER:
+         {
+            DetectionConverter<S, DETECT_POWER> convert;
+            detectSubcubeWith(pScratch, pDst, pElement, subcube, interleave, rowsPerBlock, threadCount, convert,
+               success);
+            break;
+         }
+         case DETECT_DB:
+         {
+            DetectionConverter<S, DETECT_DB> convert;
+            detectSubcubeWith(pScratch, pDst, pElement, subcube, interleave, rowsPerBlock, threadCount, convert,
+               success);
+            break;
+         }
+         default:
+         {
+            DetectionConverter<S, DETECT_PHASE> convert;
+            detectSubcubeWith(pScratch, pDst, pElement, subcube, interleave, rowsPerBlock, threadCount, convert,
+               success);
+            break;
+         }
+      }
+   }
+
+   /**
+    * Copy a subcube of a raster element into a buffer of another data type laid out
+    * in the given interleave. The values are converted as they are copied so the
+    * data is only read once.
+    *
+    * @param pData
+    *        The destination buffer. It must be large enough to hold the subcube
+    *        as \p idlType values.
+    * @param idlType
+    *        The IDL type of the destination buffer. getIdlTypeSize() must be
+    *        non-zero for it.
+    * @param pBadValues
+    *        Values to replace as they are copied, or \c NULL to copy every value.
+    *        Its count is increased by the number of values replaced.
+    * @return \c true if the subcube was copied, \c false otherwise.
+    *         An IDL message is posted on failure.
+    */
+   bool copyConvertedSubcube(void* pData, int idlType, RasterElement* pElement, const Subcube& subcube,
+      InterleaveFormatType interleave, BadValueFill* pBadValues = NULL);
+
+   /**
+    * Copy a subcube of a raster element into a separate buffer for each band, as
+    * copyConvertedSubcube() would copy it as BSQ data. The subcube is read once.
+    *
+    * @param bands
+    *        A buffer for each band of the subcube, each large enough to hold the rows
+    *        and columns of the subcube as \p idlType values.
+    * @return \c true if the subcube was copied, \c false otherwise.
+    *         An IDL message is posted on failure.
+    */
+   bool copySplitBands(const std::vector<void*>& bands, int idlType, RasterElement* pElement,
+      const Subcube& subcube, BadValueFill* pBadValues = NULL);
+
+   /**
+    * Copy a subcube of a raster element into a float buffer laid out in the given
+    * interleave, computing the magnitude, power or phase of each value as it is
+    * copied. Only the float values are written, so complex data does not have to be
+    * returned to IDL and detected there.
+    *
+    * @param pData
+    *        The destination buffer. It must be large enough to hold the subcube as
+    *        float values.
+    * @return \c true if the subcube was copied, \c false otherwise.
+    *         An IDL message is posted on failure.
+    */
+   bool copyDetectedSubcube(float* pData, DetectionType detection, RasterElement* pElement,
+      const Subcube& subcube, InterleaveFormatType interleave);
+
+   /**
+    * Copy a subcube of a raster element into a float or double buffer laid out in the
+    * given interleave, computing gain * value + offset for each value with the gain and
+    * offset of its band as it is copied. Bad values are replaced before they are scaled.
+    *
+    * @param idlType
+    *        The IDL type of the destination buffer, either \c IDL_TYP_FLOAT or
+    *        \c IDL_TYP_DOUBLE.
+    * @param gains
+    *        The gain of each band of the subcube.
+    * @param offsets
+    *        The offset of each band of the subcube.
+    * @param pBadValues
+    *        Values to replace as they are copied, or \c NULL to copy every value.
+    * @return \c true if the subcube was copied, \c false otherwise.
+    *         An IDL message is posted on failure.
+    */
+   bool copyCalibratedSubcube(void* pData, int idlType, RasterElement* pElement, const Subcube& subcube,
+      InterleaveFormatType interleave, const std::vector<double>& gains, const std::vector<double>& offsets,
+      BadValueFill* pBadValues = NULL);
+
+   /**
+    * Find the pixels of a subcube which are selected by a mask.
+    *
+    * @param pMask
+    *        An AOI, or a raster element whose first band is non-zero for each selected
+    *        pixel. A raster element must hold at least the rows and columns of the subcube.
+    * @param rows
+    *        Set to the active row numbers of the selected pixels, in row order.
+    * @param columns
+    *        Set to the active column numbers of the selected pixels.
+    * @return \c true if the mask was searched, \c false if it can't be used as a mask.
+    */
+   bool getMaskedPixels(DataElement* pMask, const Subcube& subcube, std::vector<unsigned int>& rows,
+      std::vector<unsigned int>& columns);
+
+   /**
+    * Copy selected pixels of a subcube into a buffer holding the bands of each pixel
+    * next to each other. The rows holding selected pixels are read once, in blocks
+    * which start at a selected row, so rows without selected pixels are skipped. Each
+    * block only reads the columns spanned by its selected pixels. Complex integer data
+    * is converted to IDL_COMPLEX.
+    *
+    * @param rows
+    *        The active row numbers of the pixels, in row order, as from getMaskedPixels().
+    * @param columns
+    *        The active column numbers of the pixels.
+    * @param pBadValues
+    *        Values to replace as they are copied, or \c NULL to copy every value.
+    * @return \c true if the pixels were copied, \c false otherwise.
+    *         An IDL message is posted on failure.
+    */
+   bool copyMaskedPixels(void* pData, RasterElement* pElement, const Subcube& subcube,
+      const std::vector<unsigned int>& rows, const std::vector<unsigned int>& columns,
+      BadValueFill* pBadValues = NULL);
+
+   /**
+    * Copy the bands of pixels at any positions into a buffer holding the bands of each
+    * pixel next to each other, in the order the pixels are given. The pixels are sorted
+    * by row and grouped into blocks of rows, and each block is read once on its own
+    * thread, from the first to the last row and column holding one of its pixels. Complex
+    * integer data is converted to IDL_COMPLEX.
+    *
+    * @param subcube
+    *        The bands to copy. Its rows and columns are not used.
+    * @param rows
+    *        The active row number of each pixel.
+    * @param columns
+    *        The active column number of each pixel.
+    * @return \c true if the pixels were copied, \c false otherwise.
+    *         An IDL message is posted on failure.
+    */
+   bool copyPixels(void* pData, RasterElement* pElement, const Subcube& subcube,
+      const std::vector<unsigned int>& rows, const std::vector<unsigned int>& columns);
+
    RasterChannelType getRasterChannelType(const std::string& color);
 
    static std::vector<WizardObject*> spWizards;
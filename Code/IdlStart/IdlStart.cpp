@@ -11,13 +11,18 @@
 #include "AppConfig.h"
 #include "AppVerify.h"
 #include "ArrayCommands.h"
+#include "AsyncTransfers.h"
+#include "ExportRegistry.h"
 #include "GpuCommands.h"
 #include "IdlFunctions.h"
 #include "IdlStart.h"
 #include "LayerCommands.h"
 #include "MetadataCommands.h"
 #include "MiscCommands.h"
+#include "OverviewCache.h"
 #include "PlugInRegistration.h"
+#include "ResultCache.h"
+#include "TileCache.h"
 #include "VisualizationCommands.h"
 #include "WindowCommands.h"
 
@@ -170,8 +175,13 @@ extern "C" LINKAGE int execute_idl(int commandCount,
 extern "C" LINKAGE int close_idl()
 {
    IdlFunctions::cleanupWizardObjects();
+   AsyncTransfers::instance().clear();
+   TileCache::instance().clear();
+   ResultCache::instance().clear();
+   OverviewCache::instance().clear();
    spSendOutput = NULL;
    IDL_ToutPop();
    IDL_Cleanup(IDL_TRUE);
+   ExportRegistry::instance().clear();
    return 1;
 }
\ No newline at end of file
@@ -0,0 +1,257 @@
+/*
+ * The information in this file is
+ * Copyright(c) 2007 Ball Aerospace & Technologies Corporation
+ * and is subject to the terms and conditions of the
+ * GNU Lesser General Public License Version 2.1
+ * The license text is available from
+ * http://www.gnu.org/licenses/lgpl.html
+ */
+
+#include "ConfigurationSettings.h"
+#include "DataVariant.h"
+#include "IdlFunctions.h"
+#include "OverviewCache.h"
+#include "RasterDataDescriptor.h"
+#include "RasterElement.h"
+#include <algorithm>
+#include <new>
+
+namespace
+{
+   const size_t BytesPerMegabyte = 1024 * 1024;
+}
+
+OverviewCache& OverviewCache::instance()
+{
+   static OverviewCache sCache;
+   return sCache;
+}
+
+OverviewCache::OverviewCache() :
+   mWatcher(*this, true),
+   mBudget(0),
+   mBytes(0)
+{}
+
+bool OverviewCache::applySettings()
+{
+   const unsigned int megabytes = dv_cast<unsigned int>(
+      Service<ConfigurationSettings>()->getSetting("IdlInterpreter/OverviewCacheSize"), 128);
+   mBudget = static_cast<size_t>(megabytes) * BytesPerMegabyte;
+   evict();
+   return megabytes > 0;
+}
+
+unsigned int OverviewCache::getLevelCount(unsigned int rows, unsigned int columns)
+{
+   unsigned int levels = 0;
+   while (rows > 1 && columns > 1)
+   {
+      rows = (rows + 1) / 2;
+      columns = (columns + 1) / 2;
+      ++levels;
+   }
+   return levels;
+}
+
+const OverviewCache::Level* OverviewCache::getLevel(RasterElement* pElement, unsigned int band,
+                                                    unsigned int level, bool keep, Level& built)
+{
+   const RasterDataDescriptor* pDesc = (pElement == NULL) ? NULL :
+      static_cast<const RasterDataDescriptor*>(pElement->getDataDescriptor());
+   if (pDesc == NULL || level == 0 || level > getLevelCount(pDesc->getRowCount(), pDesc->getColumnCount()))
+   {
+      return NULL;
+   }
+
+   //the first level is the largest, so a band whose first level doesn't fit is never kept
+   const uint64_t firstLevelBytes = static_cast<uint64_t>((pDesc->getRowCount() + 1) / 2) *
+      ((pDesc->getColumnCount() + 1) / 2) * sizeof(float);
+   if (!keep || firstLevelBytes > mBudget)
+   {
+      return buildLevel(pElement, band, level, built);
+   }
+
+   const PyramidKey key(pElement, band);
+   try
+   {
+      mWatcher.watch(pElement);
+      std::map<PyramidKey, Pyramid>::iterator found = mPyramids.find(key);
+      if (found == mPyramids.end())
+      {
+         mRecent.push_front(key);
+         found = mPyramids.insert(std::make_pair(key, Pyramid())).first;
+         found->second.mRecent = mRecent.begin();
+      }
+      else
+      {
+         mRecent.splice(mRecent.begin(), mRecent, found->second.mRecent);
+      }
+      Pyramid& pyramid = found->second;
+      std::vector<Level>& levels = pyramid.mLevels;
+      if (levels.empty())
+      {
+         Level first;
+         if (!buildFirstLevel(pElement, band, first))
+         {
+            return NULL;
+         }
+         levels.push_back(Level());
+         levels.back().mRows = first.mRows;
+         levels.back().mColumns = first.mColumns;
+         levels.back().mData.swap(first.mData);
+         pyramid.mBytes += levels.back().mData.size() * sizeof(float);
+         mBytes += levels.back().mData.size() * sizeof(float);
+      }
+      while (levels.size() < level)
+      {
+         Level next;
+         halveLevel(levels.back(), next);
+         levels.push_back(Level());
+         levels.back().mRows = next.mRows;
+         levels.back().mColumns = next.mColumns;
+         levels.back().mData.swap(next.mData);
+         pyramid.mBytes += levels.back().mData.size() * sizeof(float);
+         mBytes += levels.back().mData.size() * sizeof(float);
+      }
+      evict();
+      return &levels[level - 1];
+   }
+   catch (const std::bad_alloc&)
+   {
+      removeLevels(pElement);
+      return NULL;
+   }
+}
+
+void OverviewCache::invalidate(RasterElement* pElement)
+{
+   removeLevels(pElement);
+}
+
+void OverviewCache::clear()
+{
+   mWatcher.clear();
+   mPyramids.clear();
+   mRecent.clear();
+   mBytes = 0;
+}
+
+bool OverviewCache::buildFirstLevel(RasterElement* pElement, unsigned int band, Level& level)
+{
+   const RasterDataDescriptor* pDesc = static_cast<const RasterDataDescriptor*>(pElement->getDataDescriptor());
+   const unsigned int rows = pDesc->getRowCount();
+   const unsigned int columns = pDesc->getColumnCount();
+   level.mRows = (rows + 1) / 2;
+   level.mColumns = (columns + 1) / 2;
+   level.mData.resize(static_cast<size_t>(level.mRows) * level.mColumns);
+
+   //the band is read in blocks of an even number of rows so each block fills whole rows of the level
+   const size_t rowBytes = static_cast<size_t>(columns) * sizeof(float);
+   const unsigned int blockRows = static_cast<unsigned int>(std::max<size_t>(2,
+      std::min<size_t>(rows, IdlFunctions::MaxChunkBytes / rowBytes) & ~static_cast<size_t>(1)));
+   std::vector<float> block(static_cast<size_t>(blockRows) * columns);
+   IdlFunctions::Subcube subcube;
+   subcube.mWidthEnd = columns - 1;
+   subcube.mBandStart = band;
+   subcube.mBandEnd = band;
+   for (unsigned int row = 0; row < rows; row += blockRows)
+   {
+      subcube.mHeightStart = row;
+      subcube.mHeightEnd = std::min(row + blockRows, rows) - 1;
+      if (!IdlFunctions::copyConvertedSubcube(&block[0], IDL_TYP_FLOAT, pElement, subcube, BSQ))
+      {
+         return false;
+      }
+      halve(&block[0], subcube.getRowCount(), columns, &level.mData[static_cast<size_t>(row / 2) * level.mColumns]);
+   }
+   return true;
+}
+
+const OverviewCache::Level* OverviewCache::buildLevel(RasterElement* pElement, unsigned int band,
+                                                      unsigned int level, Level& built)
+{
+   try
+   {
+      //only the level before the next one is held
+      if (!buildFirstLevel(pElement, band, built))
+      {
+         return NULL;
+      }
+      for (unsigned int current = 1; current < level; ++current)
+      {
+         Level next;
+         halveLevel(built, next);
+         built.mRows = next.mRows;
+         built.mColumns = next.mColumns;
+         built.mData.swap(next.mData);
+      }
+   }
+   catch (const std::bad_alloc&)
+   {
+      return NULL;
+   }
+   return &built;
+}
+
+void OverviewCache::halveLevel(const Level& src, Level& dst)
+{
+   dst.mRows = (src.mRows + 1) / 2;
+   dst.mColumns = (src.mColumns + 1) / 2;
+   dst.mData.resize(static_cast<size_t>(dst.mRows) * dst.mColumns);
+   halve(&src.mData[0], src.mRows, src.mColumns, &dst.mData[0]);
+}
+
+void OverviewCache::halve(const float* pSrc, unsigned int rows, unsigned int columns, float* pDst)
+{
+   const unsigned int pairs = columns / 2;
+   const unsigned int dstColumns = (columns + 1) / 2;
+   for (unsigned int row = 0; row < rows; row += 2, pDst += dstColumns)
+   {
+      //the last row of an odd number of rows is averaged with itself
+      const float* pTop = pSrc + static_cast<size_t>(row) * columns;
+      const float* pBottom = (row + 1 < rows) ? pTop + columns : pTop;
+      for (unsigned int column = 0; column < pairs; ++column)
+      {
+         pDst[column] = 0.25f * (pTop[2 * column] + pTop[2 * column + 1] + pBottom[2 * column] +
+            pBottom[2 * column + 1]);
+      }
+      if (dstColumns > pairs)
+      {
+         pDst[pairs] = 0.5f * (pTop[columns - 1] + pBottom[columns - 1]);
+      }
+   }
+}
+
+void OverviewCache::removeLevels(RasterElement* pElement)
+{
+   std::map<PyramidKey, Pyramid>::iterator pyramid = mPyramids.lower_bound(PyramidKey(pElement, 0U));
+   while (pyramid != mPyramids.end() && pyramid->first.first == pElement)
+   {
+      mBytes -= pyramid->second.mBytes;
+      mRecent.erase(pyramid->second.mRecent);
+      mPyramids.erase(pyramid++);
+   }
+}
+
+void OverviewCache::evict()
+{
+   //the most recently used pyramid holds the level being returned, so it is always kept
+   while (mBytes > mBudget && mRecent.size() > 1)
+   {
+      std::map<PyramidKey, Pyramid>::iterator found = mPyramids.find(mRecent.back());
+      mBytes -= found->second.mBytes;
+      mPyramids.erase(found);
+      mRecent.pop_back();
+   }
+}
+
+void OverviewCache::elementDeleted(RasterElement* pElement)
+{
+   removeLevels(pElement);
+}
+
+void OverviewCache::elementModified(RasterElement* pElement)
+{
+   removeLevels(pElement);
+}
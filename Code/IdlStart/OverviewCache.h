@@ -0,0 +1,139 @@
+/*
+ * The information in this file is
+ * Copyright(c) 2007 Ball Aerospace & Technologies Corporation
+ * and is subject to the terms and conditions of the
+ * GNU Lesser General Public License Version 2.1
+ * The license text is available from
+ * http://www.gnu.org/licenses/lgpl.html
+ */
+
+#ifndef OVERVIEWCACHE_H
+#define OVERVIEWCACHE_H
+
+#include "AppConfig.h"
+#include "ElementWatcher.h"
+#include <list>
+#include <map>
+#include <utility>
+#include <vector>
+
+class RasterElement;
+
+/**
+ * These are internal support methods not used in IDL.
+ * \cond INTERNAL
+ */
+
+/**
+ * Keeps reduced resolution copies of the bands of raster elements so a zoomed out
+ * view of a large raster element can be returned without reading it at full resolution.
+ *
+ * Each band has a pyramid of levels. Level 1 is the band at half resolution and each
+ * further level halves the one before it. Each value is the mean of the 2 by 2 block of
+ * values it covers. Levels are built as they are first needed, reading the band once at
+ * full resolution, and are kept until the raster element is modified or deleted. The
+ * pyramids are evicted in least recently used order once the cache holds more than
+ * the IdlInterpreter/OverviewCacheSize setting, in megabytes.
+ */
+class OverviewCache : private ElementWatcher::Listener
+{
+public:
+   /**
+    * A level of the pyramid of a band, stored as float values in row order.
+    */
+   struct Level
+   {
+      Level() :
+         mRows(0),
+         mColumns(0)
+      {}
+
+      unsigned int mRows;
+      unsigned int mColumns;
+      std::vector<float> mData;
+   };
+
+   static OverviewCache& instance();
+
+   /**
+    * Read the cache settings.
+    *
+    * @return \c true if the cache should be used, \c false if its size is zero.
+    */
+   bool applySettings();
+
+   /**
+    * Get the number of levels below full resolution a raster element can have. The
+    * last level is a single row or column.
+    */
+   static unsigned int getLevelCount(unsigned int rows, unsigned int columns);
+
+   /**
+    * Get a level of the pyramid of a band, building it and any levels before it which
+    * are not kept yet.
+    *
+    * @param band
+    *        The active band number.
+    * @param level
+    *        The level to get, starting from 1.
+    * @param keep
+    *        If \c false, the levels are built without being kept. This is used when the
+    *        data of the element may be changed without a signal or the cache is disabled.
+    *        Bands whose first level is larger than the cache are never kept.
+    * @param built
+    *        A level to hold the result when \p keep is \c false.
+    * @return The level, or \c NULL if it could not be built. The level stays valid until
+    *         the next call.
+    */
+   const Level* getLevel(RasterElement* pElement, unsigned int band, unsigned int level, bool keep,
+      Level& built);
+
+   /**
+    * Drop the levels of an element whose data may be changed without a signal, such
+    * as when an IDL array refers to the element's data.
+    */
+   void invalidate(RasterElement* pElement);
+
+   /**
+    * Drop every level.
+    */
+   void clear();
+
+private:
+   typedef std::pair<RasterElement*, unsigned int> PyramidKey;
+
+   struct Pyramid
+   {
+      Pyramid() :
+         mBytes(0)
+      {}
+
+      std::vector<Level> mLevels;
+      size_t mBytes;
+      std::list<PyramidKey>::iterator mRecent;
+   };
+
+   OverviewCache();
+   OverviewCache(const OverviewCache& rhs);
+   OverviewCache& operator=(const OverviewCache& rhs);
+
+   static bool buildFirstLevel(RasterElement* pElement, unsigned int band, Level& level);
+   static void halveLevel(const Level& src, Level& dst);
+   static void halve(const float* pSrc, unsigned int rows, unsigned int columns, float* pDst);
+   static const Level* buildLevel(RasterElement* pElement, unsigned int band, unsigned int level, Level& built);
+   void removeLevels(RasterElement* pElement);
+   void evict();
+
+   void elementDeleted(RasterElement* pElement);
+   void elementModified(RasterElement* pElement);
+
+   ElementWatcher mWatcher;
+   std::map<PyramidKey, Pyramid> mPyramids;
+   std::list<PyramidKey> mRecent;
+   size_t mBudget;
+   size_t mBytes;
+};
+
+///\endcond INTERNAL
+
+#endif
@@ -0,0 +1,181 @@
+/*
+ * The information in this file is
+ * Copyright(c) 2007 Ball Aerospace & Technologies Corporation
+ * and is subject to the terms and conditions of the
+ * GNU Lesser General Public License Version 2.1
+ * The license text is available from
+ * http://www.gnu.org/licenses/lgpl.html
+ */
+
+#include "ConfigurationSettings.h"
+#include "DataVariant.h"
+#include "RasterElement.h"
+#include "ResultCache.h"
+#include <string.h>
+#include <new>
+
+namespace
+{
+   const size_t BytesPerMegabyte = 1024 * 1024;
+}
+
+ResultCache& ResultCache::instance()
+{
+   static ResultCache sCache;
+   return sCache;
+}
+
+ResultCache::ResultCache() :
+   mWatcher(*this, true),
+   mBudget(0),
+   mBytes(0)
+{}
+
+ResultCache::ResultKey::ResultKey(RasterElement* pElement, unsigned int version,
+                                  const IdlFunctions::Subcube& subcube, InterleaveFormatType interleave,
+                                  int type) :
+   mpElement(pElement),
+   mVersion(version)
+{
+   const unsigned int values[] = {subcube.mHeightStart, subcube.mHeightEnd, subcube.mWidthStart,
+      subcube.mWidthEnd, subcube.mBandStart, subcube.mBandEnd, subcube.mRowSkip, subcube.mColumnSkip,
+      subcube.mBandSkip, static_cast<unsigned int>(interleave), static_cast<unsigned int>(type)};
+   mValues.assign(values, values + sizeof(values) / sizeof(values[0]));
+   mValues.insert(mValues.end(), subcube.mBandList.begin(), subcube.mBandList.end());
+}
+
+bool ResultCache::ResultKey::operator<(const ResultKey& other) const
+{
+   if (mpElement != other.mpElement)
+   {
+      return mpElement < other.mpElement;
+   }
+   if (mVersion != other.mVersion)
+   {
+      return mVersion < other.mVersion;
+   }
+   return mValues < other.mValues;
+}
+
+bool ResultCache::applySettings()
+{
+   const unsigned int megabytes = dv_cast<unsigned int>(
+      Service<ConfigurationSettings>()->getSetting("IdlInterpreter/ResultCacheSize"), 128);
+   mBudget = static_cast<size_t>(megabytes) * BytesPerMegabyte;
+   evict();
+   return megabytes > 0;
+}
+
+bool ResultCache::copy(RasterElement* pElement, const IdlFunctions::Subcube& subcube,
+                       InterleaveFormatType interleave, int type, UCHAR* pData, size_t bytes)
+{
+   std::map<ResultKey, Result>::iterator found =
+      mResults.find(ResultKey(pElement, getVersion(pElement), subcube, interleave, type));
+   if (found == mResults.end() || found->second.mData.size() != bytes)
+   {
+      return false;
+   }
+   memcpy(pData, &found->second.mData[0], bytes);
+   mRecent.splice(mRecent.begin(), mRecent, found->second.mRecent);
+   return true;
+}
+
+void ResultCache::insert(RasterElement* pElement, const IdlFunctions::Subcube& subcube,
+                         InterleaveFormatType interleave, int type, const UCHAR* pData, size_t bytes)
+{
+   if (bytes == 0 || bytes > mBudget / 4)
+   {
+      return;
+   }
+   const ResultKey key(pElement, getVersion(pElement), subcube, interleave, type);
+   if (mResults.find(key) != mResults.end())
+   {
+      return;
+   }
+
+   Result& result = mResults[key];
+   try
+   {
+      result.mData.assign(pData, pData + bytes);
+   }
+   catch (const std::bad_alloc&)
+   {
+      mResults.erase(key);
+      return;
+   }
+   mRecent.push_front(key);
+   result.mRecent = mRecent.begin();
+   mBytes += bytes;
+   evict();
+}
+
+void ResultCache::invalidate(RasterElement* pElement)
+{
+   std::map<RasterElement*, unsigned int>::iterator version = mVersions.find(pElement);
+   if (version != mVersions.end())
+   {
+      ++version->second;
+      removeResults(pElement);
+   }
+}
+
+void ResultCache::clear()
+{
+   mWatcher.clear();
+   mVersions.clear();
+   mResults.clear();
+   mRecent.clear();
+   mBytes = 0;
+}
+
+unsigned int ResultCache::getVersion(RasterElement* pElement)
+{
+   std::map<RasterElement*, unsigned int>::iterator version = mVersions.find(pElement);
+   if (version != mVersions.end())
+   {
+      return version->second;
+   }
+   mVersions[pElement] = 0;
+   mWatcher.watch(pElement);
+   return 0;
+}
+
+void ResultCache::removeResults(RasterElement* pElement)
+{
+   std::map<ResultKey, Result>::iterator result = mResults.begin();
+   while (result != mResults.end())
+   {
+      if (result->first.mpElement == pElement)
+      {
+         mBytes -= result->second.mData.size();
+         mRecent.erase(result->second.mRecent);
+         mResults.erase(result++);
+      }
+      else
+      {
+         ++result;
+      }
+   }
+}
+
+void ResultCache::evict()
+{
+   while (mBytes > mBudget && !mRecent.empty())
+   {
+      std::map<ResultKey, Result>::iterator found = mResults.find(mRecent.back());
+      mBytes -= found->second.mData.size();
+      mResults.erase(found);
+      mRecent.pop_back();
+   }
+}
+
+void ResultCache::elementDeleted(RasterElement* pElement)
+{
+   removeResults(pElement);
+   mVersions.erase(pElement);
+}
+
+void ResultCache::elementModified(RasterElement* pElement)
+{
+   invalidate(pElement);
+}
@@ -0,0 +1,117 @@
+/*
+ * The information in this file is
+ * Copyright(c) 2007 Ball Aerospace & Technologies Corporation
+ * and is subject to the terms and conditions of the
+ * GNU Lesser General Public License Version 2.1
+ * The license text is available from
+ * http://www.gnu.org/licenses/lgpl.html
+ */
+
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include "AppConfig.h"
+#include "ElementWatcher.h"
+#include "IdlFunctions.h"
+#include "TypesFile.h"
+#include <idl_export.h>
+#include <list>
+#include <map>
+#include <vector>
+
+class RasterElement;
+
+/**
+ * These are internal support methods not used in IDL.
+ * \cond INTERNAL
+ */
+
+/**
+ * Keeps copies of the arrays returned from array_to_idl() so a repeated request for
+ * an unchanged subcube is copied from memory instead of being read and converted again.
+ *
+ * Each raster element has a version which changes whenever its data is modified or an
+ * IDL array is given direct access to its data. Results are kept for the current version
+ * of an element only, and are evicted in least recently used order once the cache holds
+ * more than the IdlInterpreter/ResultCacheSize setting, in megabytes.
+ */
+class ResultCache : private ElementWatcher::Listener
+{
+public:
+   static ResultCache& instance();
+
+   /**
+    * Read the cache settings.
+    *
+    * @return \c true if the cache should be used, \c false if its size is zero.
+    */
+   bool applySettings();
+
+   /**
+    * Copy a kept result into a buffer.
+    *
+    * @return \c true if a result for the current version of the element was found
+    *         and copied, \c false otherwise.
+    */
+   bool copy(RasterElement* pElement, const IdlFunctions::Subcube& subcube, InterleaveFormatType interleave,
+      int type, UCHAR* pData, size_t bytes);
+
+   /**
+    * Keep a copy of a result for the current version of the element. Results larger
+    * than a quarter of the cache are not kept.
+    */
+   void insert(RasterElement* pElement, const IdlFunctions::Subcube& subcube, InterleaveFormatType interleave,
+      int type, const UCHAR* pData, size_t bytes);
+
+   /**
+    * Start a new version of an element whose data may be changed without a signal,
+    * such as when an IDL array refers to the element's data.
+    */
+   void invalidate(RasterElement* pElement);
+
+   /**
+    * Drop every result.
+    */
+   void clear();
+
+private:
+   struct ResultKey
+   {
+      ResultKey(RasterElement* pElement, unsigned int version, const IdlFunctions::Subcube& subcube,
+         InterleaveFormatType interleave, int type);
+
+      bool operator<(const ResultKey& other) const;
+
+      RasterElement* mpElement;
+      unsigned int mVersion;
+      std::vector<unsigned int> mValues;
+   };
+
+   struct Result
+   {
+      std::vector<char> mData;
+      std::list<ResultKey>::iterator mRecent;
+   };
+
+   ResultCache();
+   ResultCache(const ResultCache& rhs);
+   ResultCache& operator=(const ResultCache& rhs);
+
+   unsigned int getVersion(RasterElement* pElement);
+   void removeResults(RasterElement* pElement);
+   void evict();
+
+   void elementDeleted(RasterElement* pElement);
+   void elementModified(RasterElement* pElement);
+
+   ElementWatcher mWatcher;
+   std::map<ResultKey, Result> mResults;
+   std::list<ResultKey> mRecent;
+   std::map<RasterElement*, unsigned int> mVersions;
+   size_t mBudget;
+   size_t mBytes;
+};
+
+///\endcond INTERNAL
+
+#endif
@@ -0,0 +1,382 @@
+/*
+ * The information in this file is
+ * Copyright(c) 2007 Ball Aerospace & Technologies Corporation
+ * and is subject to the terms and conditions of the
+ * GNU Lesser General Public License Version 2.1
+ * The license text is available from
+ * http://www.gnu.org/licenses/lgpl.html
+ */
+
+#include "ConfigurationSettings.h"
+#include "DataVariant.h"
+#include "RasterDataDescriptor.h"
+#include "RasterElement.h"
+#include "TileCache.h"
+#include <pthread.h>
+#include <algorithm>
+#include <limits>
+#include <new>
+
+namespace
+{
+   const size_t TileBytes = 4 * 1024 * 1024;
+   const size_t BytesPerMegabyte = 1024 * 1024;
+   const unsigned int UnknownBlock = std::numeric_limits<unsigned int>::max();
+}
+
+TileCache& TileCache::instance()
+{
+   static TileCache sCache;
+   return sCache;
+}
+
+TileCache::TileCache() :
+   mWatcher(*this, true),
+   mBudget(0),
+   mBytes(0),
+   mThreadCount(1),
+   mPrefetchRunning(false),
+   mStopping(false),
+   mPrefetchPending(false),
+   mpLoadingElement(NULL)
+{
+   pthread_mutex_init(&mMutex, NULL);
+   pthread_cond_init(&mCondition, NULL);
+}
+
+TileCache::~TileCache()
+{
+   //the elements are gone by now so only the thread and the tiles are cleaned up
+   stopPrefetch();
+   for (std::map<TileKey, Tile*>::iterator tile = mTiles.begin(); tile != mTiles.end(); ++tile)
+   {
+      delete tile->second;
+   }
+   pthread_cond_destroy(&mCondition);
+   pthread_mutex_destroy(&mMutex);
+}
+
+bool TileCache::applySettings()
+{
+   const unsigned int megabytes = dv_cast<unsigned int>(
+      Service<ConfigurationSettings>()->getSetting("IdlInterpreter/TileCacheSize"), 256);
+   pthread_mutex_lock(&mMutex);
+   mBudget = static_cast<size_t>(megabytes) * BytesPerMegabyte;
+   mThreadCount = IdlFunctions::getThreadCount();
+   evict();
+   pthread_mutex_unlock(&mMutex);
+   return megabytes > 0;
+}
+
+void TileCache::clear()
+{
+   stopPrefetch();
+
+   pthread_mutex_lock(&mMutex);
+   for (std::map<TileKey, Tile*>::iterator tile = mTiles.begin(); tile != mTiles.end(); ++tile)
+   {
+      delete tile->second;
+   }
+   mTiles.clear();
+   mRecent.clear();
+   mLastBlocks.clear();
+   mBytes = 0;
+   pthread_mutex_unlock(&mMutex);
+
+   mWatcher.clear();
+}
+
+bool TileCache::isCacheable(const RasterDataDescriptor* pDesc, const IdlFunctions::Subcube& subcube)
+{
+   const bool bandTiles = (pDesc->getInterleaveFormat() == BSQ);
+   if (subcube.mRowSkip > 1 || subcube.mColumnSkip > 1 || (subcube.mBandSkip > 1 && !bandTiles))
+   {
+      return false;
+   }
+
+   //each BSQ band has its own tiles so the size of a single band is compared
+   const uint64_t tileBytes = static_cast<uint64_t>(getTileRowCount(pDesc)) * pDesc->getColumnCount() *
+      pDesc->getBytesPerElement() * (bandTiles ? 1 : pDesc->getBandCount());
+   const uint64_t bytes = static_cast<uint64_t>(subcube.getRowCount()) * subcube.getColumnCount() *
+      pDesc->getBytesPerElement() * (bandTiles ? 1 : subcube.getBandCount());
+   return bytes * 4 >= tileBytes;
+}
+
+unsigned int TileCache::getTileRowCount(const RasterDataDescriptor* pDesc)
+{
+   size_t rowBytes = static_cast<size_t>(pDesc->getColumnCount()) * pDesc->getBytesPerElement();
+   if (pDesc->getInterleaveFormat() != BSQ)
+   {
+      rowBytes *= pDesc->getBandCount();
+   }
+   const size_t rows = std::max<size_t>(1, TileBytes / std::max<size_t>(1, rowBytes));
+   return static_cast<unsigned int>(std::min<size_t>(rows, std::max<size_t>(1, pDesc->getRowCount())));
+}
+
+TileCache::Tile* TileCache::acquire(RasterElement* pElement, unsigned int band, unsigned int block)
+{
+   const RasterDataDescriptor* pDesc = static_cast<const RasterDataDescriptor*>(pElement->getDataDescriptor());
+   const unsigned int tileRows = getTileRowCount(pDesc);
+   const unsigned int blockCount = (pDesc->getRowCount() + tileRows - 1) / tileRows;
+   const TileKey key(pElement, band, block);
+
+   pthread_mutex_lock(&mMutex);
+
+   //read ahead only when the blocks of a band are visited in order
+   unsigned int& lastBlock =
+      mLastBlocks.insert(std::make_pair(std::make_pair(pElement, band), UnknownBlock)).first->second;
+   const bool sequential = (lastBlock != UnknownBlock && lastBlock + 1 == block);
+   lastBlock = block;
+
+   Tile* pTile = NULL;
+   for (;;)
+   {
+      std::map<TileKey, Tile*>::iterator found = mTiles.find(key);
+      if (found == mTiles.end())
+      {
+         break;
+      }
+      if (!found->second->mLoading)
+      {
+         pTile = found->second;
+         break;
+      }
+      pthread_cond_wait(&mCondition, &mMutex);
+   }
+
+   if (pTile != NULL)
+   {
+      ++pTile->mPins;
+      mRecent.splice(mRecent.begin(), mRecent, pTile->mRecent);
+   }
+   else
+   {
+      //the placeholder keeps the read ahead thread from loading the same tile
+      pTile = new Tile;
+      pTile->mPins = 1;
+      mTiles[key] = pTile;
+      const unsigned int threadCount = mThreadCount;
+      pthread_mutex_unlock(&mMutex);
+      const bool loaded = loadTile(key, pTile, threadCount);
+      pthread_mutex_lock(&mMutex);
+      if (!loaded)
+      {
+         mTiles.erase(key);
+         pthread_cond_broadcast(&mCondition);
+         pthread_mutex_unlock(&mMutex);
+         delete pTile;
+         return NULL;
+      }
+      insertLoadedTile(key, pTile);
+   }
+
+   if (sequential && block + 1 < blockCount)
+   {
+      prefetch(TileKey(pElement, band, block + 1));
+   }
+   pthread_mutex_unlock(&mMutex);
+   return pTile;
+}
+
+void TileCache::release(Tile* pTile)
+{
+   pthread_mutex_lock(&mMutex);
+   --pTile->mPins;
+   evict();
+   pthread_mutex_unlock(&mMutex);
+}
+
+bool TileCache::loadTile(const TileKey& key, Tile* pTile, unsigned int threadCount)
+{
+   const RasterDataDescriptor* pDesc =
+      static_cast<const RasterDataDescriptor*>(key.mpElement->getDataDescriptor());
+   const unsigned int tileRows = getTileRowCount(pDesc);
+
+   IdlFunctions::Subcube subcube;
+   subcube.mHeightStart = key.mBlock * tileRows;
+   subcube.mHeightEnd = std::min(subcube.mHeightStart + tileRows, pDesc->getRowCount()) - 1;
+   subcube.mWidthEnd = pDesc->getColumnCount() - 1;
+   if (pDesc->getInterleaveFormat() == BSQ)
+   {
+      subcube.mBandStart = key.mBand;
+      subcube.mBandEnd = key.mBand;
+   }
+   else
+   {
+      subcube.mBandEnd = pDesc->getBandCount() - 1;
+   }
+
+   pTile->mFirstRow = subcube.mHeightStart;
+   pTile->mRowCount = subcube.getRowCount();
+   try
+   {
+      pTile->mData.resize(static_cast<size_t>(subcube.getRowCount()) * subcube.getColumnCount() *
+         subcube.getBandCount() * pDesc->getBytesPerElement());
+   }
+   catch (const std::bad_alloc&)
+   {
+      return false;
+   }
+   return IdlFunctions::readNativeSubcube(&pTile->mData[0], key.mpElement, subcube, threadCount);
+}
+
+void TileCache::insertLoadedTile(const TileKey& key, Tile* pTile)
+{
+   pTile->mLoading = false;
+   mRecent.push_front(key);
+   pTile->mRecent = mRecent.begin();
+   mBytes += pTile->mData.size();
+   pthread_cond_broadcast(&mCondition);
+   evict();
+}
+
+void TileCache::evict()
+{
+   std::list<TileKey>::iterator key = mRecent.end();
+   while (mBytes > mBudget && key != mRecent.begin())
+   {
+      --key;
+      std::map<TileKey, Tile*>::iterator found = mTiles.find(*key);
+      if (found == mTiles.end() || found->second->mPins > 0)
+      {
+         continue;
+      }
+      mBytes -= found->second->mData.size();
+      delete found->second;
+      mTiles.erase(found);
+      key = mRecent.erase(key);
+   }
+}
+
+void TileCache::removeTiles(RasterElement* pElement)
+{
+   //a tile of this element may be in the middle of being read ahead
+   while (mpLoadingElement == pElement)
+   {
+      pthread_cond_wait(&mCondition, &mMutex);
+   }
+   if (mPrefetchPending && mPrefetchKey.mpElement == pElement)
+   {
+      mPrefetchPending = false;
+   }
+
+   std::map<TileKey, Tile*>::iterator tile = mTiles.lower_bound(TileKey(pElement));
+   while (tile != mTiles.end() && tile->first.mpElement == pElement)
+   {
+      if (!tile->second->mLoading)
+      {
+         mRecent.erase(tile->second->mRecent);
+         mBytes -= tile->second->mData.size();
+      }
+      delete tile->second;
+      mTiles.erase(tile++);
+   }
+
+   std::map<std::pair<RasterElement*, unsigned int>, unsigned int>::iterator last =
+      mLastBlocks.lower_bound(std::make_pair(pElement, 0U));
+   while (last != mLastBlocks.end() && last->first.first == pElement)
+   {
+      mLastBlocks.erase(last++);
+   }
+}
+
+void TileCache::prefetch(const TileKey& key)
+{
+   if (mTiles.find(key) != mTiles.end())
+   {
+      return;
+   }
+   mPrefetchKey = key;
+   mPrefetchPending = true;
+   if (!mPrefetchRunning)
+   {
+      mPrefetchRunning = (pthread_create(&mPrefetchThread, NULL, runPrefetch, this) == 0);
+      if (!mPrefetchRunning)
+      {
+         mPrefetchPending = false;
+      }
+   }
+   pthread_cond_broadcast(&mCondition);
+}
+
+void* TileCache::runPrefetch(void* pArg)
+{
+   static_cast<TileCache*>(pArg)->processPrefetches();
+   return NULL;
+}
+
+void TileCache::processPrefetches()
+{
+   pthread_mutex_lock(&mMutex);
+   for (;;)
+   {
+      while (!mStopping && !mPrefetchPending)
+      {
+         pthread_cond_wait(&mCondition, &mMutex);
+      }
+      if (mStopping)
+      {
+         break;
+      }
+      const TileKey key = mPrefetchKey;
+      mPrefetchPending = false;
+      if (mTiles.find(key) != mTiles.end())
+      {
+         continue;
+      }
+
+      Tile* pTile = new Tile;
+      mTiles[key] = pTile;
+      mpLoadingElement = key.mpElement;
+      pthread_mutex_unlock(&mMutex);
+      const bool loaded = loadTile(key, pTile, 1);
+      pthread_mutex_lock(&mMutex);
+      mpLoadingElement = NULL;
+      if (loaded)
+      {
+         insertLoadedTile(key, pTile);
+      }
+      else
+      {
+         mTiles.erase(key);
+         delete pTile;
+         pthread_cond_broadcast(&mCondition);
+      }
+   }
+   pthread_mutex_unlock(&mMutex);
+}
+
+void TileCache::stopPrefetch()
+{
+   pthread_mutex_lock(&mMutex);
+   if (!mPrefetchRunning)
+   {
+      pthread_mutex_unlock(&mMutex);
+      return;
+   }
+   mStopping = true;
+   pthread_cond_broadcast(&mCondition);
+   pthread_mutex_unlock(&mMutex);
+
+   pthread_join(mPrefetchThread, NULL);
+
+   pthread_mutex_lock(&mMutex);
+   mPrefetchRunning = false;
+   mPrefetchPending = false;
+   mStopping = false;
+   pthread_mutex_unlock(&mMutex);
+}
+
+void TileCache::elementDeleted(RasterElement* pElement)
+{
+   pthread_mutex_lock(&mMutex);
+   removeTiles(pElement);
+   pthread_mutex_unlock(&mMutex);
+}
+
+void TileCache::elementModified(RasterElement* pElement)
+{
+   pthread_mutex_lock(&mMutex);
+   removeTiles(pElement);
+   pthread_mutex_unlock(&mMutex);
+}
@@ -0,0 +1,239 @@
+/*
+ * The information in this file is
+ * Copyright(c) 2007 Ball Aerospace & Technologies Corporation
+ * and is subject to the terms and conditions of the
+ * GNU Lesser General Public License Version 2.1
+ * The license text is available from
+ * http://www.gnu.org/licenses/lgpl.html
+ */
+
+#ifndef TILECACHE_H
+#define TILECACHE_H
+
+#include "ElementWatcher.h"
+#include "IdlFunctions.h"
+#include "RasterDataDescriptor.h"
+#include "RasterElement.h"
+#include "TypesFile.h"
+#include <pthread.h>
+#include <list>
+#include <map>
+#include <utility>
+#include <vector>
+
+/**
+ * These are internal support methods not used in IDL.
+ * \cond INTERNAL
+ */
+
+/**
+ * Keeps blocks of rows of on-disk raster elements between calls to array_to_idl().
+ *
+ * A tile is a block of rows stored in the element's interleave. BSQ tiles hold a
+ * single band and BIP and BIL tiles hold every band. Tiles are evicted in least
+ * recently used order once the cache holds more than the
+ * IdlInterpreter/TileCacheSize setting, in megabytes, and are dropped when the
+ * element's data is modified or the element is deleted. When a tile is requested
+ * right after the tile before it, the following tile is read on a background
+ * thread. Subcubes with skipped rows or columns, or much smaller than a tile, are
+ * not worth caching since a tile would read far more data than was requested.
+ */
+class TileCache : private ElementWatcher::Listener
+{
+public:
+   static TileCache& instance();
+
+   /**
+    * Read the cache settings.
+    *
+    * @return \c true if the cache should be used, \c false if its size is zero.
+    */
+   bool applySettings();
+
+   /**
+    * Determine if a subcube should be copied through the cache. Subcubes with skipped
+    * rows or columns, skipped bands of BIP or BIL data, or less than a quarter of the
+    * size of a tile are read directly instead.
+    */
+   static bool isCacheable(const RasterDataDescriptor* pDesc, const IdlFunctions::Subcube& subcube);
+
+   /**
+    * Copy a subcube of a raster element through the cache into a buffer laid
+    * out in the given interleave.
+    *
+    * @param success
+    *        Set to \c true if the subcube was copied and \c false otherwise.
+    *        An IDL message is posted on failure.
+    */
+   template<typename T>
+   void copySubcube(T* pData, RasterElement* pElement, const IdlFunctions::Subcube& subcube,
+      InterleaveFormatType interleave, bool& success)
+   {
+      success = false;
+      const RasterDataDescriptor* pDesc = (pElement == NULL) ? NULL :
+         static_cast<const RasterDataDescriptor*>(pElement->getDataDescriptor());
+      const size_t rows = subcube.getRowCount();
+      const size_t columns = subcube.getColumnCount();
+      const size_t bands = subcube.getBandCount();
+      size_t dstStrides[3];
+      if (pData == NULL || pDesc == NULL ||
+         !IdlFunctions::getInterleaveStrides(interleave, rows, columns, bands, dstStrides))
+      {
+         return;
+      }
+      mWatcher.watch(pElement);
+
+      const bool bandTiles = (pDesc->getInterleaveFormat() == BSQ);
+      const unsigned int tileRows = getTileRowCount(pDesc);
+      size_t tileStrides[3];
+      IdlFunctions::getInterleaveStrides(pDesc->getInterleaveFormat(), tileRows, pDesc->getColumnCount(),
+         bandTiles ? 1 : pDesc->getBandCount(), tileStrides);
+      const size_t srcStrides[3] = {tileStrides[0] * subcube.mRowSkip, tileStrides[1] * subcube.mColumnSkip,
+         tileStrides[2] * subcube.mBandSkip};
+
+      const size_t groups = bandTiles ? bands : 1;
+      for (size_t group = 0; group < groups; ++group)
+      {
+         const unsigned int band = bandTiles ? subcube.getBand(static_cast<unsigned int>(group)) : 0;
+         for (size_t row = 0; row < rows;)
+         {
+            const unsigned int sourceRow = subcube.mHeightStart + static_cast<unsigned int>(row) * subcube.mRowSkip;
+            Tile* pTile = acquire(pElement, band, sourceRow / tileRows);
+            if (pTile == NULL)
+            {
+               IDL_Message(IDL_M_GENERIC, IDL_MSG_RET, "error in copying array values to IDL.");
+               return;
+            }
+
+            //copy every requested row held by this tile
+            const size_t lastRow = pTile->mFirstRow + pTile->mRowCount - 1;
+            const size_t count = std::min(rows - row, (lastRow - sourceRow) / subcube.mRowSkip + 1);
+            const T* pSrc = reinterpret_cast<const T*>(&pTile->mData[0]) +
+               (sourceRow - pTile->mFirstRow) * tileStrides[0] + subcube.mWidthStart * tileStrides[1];
+            if (bandTiles || subcube.mBandList.empty())
+            {
+               if (!bandTiles)
+               {
+                  pSrc += subcube.mBandStart * tileStrides[2];
+               }
+               const size_t counts[3] = {count, columns, bandTiles ? 1 : bands};
+               IdlFunctions::copyCube(pSrc, srcStrides, pData + row * dstStrides[0] + group * dstStrides[2],
+                  dstStrides, counts);
+            }
+            else
+            {
+               //the tile holds every band so gather the listed ones one at a time
+               const size_t counts[3] = {count, columns, 1};
+               for (size_t index = 0; index < bands; ++index)
+               {
+                  IdlFunctions::copyCube(pSrc + subcube.mBandList[index] * tileStrides[2], srcStrides,
+                     pData + row * dstStrides[0] + index * dstStrides[2], dstStrides, counts);
+               }
+            }
+            release(pTile);
+            row += count;
+         }
+      }
+      success = true;
+   }
+
+   /**
+    * Drop every tile and stop the read ahead thread.
+    */
+   void clear();
+
+private:
+   struct TileKey
+   {
+      TileKey(RasterElement* pElement = NULL, unsigned int band = 0, unsigned int block = 0) :
+         mpElement(pElement),
+         mBand(band),
+         mBlock(block)
+      {}
+
+      bool operator<(const TileKey& other) const
+      {
+         if (mpElement != other.mpElement)
+         {
+            return mpElement < other.mpElement;
+         }
+         if (mBand != other.mBand)
+         {
+            return mBand < other.mBand;
+         }
+         return mBlock < other.mBlock;
+      }
+
+      RasterElement* mpElement;
+      unsigned int mBand;
+      unsigned int mBlock;
+   };
+
+   struct Tile
+   {
+      Tile() :
+         mFirstRow(0),
+         mRowCount(0),
+         mPins(0),
+         mLoading(true)
+      {}
+
+      std::vector<char> mData;
+      unsigned int mFirstRow;
+      unsigned int mRowCount;
+      unsigned int mPins;
+      bool mLoading;
+      std::list<TileKey>::iterator mRecent;
+   };
+
+   TileCache();
+   ~TileCache();
+   TileCache(const TileCache& rhs);
+   TileCache& operator=(const TileCache& rhs);
+
+   static unsigned int getTileRowCount(const RasterDataDescriptor* pDesc);
+   Tile* acquire(RasterElement* pElement, unsigned int band, unsigned int block);
+   void release(Tile* pTile);
+   bool loadTile(const TileKey& key, Tile* pTile, unsigned int threadCount);
+   void insertLoadedTile(const TileKey& key, Tile* pTile);
+   void evict();
+   void removeTiles(RasterElement* pElement);
+   void stopPrefetch();
+   void prefetch(const TileKey& key);
+   static void* runPrefetch(void* pArg);
+   void processPrefetches();
+
+   void elementDeleted(RasterElement* pElement);
+   void elementModified(RasterElement* pElement);
+
+   pthread_mutex_t mMutex;
+   pthread_cond_t mCondition;
+   ElementWatcher mWatcher;
+   std::map<TileKey, Tile*> mTiles;
+   std::list<TileKey> mRecent;
+   std::map<std::pair<RasterElement*, unsigned int>, unsigned int> mLastBlocks;
+   size_t mBudget;
+   size_t mBytes;
+   unsigned int mThreadCount;
+
+   pthread_t mPrefetchThread;
+   bool mPrefetchRunning;
+   bool mStopping;
+   bool mPrefetchPending;
+   TileKey mPrefetchKey;
+   RasterElement* mpLoadingElement;
+};
+
+/**
+ * Copy a subcube through the TileCache. This can be used with switchOnEncoding.
+ */
+template<typename T>
+void copyCachedSubcube(T* pData, RasterElement* pElement, const IdlFunctions::Subcube& subcube,
+   InterleaveFormatType interleave, bool& success)
+{
+   TileCache::instance().copySubcube(pData, pElement, subcube, interleave, success);
+}
+
+///\endcond INTERNAL
+
+#endif